@@ -0,0 +1,57 @@
+"""
+Compare meshing every root shape in one parallel pass against
+meshing one root shape after another, using the mesh stage time
+`ConvertStats` records for the public conversion API.
+
+    python benchmarks/bench_meshing.py [file.step ...]
+
+A many-roots assembly repeating the test model as independent
+products is meshed in one conversion, against converting the
+test model alone once per copy. The mesh stage of every other
+file given is timed as well.
+"""
+
+import os
+import sys
+import tempfile
+
+import cascadio
+from corpus import many_roots, model
+
+
+def mesh_seconds(file_name, count=3, tol_linear=0.001):
+    """
+    The fastest mesh stage of `count` conversions of `file_name`.
+    """
+    walls = []
+    with tempfile.TemporaryDirectory() as D:
+        out = os.path.join(D, "out.glb")
+        for _ in range(count):
+            stats = cascadio.ConvertStats()
+            if cascadio.step_to_glb(file_name, out, tol_linear, stats=stats) != 0:
+                raise RuntimeError("failed to convert: " + file_name)
+            walls.append(stats.mesh.wall)
+    return min(walls)
+
+
+if __name__ == "__main__":
+    copies = 64
+    with tempfile.TemporaryDirectory() as D:
+        roots = os.path.join(D, "many_roots.step")
+        with open(roots, "w") as f:
+            f.write(many_roots(model, copies))
+
+        print("{:>40} {:>10} {:>10} {:>8}".format("file", "per-root", "one-pass", "speedup"))
+        loop = copies * mesh_seconds(model)
+        single = mesh_seconds(roots)
+        print(
+            "{:>40} {:>9.3f}s {:>9.3f}s {:>7.2f}x".format(
+                os.path.basename(roots), loop, single, loop / single
+            )
+        )
+        for file_name in sys.argv[1:]:
+            print(
+                "{:>40} {:>10} {:>9.3f}s".format(
+                    os.path.basename(file_name), "", mesh_seconds(file_name)
+                )
+            )
@@ -0,0 +1,275 @@
+"""
+Run every conversion API over a corpus of STEP files and
+record per-stage time, peak memory and mesh sizes as JSON
+so releases and OCCT bumps can be compared.
+
+    python benchmarks/bench_suite.py [--corpus DIR] [--output FILE]
+        [--baseline FILE] [--tolerance 0.2] [--repeat 3]
+
+Generated small, medium and large many-product assemblies, a
+grid of instances of one part through a shared sub-assembly and
+a single dense B-spline face are always included. Pass `--corpus`
+with a directory of real files to benchmark those as well.
+
+With `--scaling` the speedup of batches with more threads is
+recorded too. Parsing and transfer of a single file are serial
+inside OpenCASCADE, so files scale across cores, not within one.
+
+With `--metadata` the transfer with STEP validation properties,
+GD&T, views and materials, which are skipped by default, is
+timed against the default transfer for every file.
+
+The `scan_step` case only parses each file and walks its
+product structure, and its time as a fraction of `step_to_glb`
+is recorded as `scan_ratio` for every file.
+
+With `--baseline` the wall time of every case and of each of its
+stages is compared to a previous result and the exit status is 1
+if any is slower by more than `--tolerance`. Stages under
+`--floor` seconds in the baseline are too noisy and not compared.
+"""
+
+import argparse
+import glob
+import json
+import os
+import platform
+import sys
+import tempfile
+import time
+
+import cascadio
+from corpus import generate
+
+# the stages of ConvertStats with their own timings
+STAGES = ("read", "transfer", "mesh", "write")
+
+
+def run_case(api, file_name, directory, tol_linear):
+    """
+    Convert `file_name` once with `api` and return
+    its measurements as a dict.
+    """
+    stats = cascadio.ConvertStats()
+    start = time.perf_counter()
+    if api == "step_to_glb":
+        out = os.path.join(directory, "out.glb")
+        status = cascadio.step_to_glb(file_name, out, tol_linear, stats=stats)
+        if status != 0:
+            raise RuntimeError("failed to convert: " + file_name)
+    elif api == "convert_to_glb":
+        with open(file_name, "rb") as f:
+            data = f.read()
+        cascadio.convert_to_glb(data, "step", tol_linear, stats=stats)
+    elif api == "step_to_arrays":
+        cascadio.step_to_arrays(file_name, tol_linear, stats=stats)
+    elif api == "scan_step":
+        cascadio.scan_step(file_name, stats=stats)
+    else:
+        raise ValueError(api)
+    result = stats.to_dict()
+    result["total"] = time.perf_counter() - start
+    return result
+
+
+def run_suite(files, apis, repeat, tol_linear):
+    """
+    Run every API over every file keeping the fastest of
+    `repeat` runs, and return the result document.
+    """
+    cases = []
+    with tempfile.TemporaryDirectory() as D:
+        for name, file_name in sorted(files.items()):
+            for api in apis:
+                runs = [run_case(api, file_name, D, tol_linear) for _ in range(repeat)]
+                best = min(runs, key=lambda r: r["total"])
+                best["name"] = name
+                best["api"] = api
+                best["input_bytes"] = os.path.getsize(file_name)
+                cases.append(best)
+                print(
+                    "{:>24} {:>16} {:>9.3f}s {:>10} tris {:>8.1f} MB peak".format(
+                        name,
+                        api,
+                        best["total"],
+                        best["triangles"],
+                        max(best[stage]["peak_rss"] for stage in STAGES)
+                        / 1e6,
+                    )
+                )
+
+    totals = {(c["name"], c["api"]): c["total"] for c in cases}
+    scan_ratio = {}
+    for name in sorted(files):
+        if (name, "scan_step") in totals and (name, "step_to_glb") in totals:
+            scan_ratio[name] = totals[(name, "scan_step")] / max(
+                totals[(name, "step_to_glb")], 1e-9
+            )
+            print(
+                "{:>24} {:>16} {:>9.3f}x".format(
+                    name, "scan/step_to_glb", scan_ratio[name]
+                )
+            )
+
+    return {
+        "version": cascadio.__version__,
+        "occt_version": cascadio.__occt_version__,
+        "python": platform.python_version(),
+        "machine": platform.machine(),
+        "cpus": os.cpu_count(),
+        "tol_linear": tol_linear,
+        "cases": cases,
+        "scan_ratio": scan_ratio,
+    }
+
+
+def run_scaling(file_name, repeat, tol_linear):
+    """
+    Time converting a batch of copies of `file_name` with an
+    increasing number of threads and return the speedups.
+    """
+    cpus = os.cpu_count() or 1
+    counts = sorted(set([1, 2, 4, 8, 16, cpus]))
+    counts = [c for c in counts if c <= cpus]
+    results = []
+    with tempfile.TemporaryDirectory() as D:
+        inputs = [file_name] * max(counts) * 2
+        outputs = [os.path.join(D, "%d.glb" % i) for i in range(len(inputs))]
+        for count in counts:
+            times = []
+            for _ in range(repeat):
+                start = time.perf_counter()
+                cascadio.step_to_glb_batch(
+                    inputs, outputs, tol_linear, num_threads=count
+                )
+                times.append(time.perf_counter() - start)
+            results.append({"threads": count, "total": min(times)})
+    for result in results:
+        result["speedup"] = results[0]["total"] / result["total"]
+        print(
+            "{:>24} {:>16} {:>9.3f}s {:>9.2f}x".format(
+                "batch", "%d threads" % result["threads"], result["total"],
+                result["speedup"],
+            )
+        )
+    return results
+
+
+def run_metadata(files, repeat, tol_linear):
+    """
+    Time the transfer stage of every file with and without
+    the STEP metadata no output uses, and return the ratios.
+    """
+    results = []
+    with tempfile.TemporaryDirectory() as D:
+        out = os.path.join(D, "out.glb")
+        for name, file_name in sorted(files.items()):
+            times = {}
+            for metadata in (False, True):
+                read = cascadio.ReadOptions(metadata=metadata)
+                walls = []
+                for _ in range(repeat):
+                    stats = cascadio.ConvertStats()
+                    cascadio.step_to_glb(
+                        file_name,
+                        out,
+                        tol_linear,
+                        stats=stats,
+                        read=read,
+                    )
+                    walls.append(stats.transfer.wall)
+                times[metadata] = min(walls)
+            result = {
+                "name": name,
+                "transfer": times[False],
+                "transfer_metadata": times[True],
+                "speedup": times[True] / max(times[False], 1e-9),
+            }
+            results.append(result)
+            print(
+                "{:>24} {:>16} {:>9.3f}s {:>9.3f}s {:>9.2f}x".format(
+                    name, "metadata", result["transfer_metadata"],
+                    result["transfer"], result["speedup"],
+                )
+            )
+    return results
+
+
+def compare(result, baseline, tolerance, floor=0.01):
+    """
+    Return a line for every case, or stage of a case, slower
+    than its baseline by more than `tolerance`. A slower stage
+    can hide behind a faster one in the total, so both count.
+    """
+    before = {(c["name"], c["api"]): c for c in baseline["cases"]}
+    slower = []
+    for case in result["cases"]:
+        old = before.get((case["name"], case["api"]))
+        if old is None:
+            continue
+        times = [("total", old["total"], case["total"])]
+        for stage in STAGES:
+            if stage in old and old[stage]["wall"] >= floor:
+                times.append((stage, old[stage]["wall"], case[stage]["wall"]))
+        for label, then, now in times:
+            ratio = now / max(then, 1e-9)
+            if ratio > 1.0 + tolerance:
+                slower.append(
+                    "{} {} {}: {:.3f}s -> {:.3f}s ({:.2f}x)".format(
+                        case["name"], case["api"], label, then, now, ratio
+                    )
+                )
+    return slower
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[1])
+    parser.add_argument("--corpus", help="directory of extra STEP files")
+    parser.add_argument("--output", default="benchmark.json")
+    parser.add_argument("--baseline", help="previous output to compare against")
+    parser.add_argument("--tolerance", type=float, default=0.2)
+    parser.add_argument("--floor", type=float, default=0.01)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--tol-linear", type=float, default=0.01)
+    parser.add_argument(
+        "--apis", default="step_to_glb,convert_to_glb,step_to_arrays,scan_step"
+    )
+    parser.add_argument(
+        "--scaling", action="store_true", help="record thread scaling"
+    )
+    parser.add_argument(
+        "--metadata", action="store_true", help="time skipping STEP metadata"
+    )
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as D:
+        files = generate(D)
+        if args.corpus is not None:
+            for ext in ("*.step", "*.stp", "*.STEP", "*.STP"):
+                for path in glob.glob(os.path.join(args.corpus, ext)):
+                    files[os.path.basename(path)] = path
+        result = run_suite(
+            files, args.apis.split(","), args.repeat, args.tol_linear
+        )
+        if args.scaling:
+            result["scaling"] = run_scaling(
+                files["medium"], args.repeat, args.tol_linear
+            )
+        if args.metadata:
+            result["metadata"] = run_metadata(files, args.repeat, args.tol_linear)
+
+    with open(args.output, "w") as f:
+        json.dump(result, f, indent=2)
+
+    if args.baseline is not None:
+        with open(args.baseline, "r") as f:
+            baseline = json.load(f)
+        slower = compare(result, baseline, args.tolerance, args.floor)
+        for line in slower:
+            print("SLOWER " + line)
+        if len(slower) > 0:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
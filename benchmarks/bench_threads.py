@@ -0,0 +1,51 @@
+"""
+Compare converting the test model on several Python threads at
+once against converting it the same number of times on one.
+
+    python benchmarks/bench_threads.py [threads ...]
+
+Conversions release the GIL, so with OCCT kept single threaded
+the speedup is how much Python threads alone add.
+"""
+
+import os
+import sys
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import cascadio
+from corpus import model
+
+
+def seconds(data, threads, jobs):
+    """
+    Wall time of `jobs` conversions of `data` spread over `threads`.
+    """
+
+    def convert(_):
+        return cascadio.convert_to_glb(
+            data, "step", tol_linear=0.001, use_parallel=False
+        )
+
+    tic = time.perf_counter()
+    with ThreadPoolExecutor(threads) as pool:
+        list(pool.map(convert, range(jobs)))
+    return time.perf_counter() - tic
+
+
+if __name__ == "__main__":
+    with open(model, "rb") as f:
+        data = f.read()
+    counts = [int(a) for a in sys.argv[1:]] or [2, 4, min(os.cpu_count() or 1, 8)]
+
+    # warm up one-time OCCT initialization
+    seconds(data, 1, 1)
+    print("{:>8} {:>10} {:>10} {:>8}".format("threads", "serial", "threaded", "speedup"))
+    for count in counts:
+        serial = seconds(data, 1, count * 4)
+        threaded = seconds(data, count, count * 4)
+        print(
+            "{:>8} {:>9.3f}s {:>9.3f}s {:>7.2f}x".format(
+                count, serial, threaded, serial / threaded
+            )
+        )
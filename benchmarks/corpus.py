@@ -0,0 +1,316 @@
+"""
+Generated STEP files for the benchmarks, built by repeating
+the test model or writing geometry out directly so no large
+files need to live in the repo.
+"""
+
+import math
+import os
+import re
+
+cwd = os.path.abspath(os.path.dirname(__file__))
+model = os.path.join(cwd, "..", "tests", "models", "featuretype.STEP")
+
+
+def many_roots(path, copies):
+    """
+    Write a STEP file containing `copies` independent root
+    products, each a renumbered copy of the DATA of `path`.
+    """
+    with open(path, "r") as f:
+        text = f.read()
+    head, rest = text.split("DATA;", 1)
+    data, tail = rest.rsplit("ENDSEC;", 1)
+    offset = max(int(i) for i in re.findall(r"#(\d+)", data))
+
+    chunks = [
+        re.sub(r"#(\d+)", lambda m, k=k: "#%d" % (int(m.group(1)) + k * offset), data)
+        for k in range(copies)
+    ]
+    return head + "DATA;" + "".join(chunks) + "ENDSEC;" + tail
+
+
+# entities of the test model which assemblies reuse: its product
+# definition, shape representation and the origin placement and
+# unit context of that representation
+PART_DEFINITION, PART_REP, PART_ORIGIN, CONTEXT = 1773, 45, 390, 2086
+PRODUCT_CONTEXT, DEFINITION_CONTEXT = 304, 1246
+
+
+def assembly(path, root):
+    """
+    Write a STEP assembly placing instances of the part in `path`,
+    which must be the test model.
+
+    Parameters
+    ----------
+    path
+      The test model, whose product is the only part.
+    root
+      A dict with the product `name` of an assembly and its
+      `children`, a list of `(instance, (x, y, z), child)` where
+      `child` is None for the part or another such dict. A dict
+      used more than once is one shared sub-assembly. An optional
+      fourth element `((zx, zy, zz), (xx, xy, xz))` gives the axis
+      and reference direction of the instance.
+
+    Returns
+    -------
+    text
+      The STEP file, in the units of the test model.
+    """
+    with open(path, "r") as f:
+        text = f.read()
+    head, rest = text.split("DATA;", 1)
+    data, tail = rest.rsplit("ENDSEC;", 1)
+    last = [max(int(i) for i in re.findall(r"#(\d+)", data))]
+    lines = []
+
+    def reserve():
+        last[0] += 1
+        return last[0]
+
+    def add(entity):
+        index = reserve()
+        lines.append("#%d = %s ;\n" % (index, entity))
+        return index
+
+    def vector(values):
+        return "( %s )" % ", ".join("%.9f" % float(v) for v in values)
+
+    def placement(origin, axes=((0, 0, 1), (1, 0, 0))):
+        point = add("CARTESIAN_POINT ( '', %s )" % vector(origin))
+        axis = add("DIRECTION ( '', %s )" % vector(axes[0]))
+        ref = add("DIRECTION ( '', %s )" % vector(axes[1]))
+        return add("AXIS2_PLACEMENT_3D ( '', #%d, #%d, #%d )" % (point, axis, ref))
+
+    built = {}
+
+    def product(node):
+        if id(node) in built:
+            return built[id(node)]
+        name = node["name"]
+        item = add(
+            "PRODUCT ( '%s', '%s', '', ( #%d ) )" % (name, name, PRODUCT_CONTEXT)
+        )
+        formation = add("PRODUCT_DEFINITION_FORMATION ( '', '', #%d )" % item)
+        definition = add(
+            "PRODUCT_DEFINITION ( 'design', '', #%d, #%d )"
+            % (formation, DEFINITION_CONTEXT)
+        )
+        shape = add("PRODUCT_DEFINITION_SHAPE ( '', '', #%d )" % definition)
+        # the representation lists the placements of the children,
+        # so it is written once they are
+        rep = reserve()
+        add("SHAPE_DEFINITION_REPRESENTATION ( #%d, #%d )" % (shape, rep))
+        origin = placement((0, 0, 0))
+        built[id(node)] = (definition, rep, origin)
+
+        items = [origin]
+        for child in node["children"]:
+            instance, offset, sub = child[:3]
+            if sub is None:
+                target = (PART_DEFINITION, PART_REP, PART_ORIGIN)
+            else:
+                target = product(sub)
+            placed = placement(offset, *child[3:])
+            items.append(placed)
+            transform = add(
+                "ITEM_DEFINED_TRANSFORMATION ( '', '', #%d, #%d )"
+                % (target[2], placed)
+            )
+            relation = add(
+                "( REPRESENTATION_RELATIONSHIP ( '', '', #%d, #%d ) "
+                "REPRESENTATION_RELATIONSHIP_WITH_TRANSFORMATION ( #%d ) "
+                "SHAPE_REPRESENTATION_RELATIONSHIP ( ) )"
+                % (target[1], rep, transform)
+            )
+            usage = add(
+                "NEXT_ASSEMBLY_USAGE_OCCURRENCE ( '%s', '%s', '', #%d, #%d, $ )"
+                % (instance, instance, definition, target[0])
+            )
+            usage_shape = add("PRODUCT_DEFINITION_SHAPE ( '', '', #%d )" % usage)
+            add(
+                "CONTEXT_DEPENDENT_SHAPE_REPRESENTATION ( #%d, #%d )"
+                % (relation, usage_shape)
+            )
+        lines.append(
+            "#%d = SHAPE_REPRESENTATION ( '%s', ( %s ), #%d ) ;\n"
+            % (rep, name, ", ".join("#%d" % i for i in items), CONTEXT)
+        )
+        return built[id(node)]
+
+    product(root)
+    return head + "DATA;" + data + "".join(lines) + "ENDSEC;" + tail
+
+
+def bspline_face(count=64, size=100.0, height=5.0, waves=8):
+    """
+    Write a STEP file with a single B-spline face, a square of
+    `count` by `count` cubic control points rippled by `waves`
+    periods of `height`, which meshes into many triangles from
+    very little B-rep.
+
+    Returns
+    -------
+    text
+      The STEP file, in millimetres.
+    """
+    lines = []
+
+    def add(entity):
+        lines.append("#%d = %s ;\n" % (len(lines) + 1, entity))
+        return len(lines)
+
+    def ref(indices):
+        return "( %s )" % ", ".join("#%d" % i for i in indices)
+
+    def z(i, j):
+        u, v = i / (count - 1.0), j / (count - 1.0)
+        return height * math.sin(2 * math.pi * waves * u) * math.cos(
+            2 * math.pi * waves * v
+        )
+
+    points = [
+        [
+            add(
+                "CARTESIAN_POINT ( '', ( %.9f, %.9f, %.9f ) )"
+                % (size * i / (count - 1.0), size * j / (count - 1.0), z(i, j))
+            )
+            for j in range(count)
+        ]
+        for i in range(count)
+    ]
+    spans = count - 3
+    mults = "( %s )" % ", ".join(["4"] + ["1"] * (spans - 1) + ["4"])
+    knots = "( %s )" % ", ".join("%.9f" % (k / float(spans)) for k in range(spans + 1))
+
+    def curve(poles):
+        return add(
+            "B_SPLINE_CURVE_WITH_KNOTS ( '', 3, %s, .UNSPECIFIED., .F., .F., "
+            "%s, %s, .UNSPECIFIED. )" % (ref(poles), mults, knots)
+        )
+
+    surface = add(
+        "B_SPLINE_SURFACE_WITH_KNOTS ( '', 3, 3, ( %s ), .UNSPECIFIED., "
+        ".F., .F., .F., %s, %s, %s, %s, .UNSPECIFIED. )"
+        % (", ".join(ref(row) for row in points), mults, mults, knots, knots)
+    )
+    corners = [
+        add("VERTEX_POINT ( '', #%d )" % points[i][j])
+        for i, j in ((0, 0), (-1, 0), (-1, -1), (0, -1))
+    ]
+    # the boundary curves are the edge rows of poles, walked
+    # counterclockwise in the parameter plane
+    boundary = [
+        (corners[0], corners[1], [row[0] for row in points], ".T."),
+        (corners[1], corners[2], points[-1], ".T."),
+        (corners[3], corners[2], [row[-1] for row in points], ".F."),
+        (corners[0], corners[3], points[0], ".F."),
+    ]
+    edges = []
+    for start, end, poles, sense in boundary:
+        edge = add(
+            "EDGE_CURVE ( '', #%d, #%d, #%d, .T. )" % (start, end, curve(poles))
+        )
+        edges.append(add("ORIENTED_EDGE ( '', *, *, #%d, %s )" % (edge, sense)))
+    loop = add("EDGE_LOOP ( '', %s )" % ref(edges))
+    bound = add("FACE_OUTER_BOUND ( '', #%d, .T. )" % loop)
+    face = add("ADVANCED_FACE ( '', ( #%d ), #%d, .T. )" % (bound, surface))
+    shell = add("OPEN_SHELL ( '', ( #%d ) )" % face)
+    surfaces = add("SHELL_BASED_SURFACE_MODEL ( '', ( #%d ) )" % shell)
+
+    application = add("APPLICATION_CONTEXT ( 'automotive design' )")
+    add(
+        "APPLICATION_PROTOCOL_DEFINITION ( 'draft international standard', "
+        "'automotive_design', 1998, #%d )" % application
+    )
+    context = add("PRODUCT_CONTEXT ( '', #%d, 'mechanical' )" % application)
+    item = add("PRODUCT ( 'bspline', 'bspline', '', ( #%d ) )" % context)
+    formation = add("PRODUCT_DEFINITION_FORMATION ( '', '', #%d )" % item)
+    design = add(
+        "PRODUCT_DEFINITION_CONTEXT ( 'part definition', #%d, 'design' )"
+        % application
+    )
+    definition = add(
+        "PRODUCT_DEFINITION ( 'design', '', #%d, #%d )" % (formation, design)
+    )
+    shape = add("PRODUCT_DEFINITION_SHAPE ( '', '', #%d )" % definition)
+    length = add("( LENGTH_UNIT ( ) NAMED_UNIT ( * ) SI_UNIT ( .MILLI., .METRE. ) )")
+    angle = add("( NAMED_UNIT ( * ) PLANE_ANGLE_UNIT ( ) SI_UNIT ( $, .RADIAN. ) )")
+    solid = add("( NAMED_UNIT ( * ) SI_UNIT ( $, .STERADIAN. ) SOLID_ANGLE_UNIT ( ) )")
+    accuracy = add(
+        "UNCERTAINTY_MEASURE_WITH_UNIT ( LENGTH_MEASURE ( 1.0E-07 ), #%d, "
+        "'distance_accuracy_value', '' )" % length
+    )
+    units = add(
+        "( GEOMETRIC_REPRESENTATION_CONTEXT ( 3 ) "
+        "GLOBAL_UNCERTAINTY_ASSIGNED_CONTEXT ( ( #%d ) ) "
+        "GLOBAL_UNIT_ASSIGNED_CONTEXT ( ( #%d, #%d, #%d ) ) "
+        "REPRESENTATION_CONTEXT ( '', '' ) )" % (accuracy, length, angle, solid)
+    )
+    rep = add(
+        "MANIFOLD_SURFACE_SHAPE_REPRESENTATION ( 'bspline', ( #%d ), #%d )"
+        % (surfaces, units)
+    )
+    add("SHAPE_DEFINITION_REPRESENTATION ( #%d, #%d )" % (shape, rep))
+
+    return (
+        "ISO-10303-21;\nHEADER;\n"
+        "FILE_DESCRIPTION ( ( 'dense B-spline face' ), '2;1' );\n"
+        "FILE_NAME ( 'bspline.step', '', ( '' ), ( '' ), '', '', '' );\n"
+        "FILE_SCHEMA ( ( 'AUTOMOTIVE_DESIGN { 1 0 10303 214 1 1 1 1 }' ) );\n"
+        "ENDSEC;\nDATA;\n" + "".join(lines) + "ENDSEC;\nEND-ISO-10303-21;\n"
+    )
+
+
+def grid(rows, columns, spacing=20.0):
+    """
+    An `assembly` root placing `rows` instances of one shared row
+    sub-assembly, each of `columns` instances of the part.
+    """
+    row = {
+        "name": "row",
+        "children": [
+            ("part%d" % i, (i * spacing, 0, 0), None) for i in range(columns)
+        ],
+    }
+    return {
+        "name": "grid",
+        "children": [("row%d" % i, (0, i * spacing, 0), row) for i in range(rows)],
+    }
+
+
+def generate(directory, sizes=None):
+    """
+    Write the generated corpus into `directory`: the test model
+    repeated as independent products, a grid of instances of it
+    through a shared sub-assembly, which is meshed once however
+    large it gets, and one dense B-spline face.
+
+    Parameters
+    ----------
+    directory
+      Where to write the STEP files.
+    sizes
+      Map of case name to the number of copies of the test model.
+
+    Returns
+    -------
+    files
+      Map of case name to the path of its STEP file.
+    """
+    if sizes is None:
+        sizes = {"small": 1, "medium": 64, "large": 512}
+    cases = {}
+    for name, copies in sizes.items():
+        cases[name] = many_roots(model, copies)
+    cases["instanced"] = assembly(model, grid(16, 16))
+    cases["bspline"] = bspline_face()
+    files = {}
+    for name, text in cases.items():
+        path = os.path.join(directory, name + ".step")
+        with open(path, "w") as f:
+            f.write(text)
+        files[name] = path
+    return files
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <Quantity_ColorRGBA.hxx>
+#include <RWMesh_FaceIterator.hxx>
+#include <TCollection_AsciiString.hxx>
+#include <TDF_Label.hxx>
+#include <TDF_Tool.hxx>
+#include <TDataStd_Name.hxx>
+#include <TDocStd_Document.hxx>
+#include <XCAFPrs_DocumentExplorer.hxx>
+#include <XCAFPrs_Style.hxx>
+#include <gp_Trsf.hxx>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// Triangles of one part definition in its own coordinates.
+struct MeshArrays {
+  std::string name;
+  /// (n, 3) vertex positions.
+  std::vector<float> vertices;
+  /// (n, 3) unit vertex normals.
+  std::vector<float> normals;
+  /// (m, 3) zero-based vertex indices.
+  std::vector<uint32_t> faces;
+  /// (m, 4) RGBA per triangle, empty when no face has its own colour.
+  std::vector<uint8_t> face_colors;
+};
+
+/// One placement of a part definition in the scene.
+struct InstanceArrays {
+  InstanceArrays() : mesh(-1), has_color(false) {
+    for (int i = 0; i < 16; i++) {
+      transform[i] = (i % 5 == 0) ? 1.0 : 0.0;
+    }
+    for (int i = 0; i < 4; i++) {
+      color[i] = 1.0f;
+    }
+  }
+
+  /// Index into `SceneArrays::meshes`.
+  int mesh;
+  std::string name;
+  /// Row-major 4x4 homogeneous transform to world coordinates.
+  double transform[16];
+  /// Linear RGBA colour inherited from the assembly, if any.
+  float color[4];
+  bool has_color;
+};
+
+/// Every meshed part and every instance of a document.
+struct SceneArrays {
+  std::vector<MeshArrays> meshes;
+  std::vector<InstanceArrays> instances;
+};
+
+/// Name attribute of a label in UTF-8, or empty.
+static std::string label_name(const TDF_Label &label) {
+  Handle(TDataStd_Name) name;
+  if (label.IsNull() || !label.FindAttribute(TDataStd_Name::GetID(), name)) {
+    return std::string();
+  }
+  return TCollection_AsciiString(name->Get()).ToCString();
+}
+
+/// Append the triangulated faces of a part definition to `mesh`.
+static void part_arrays(const TDF_Label &part, MeshArrays &mesh) {
+  bool anyColor = false;
+  std::vector<Quantity_ColorRGBA> colors;
+  for (RWMesh_FaceIterator face(part, TopLoc_Location(), Standard_True);
+       face.More(); face.Next()) {
+    if (face.IsEmptyMesh()) {
+      continue;
+    }
+    const uint32_t base = (uint32_t)(mesh.vertices.size() / 3);
+    for (int n = face.NodeLower(); n <= face.NodeUpper(); n++) {
+      const gp_Pnt p = face.NodeTransformed(n);
+      const gp_Dir d = face.NormalTransformed(n);
+      mesh.vertices.push_back((float)p.X());
+      mesh.vertices.push_back((float)p.Y());
+      mesh.vertices.push_back((float)p.Z());
+      mesh.normals.push_back((float)d.X());
+      mesh.normals.push_back((float)d.Y());
+      mesh.normals.push_back((float)d.Z());
+    }
+    for (int t = face.ElemLower(); t <= face.ElemUpper(); t++) {
+      int a, b, c;
+      face.TriangleOriented(t).Get(a, b, c);
+      mesh.faces.push_back(base + (uint32_t)(a - face.NodeLower()));
+      mesh.faces.push_back(base + (uint32_t)(b - face.NodeLower()));
+      mesh.faces.push_back(base + (uint32_t)(c - face.NodeLower()));
+      colors.push_back(face.FaceColor());
+    }
+    anyColor = anyColor || face.HasFaceColor();
+  }
+
+  if (anyColor) {
+    mesh.face_colors.reserve(colors.size() * 4);
+    for (size_t i = 0; i < colors.size(); i++) {
+      Standard_Real r, g, b;
+      colors[i].GetRGB().Values(r, g, b, Quantity_TOC_sRGB);
+      mesh.face_colors.push_back((uint8_t)(r * 255.0 + 0.5));
+      mesh.face_colors.push_back((uint8_t)(g * 255.0 + 0.5));
+      mesh.face_colors.push_back((uint8_t)(b * 255.0 + 0.5));
+      mesh.face_colors.push_back((uint8_t)(colors[i].Alpha() * 255.0 + 0.5));
+    }
+  }
+}
+
+/// Walk a meshed XCAF document and collect one mesh per part
+/// definition plus every instance of it, without writing glTF.
+/// Coordinates stay in document units with the original Z up.
+static void document_arrays(const Handle(TDocStd_Document) & doc,
+                            SceneArrays &scene) {
+  std::map<std::string, int> meshIndex;
+  for (XCAFPrs_DocumentExplorer explorer(
+           doc, XCAFPrs_DocumentExplorerFlags_OnlyLeafNodes);
+       explorer.More(); explorer.Next()) {
+    const XCAFPrs_DocumentNode &node = explorer.Current();
+
+    TCollection_AsciiString entry;
+    TDF_Tool::Entry(node.RefLabel, entry);
+    std::map<std::string, int>::iterator found =
+        meshIndex.find(entry.ToCString());
+    int index;
+    if (found == meshIndex.end()) {
+      index = (int)scene.meshes.size();
+      meshIndex[entry.ToCString()] = index;
+      scene.meshes.push_back(MeshArrays());
+      scene.meshes.back().name = label_name(node.RefLabel);
+      part_arrays(node.RefLabel, scene.meshes.back());
+    } else {
+      index = found->second;
+    }
+
+    InstanceArrays instance;
+    instance.mesh = index;
+    instance.name = label_name(node.Label);
+    if (instance.name.empty()) {
+      instance.name = scene.meshes[(size_t)index].name;
+    }
+    const gp_Trsf trsf = node.Location.Transformation();
+    for (int row = 1; row <= 3; row++) {
+      for (int col = 1; col <= 4; col++) {
+        instance.transform[(row - 1) * 4 + (col - 1)] = trsf.Value(row, col);
+      }
+    }
+    if (node.Style.IsSetColorSurf()) {
+      const Quantity_ColorRGBA color = node.Style.GetColorSurfRGBA();
+      const NCollection_Vec4<float> rgba = color;
+      for (int i = 0; i < 4; i++) {
+        instance.color[i] = rgba[i];
+      }
+      instance.has_color = true;
+    }
+    scene.instances.push_back(instance);
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/// Runs jobs in submission order on at most `Limit()` worker threads,
+/// so that however many conversions are requested at once only that
+/// many run while the rest wait their turn. Workers start on demand
+/// and stay alive between jobs.
+class JobQueue {
+public:
+  /// The queue shared by every asynchronous conversion. It is never
+  /// destroyed, as detached workers may outlive static destruction.
+  static JobQueue &Instance() {
+    static JobQueue *queue = new JobQueue();
+    return *queue;
+  }
+
+  int Limit() const {
+    std::lock_guard<std::mutex> lock(myMutex);
+    return myLimit;
+  }
+
+  /// Change how many jobs may run at once, at least one. Running jobs
+  /// finish first when the limit is lowered.
+  void SetLimit(int limit) {
+    std::lock_guard<std::mutex> lock(myMutex);
+    myLimit = std::max(1, limit);
+    start();
+    myWake.notify_all();
+  }
+
+  void Submit(const std::function<void()> &job) {
+    std::lock_guard<std::mutex> lock(myMutex);
+    myJobs.push_back(job);
+    start();
+    myWake.notify_one();
+  }
+
+private:
+  JobQueue() : myLimit(1), myThreads(0), myIdle(0) {
+    myLimit = std::max(1, (int)std::thread::hardware_concurrency());
+  }
+
+  /// Start workers for waiting jobs up to the limit, with the lock held.
+  void start() {
+    while (myThreads < myLimit && myIdle < (int)myJobs.size()) {
+      myThreads++;
+      myIdle++;
+      std::thread(&JobQueue::run, this).detach();
+    }
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(myMutex);
+    for (;;) {
+      while (myJobs.empty() && myThreads <= myLimit) {
+        myWake.wait(lock);
+      }
+      if (myThreads > myLimit) {
+        myThreads--;
+        myIdle--;
+        return;
+      }
+      std::function<void()> job = myJobs.front();
+      myJobs.pop_front();
+      myIdle--;
+      lock.unlock();
+      job();
+      job = std::function<void()>();
+      lock.lock();
+      myIdle++;
+    }
+  }
+
+  mutable std::mutex myMutex;
+  std::condition_variable myWake;
+  std::deque<std::function<void()>> myJobs;
+  int myLimit;
+  /// Workers alive, and those of them waiting for a job.
+  int myThreads;
+  int myIdle;
+};
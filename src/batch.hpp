@@ -0,0 +1,69 @@
+#pragma once
+
+#include <OSD_ThreadPool.hxx>
+#include <Standard_Failure.hxx>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/// Size of a file in bytes, or zero if it can not be opened.
+static int64_t file_size(const std::string &path) {
+  std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+  if (!file) {
+    return 0;
+  }
+  return (int64_t)file.tellg();
+}
+
+/// Functor for OSD_ThreadPool::Launcher which runs jobs in a fixed order.
+template <typename Job> struct BatchFunctor {
+  BatchFunctor(const std::vector<size_t> &theOrder, const Job &theJob,
+               std::vector<int> &theStatus)
+      : order(theOrder), job(theJob), status(theStatus) {}
+
+  void operator()(int /*threadIndex*/, int index) const {
+    const size_t which = order[(size_t)index];
+    try {
+      status[which] = job(which);
+    } catch (const Standard_Failure &e) {
+      std::cerr << "Error: " << e.GetMessageString() << std::endl;
+      status[which] = 1;
+    } catch (const std::exception &e) {
+      std::cerr << "Error: " << e.what() << std::endl;
+      status[which] = 1;
+    }
+  }
+
+  const std::vector<size_t> &order;
+  const Job &job;
+  std::vector<int> &status;
+};
+
+/// Run `job(i)` for every `i < weights.size()` on the shared OCCT thread
+/// pool and return the status of every job. The launcher hands out
+/// indices from an atomic counter, so sorting the heaviest jobs first
+/// gives longest-processing-time scheduling: big files start early and
+/// small ones fill the gaps at the end. A failing job never stops the
+/// others. `num_threads` below one uses every thread of the pool.
+template <typename Job>
+static std::vector<int> run_batch(const std::vector<int64_t> &weights,
+                                  const Job &job, int num_threads) {
+  std::vector<size_t> order(weights.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&weights](size_t a, size_t b) {
+                     return weights[a] > weights[b];
+                   });
+
+  std::vector<int> status(weights.size(), 1);
+  const Handle(OSD_ThreadPool) &pool = OSD_ThreadPool::DefaultPool();
+  OSD_ThreadPool::Launcher launcher(*pool, num_threads > 0 ? num_threads
+                                                           : -1);
+  BatchFunctor<Job> functor(order, job, status);
+  launcher.Perform(0, (int)order.size(), functor);
+  return status;
+}
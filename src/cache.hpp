@@ -0,0 +1,404 @@
+#pragma once
+
+#include <BRepTools.hxx>
+#include <BRep_Builder.hxx>
+#include <BRep_Tool.hxx>
+#include <OSD_Directory.hxx>
+#include <OSD_File.hxx>
+#include <OSD_FileIterator.hxx>
+#include <OSD_Path.hxx>
+#include <OSD_Process.hxx>
+#include <OSD_Protection.hxx>
+#include <Poly_Triangulation.hxx>
+#include <Quantity_Date.hxx>
+#include <TopExp.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+#include <TopoDS.hxx>
+#include <TopoDS_Face.hxx>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// 64-bit FNV-1a, stable across platforms and runs.
+static uint64_t fnv1a(const std::string &data,
+                      uint64_t hash = 14695981039346656037ULL) {
+  for (size_t i = 0; i < data.size(); i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// Stable hex hash of the B-rep geometry of `shape` without any
+/// triangulation, combined with an opaque string of mesh settings.
+static std::string geometry_hash(const TopoDS_Shape &shape,
+                                 const std::string &settings) {
+  std::ostringstream brep;
+  BRepTools::Write(shape, brep, Standard_False, Standard_False,
+                   TopTools_FormatVersion_CURRENT);
+  // hash twice with different seeds to get 128 bits
+  const std::string data = brep.str() + '\0' + settings;
+  char hex[33];
+  std::snprintf(hex, sizeof(hex), "%016llx%016llx",
+                (unsigned long long)fnv1a(data),
+                (unsigned long long)fnv1a(data, 0x84222325cbf29ce4ULL));
+  return hex;
+}
+
+static const char tessellationMagic[8] = {'C', 'A', 'S', 'C',
+                                          'T', 'R', 'I', '1'};
+
+template <typename T> static void write_pod(std::ostream &out, const T &v) {
+  out.write((const char *)&v, sizeof(T));
+}
+
+template <typename T> static bool read_pod(std::istream &in, T &v) {
+  return (bool)in.read((char *)&v, sizeof(T));
+}
+
+/// Write the triangulation of every face of `shape` in TopExp order.
+static void write_triangulations(const TopoDS_Shape &shape,
+                                 std::ostream &out) {
+  TopTools_IndexedMapOfShape faces;
+  TopExp::MapShapes(shape, TopAbs_FACE, faces);
+  out.write(tessellationMagic, sizeof(tessellationMagic));
+  write_pod(out, (int32_t)faces.Extent());
+  for (int i = 1; i <= faces.Extent(); i++) {
+    TopLoc_Location loc;
+    Handle(Poly_Triangulation) tri =
+        BRep_Tool::Triangulation(TopoDS::Face(faces(i)), loc);
+    if (tri.IsNull()) {
+      write_pod(out, (int32_t)0);
+      continue;
+    }
+    write_pod(out, (int32_t)tri->NbNodes());
+    write_pod(out, (int32_t)tri->NbTriangles());
+    write_pod(out, (uint8_t)tri->HasUVNodes());
+    write_pod(out, (uint8_t)tri->HasNormals());
+    write_pod(out, tri->Deflection());
+    for (int n = 1; n <= tri->NbNodes(); n++) {
+      const gp_Pnt p = tri->Node(n);
+      write_pod(out, p.X());
+      write_pod(out, p.Y());
+      write_pod(out, p.Z());
+    }
+    if (tri->HasUVNodes()) {
+      for (int n = 1; n <= tri->NbNodes(); n++) {
+        const gp_Pnt2d uv = tri->UVNode(n);
+        write_pod(out, uv.X());
+        write_pod(out, uv.Y());
+      }
+    }
+    if (tri->HasNormals()) {
+      for (int n = 1; n <= tri->NbNodes(); n++) {
+        gp_Vec3f normal;
+        tri->Normal(n, normal);
+        out.write((const char *)normal.GetData(), 3 * sizeof(float));
+      }
+    }
+    for (int t = 1; t <= tri->NbTriangles(); t++) {
+      int32_t a, b, c;
+      tri->Triangle(t).Get(a, b, c);
+      write_pod(out, a);
+      write_pod(out, b);
+      write_pod(out, c);
+    }
+  }
+}
+
+/// Read triangulations written by `write_triangulations` and attach
+/// them to the faces of `shape`. Nothing is changed on failure.
+static bool read_triangulations(const TopoDS_Shape &shape, std::istream &in) {
+  char magic[sizeof(tessellationMagic)];
+  if (!in.read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + sizeof(magic), tessellationMagic)) {
+    return false;
+  }
+  TopTools_IndexedMapOfShape faces;
+  TopExp::MapShapes(shape, TopAbs_FACE, faces);
+  int32_t nbFaces = 0;
+  if (!read_pod(in, nbFaces) || nbFaces != faces.Extent()) {
+    return false;
+  }
+
+  std::vector<Handle(Poly_Triangulation)> loaded((size_t)nbFaces);
+  for (int32_t i = 0; i < nbFaces; i++) {
+    int32_t nbNodes = 0, nbTris = 0;
+    uint8_t hasUV = 0, hasNormals = 0;
+    Standard_Real deflection = 0.0;
+    if (!read_pod(in, nbNodes)) {
+      return false;
+    }
+    if (nbNodes == 0) {
+      continue;
+    }
+    if (!read_pod(in, nbTris) || !read_pod(in, hasUV) ||
+        !read_pod(in, hasNormals) || !read_pod(in, deflection) ||
+        nbNodes < 0 || nbTris < 0) {
+      return false;
+    }
+    Handle(Poly_Triangulation) tri =
+        new Poly_Triangulation(nbNodes, nbTris, hasUV != 0, hasNormals != 0);
+    tri->Deflection(deflection);
+    for (int n = 1; n <= nbNodes; n++) {
+      double xyz[3];
+      if (!in.read((char *)xyz, sizeof(xyz))) {
+        return false;
+      }
+      tri->SetNode(n, gp_Pnt(xyz[0], xyz[1], xyz[2]));
+    }
+    if (hasUV) {
+      for (int n = 1; n <= nbNodes; n++) {
+        double uv[2];
+        if (!in.read((char *)uv, sizeof(uv))) {
+          return false;
+        }
+        tri->SetUVNode(n, gp_Pnt2d(uv[0], uv[1]));
+      }
+    }
+    if (hasNormals) {
+      for (int n = 1; n <= nbNodes; n++) {
+        float normal[3];
+        if (!in.read((char *)normal, sizeof(normal))) {
+          return false;
+        }
+        tri->SetNormal(n, gp_Vec3f(normal[0], normal[1], normal[2]));
+      }
+    }
+    for (int t = 1; t <= nbTris; t++) {
+      int32_t abc[3];
+      if (!in.read((char *)abc, sizeof(abc)) || abc[0] < 1 || abc[1] < 1 ||
+          abc[2] < 1 || abc[0] > nbNodes || abc[1] > nbNodes ||
+          abc[2] > nbNodes) {
+        return false;
+      }
+      tri->SetTriangle(t, Poly_Triangle(abc[0], abc[1], abc[2]));
+    }
+    loaded[(size_t)i] = tri;
+  }
+
+  BRep_Builder builder;
+  for (int32_t i = 0; i < nbFaces; i++) {
+    if (!loaded[(size_t)i].IsNull()) {
+      builder.UpdateFace(TopoDS::Face(faces(i + 1)), loaded[(size_t)i]);
+    }
+  }
+  return true;
+}
+
+/// On-disk cache of triangulations keyed by `geometry_hash`, with a size
+/// limit enforced by evicting the least recently used entries. Entries
+/// are written to a temporary name and renamed into place so several
+/// processes may share a directory. Recency is seeded from file access
+/// times when the cache is opened and tracked in memory afterwards.
+class TessellationCache {
+public:
+  TessellationCache(const std::string &directory, int64_t maxBytes)
+      : myDirectory(directory), myMaxBytes(maxBytes), myBytes(0), myHits(0),
+        myMisses(0) {
+    if (!myDirectory.empty() && myDirectory[myDirectory.size() - 1] != '/' &&
+        myDirectory[myDirectory.size() - 1] != '\\') {
+      myDirectory += '/';
+    }
+    OSD_Directory folder((OSD_Path(myDirectory.c_str())));
+    if (!folder.Exists()) {
+      folder.Build(OSD_Protection());
+    }
+    scan();
+    evict();
+  }
+
+  /// Attach cached triangulations for `key` to `shape` if present.
+  bool Load(const std::string &key, const TopoDS_Shape &shape) {
+    std::ifstream in(path(key).c_str(), std::ios::binary);
+    if (in && read_triangulations(shape, in)) {
+      std::lock_guard<std::mutex> lock(myMutex);
+      touch(key, -1);
+      myHits++;
+      return true;
+    }
+    myMisses++;
+    return false;
+  }
+
+  /// Store the triangulations of `shape` under `key`.
+  void Store(const std::string &key, const TopoDS_Shape &shape) {
+    std::ostringstream data;
+    write_triangulations(shape, data);
+    store(key, data.str());
+  }
+
+  /// The deflection stored for `key` by `StoreTolerance`, if present.
+  bool LoadTolerance(const std::string &key, double &tolerance) {
+    std::ifstream in(path(key).c_str(), std::ios::binary);
+    if (!read_pod(in, tolerance) || in.peek() != EOF) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(myMutex);
+    touch(key, -1);
+    return true;
+  }
+
+  /// Store the deflection a triangle budget resolved to under `key`.
+  void StoreTolerance(const std::string &key, double tolerance) {
+    std::ostringstream data;
+    write_pod(data, tolerance);
+    store(key, data.str());
+  }
+
+  const std::string &Directory() const { return myDirectory; }
+  int64_t MaxBytes() const { return myMaxBytes; }
+  int64_t Hits() const { return myHits; }
+  int64_t Misses() const { return myMisses; }
+
+  int64_t Bytes() {
+    std::lock_guard<std::mutex> lock(myMutex);
+    return myBytes;
+  }
+
+  int64_t Entries() {
+    std::lock_guard<std::mutex> lock(myMutex);
+    return (int64_t)myIndex.size();
+  }
+
+private:
+  typedef std::list<std::string> Recency;
+  typedef std::map<std::string, std::pair<Recency::iterator, int64_t>> Index;
+
+  std::string path(const std::string &key) const {
+    return myDirectory + key + ".tri";
+  }
+
+  /// Write `bytes` as the entry for `key`.
+  void store(const std::string &key, const std::string &bytes) {
+    // unique per process and thread of this process
+    static std::atomic<int64_t> counter(0);
+    std::ostringstream temp;
+    temp << path(key) << "." << OSD_Process().ProcessId() << "."
+         << counter++ << ".tmp";
+    {
+      std::ofstream out(temp.str().c_str(), std::ios::binary);
+      out.write(bytes.data(), (std::streamsize)bytes.size());
+      if (!out) {
+        std::remove(temp.str().c_str());
+        return;
+      }
+    }
+    std::remove(path(key).c_str());
+    if (std::rename(temp.str().c_str(), path(key).c_str()) != 0) {
+      std::remove(temp.str().c_str());
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(myMutex);
+    touch(key, (int64_t)bytes.size());
+    evict();
+  }
+
+  /// Mark `key` most recently used, recording its size if not negative.
+  void touch(const std::string &key, int64_t size) {
+    Index::iterator found = myIndex.find(key);
+    if (found != myIndex.end()) {
+      myRecency.erase(found->second.first);
+      myRecency.push_front(key);
+      found->second.first = myRecency.begin();
+      if (size >= 0) {
+        myBytes += size - found->second.second;
+        found->second.second = size;
+      }
+      return;
+    }
+    if (size < 0) {
+      // written by another process since the cache was opened
+      size = OSD_File(OSD_Path(path(key).c_str())).Size();
+    }
+    myRecency.push_front(key);
+    myIndex[key] = std::make_pair(myRecency.begin(), size);
+    myBytes += size;
+  }
+
+  void evict() {
+    while (myBytes > myMaxBytes && !myRecency.empty()) {
+      const std::string key = myRecency.back();
+      myRecency.pop_back();
+      Index::iterator found = myIndex.find(key);
+      myBytes -= found->second.second;
+      myIndex.erase(found);
+      std::remove(path(key).c_str());
+    }
+  }
+
+  /// Index the entries already in the directory, oldest access first.
+  void scan() {
+    struct Entry {
+      std::string key;
+      int64_t size;
+      Quantity_Date accessed;
+    };
+    std::vector<Entry> entries;
+    for (OSD_FileIterator it(OSD_Path(myDirectory.c_str()), "*.tri"); it.More();
+         it.Next()) {
+      OSD_File file = it.Values();
+      OSD_Path filePath;
+      file.Path(filePath);
+      Entry entry;
+      entry.key = filePath.Name().ToCString();
+      entry.size = (int64_t)OSD_File(OSD_Path(path(entry.key).c_str())).Size();
+      entry.accessed = OSD_File(OSD_Path(path(entry.key).c_str())).AccessMoment();
+      entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) {
+                return a.accessed.IsEarlier(b.accessed);
+              });
+    for (size_t i = 0; i < entries.size(); i++) {
+      touch(entries[i].key, entries[i].size);
+    }
+  }
+
+  std::string myDirectory;
+  int64_t myMaxBytes;
+  int64_t myBytes;
+  std::atomic<int64_t> myHits;
+  std::atomic<int64_t> myMisses;
+  std::mutex myMutex;
+  Recency myRecency;
+  Index myIndex;
+};
+
+/// The process-wide tessellation cache, empty when disabled.
+static std::shared_ptr<TessellationCache> &tessellation_cache_slot() {
+  static std::shared_ptr<TessellationCache> cache;
+  return cache;
+}
+
+static std::mutex &tessellation_cache_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+/// The current tessellation cache, or null if caching is disabled.
+static std::shared_ptr<TessellationCache> tessellation_cache() {
+  std::lock_guard<std::mutex> lock(tessellation_cache_mutex());
+  return tessellation_cache_slot();
+}
+
+/// Enable the tessellation cache in `directory` or disable it if empty.
+static void set_tessellation_cache(const std::string &directory,
+                                   int64_t maxBytes) {
+  std::shared_ptr<TessellationCache> cache;
+  if (!directory.empty()) {
+    cache = std::make_shared<TessellationCache>(directory, maxBytes);
+  }
+  std::lock_guard<std::mutex> lock(tessellation_cache_mutex());
+  tessellation_cache_slot() = cache;
+}
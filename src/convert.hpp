@@ -1,88 +1,1724 @@
 #include <Message_ProgressRange.hxx>
+#include <Poly_Triangulation.hxx>
 #include <TDocStd_Document.hxx>
 #include <XCAFApp_Application.hxx>
+#include <TDF_LabelMap.hxx>
+#include <TDF_LabelSequence.hxx>
+#include <UnitsMethods_LengthUnit.hxx>
+#include <XCAFDoc_DocumentTool.hxx>
+#include <XCAFDoc_ShapeTool.hxx>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-// STEP Read methods
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+// STEP, IGES and BREP read methods
+#include <IGESCAFControl_Reader.hxx>
+#include <IGESControl_Controller.hxx>
+#include <OSD_Directory.hxx>
+#include <OSD_Parallel.hxx>
+#include <OSD_Path.hxx>
+#include <OSD_Protection.hxx>
+#include <STEPCAFControl_Controller.hxx>
 #include <STEPCAFControl_Reader.hxx>
+#include <ShapeProcess_OperLibrary.hxx>
 // Meshing
+#include <BRepBndLib.hxx>
 #include <BRepMesh_IncrementalMesh.hxx>
+#include <BRepTools.hxx>
+#include <BRep_Tool.hxx>
+#include <BinTools.hxx>
+#include <Bnd_Box.hxx>
+#include <BRep_Builder.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopTools_ListOfShape.hxx>
+#include <TopTools_MapOfShape.hxx>
+#include <TopoDS.hxx>
+#include <TopoDS_Compound.hxx>
+#include <TopoDS_Iterator.hxx>
 #include <TopoDS_Shape.hxx>
 // GLTF Write methods
 #include <RWGltf_CafWriter.hxx>
+#include <RWGltf_DracoParameters.hxx>
+// In-memory input and output
+#include "stream.hpp"
+// Batches on the shared thread pool
+#include "batch.hpp"
+// Meshing and writing options
+#include "options.hpp"
+// Persistent tessellation cache
+#include "cache.hpp"
+// Per-output part triangulations for incremental conversion
+#include "manifest.hpp"
+// Per-stage timing and memory
+#include "stats.hpp"
+// Progress reporting and cancellation
+#include "progress.hpp"
+// Mesh arrays without glTF
+#include "arrays.hpp"
+// Welding and vertex cache ordering
+#include "optimize.hpp"
+// Sharing copied parts
+#include "dedupe.hpp"
+// Freeing models in the background
+#include "release.hpp"
+// Converting only some parts
+#include "select.hpp"
+// Product structure without meshing
+#include "scan.hpp"
+// Bounded queue for asynchronous conversions
+#include "async.hpp"
+// GLB written one part at a time
+#include "glb.hpp"
+// Spatial partitioning into tiles
+#include "tiles.hpp"
+// Chrome trace spans, and per-face meshing hooks recording them
+#include "trace.hpp"
+#include "faces.hpp"
 
 static const char *errorInvalidOutExtension =
     "output filename shall have .glTF or .glb extension.";
 
-/// Transcode STEP to glTF
-static int step_to_glb(char *in, char *out, Standard_Real tol_linear,
-                       Standard_Real tol_angle, Standard_Boolean tol_relative,
-                       Standard_Boolean merge_primitives,
-                       Standard_Boolean use_parallel) {
+/// Meshing and export settings shared by every conversion entry point.
+struct ConvertParams {
+  ConvertParams(Standard_Real theTolLinear = 0.01,
+                Standard_Real theTolAngle = 0.5,
+                Standard_Boolean theTolRelative = Standard_False,
+                Standard_Boolean theMergePrimitives = Standard_True,
+                Standard_Boolean theUseParallel = Standard_True)
+      : tol_linear(theTolLinear), tol_angle(theTolAngle),
+        tol_relative(theTolRelative), merge_primitives(theMergePrimitives),
+        use_parallel(theUseParallel) {}
+
+  Standard_Real tol_linear;
+  Standard_Real tol_angle;
+  Standard_Boolean tol_relative;
+  Standard_Boolean merge_primitives;
+  Standard_Boolean use_parallel;
+  /// Path of a `PartManifest` to reuse the triangulations of parts
+  /// whose geometry is unchanged from, rewritten after meshing with
+  /// the parts of this conversion. Empty to mesh everything.
+  std::string manifest;
+  /// What to transfer and keep of the input.
+  ReadOptions read;
+  /// How to mesh it.
+  MeshOptions mesh;
+  /// How to write it.
+  WriteOptions write;
+};
+
+/// Initialize OCCT global state exactly once so conversions can run
+/// concurrently without the GIL. After this the STEP static parameters
+/// (Interface_Static) are only ever read, never written.
+static void init_occt() {
+  static std::once_flag flag;
+  std::call_once(flag, []() {
+    XCAFApp_Application::GetApplication();
+    STEPCAFControl_Controller::Init();
+    IGESControl_Controller::Init();
+    ShapeProcess_OperLibrary::Init();
+    MemoryFileSystem::Instance();
+  });
+}
+
+/// The XCAF application keeps a list of open documents which
+/// is not thread-safe, so every document open or close goes here.
+static std::mutex &application_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
 
-  // Creating XCAF document
+/// Create an empty XCAF document.
+static Handle(TDocStd_Document) new_document() {
   Handle(TDocStd_Document) doc;
   Handle(XCAFApp_Application) app = XCAFApp_Application::GetApplication();
+  std::lock_guard<std::mutex> lock(application_mutex());
   app->NewDocument("MDTV-XCAF", doc);
+  return doc;
+}
 
-  // Loading STEP file
-  STEPCAFControl_Reader stepReader;
+/// Close a document created by `new_document`.
+static void close_document(const Handle(TDocStd_Document) & doc) {
+  std::lock_guard<std::mutex> lock(application_mutex());
+  doc->Close();
+}
+
+/// Collect every face below `shapes` exactly once into a compound.
+/// Instances share a TShape and only differ by location, and the
+/// triangulation is stored on the TShape, so faces are keyed unlocated.
+static TopoDS_Compound unique_faces(const TopTools_ListOfShape &shapes) {
+  BRep_Builder builder;
+  TopoDS_Compound faces;
+  builder.MakeCompound(faces);
+  TopTools_MapOfShape seen;
+  for (TopTools_ListIteratorOfListOfShape it(shapes); it.More(); it.Next()) {
+    for (TopExp_Explorer exp(it.Value(), TopAbs_FACE); exp.More();
+         exp.Next()) {
+      if (seen.Add(exp.Current().Located(TopLoc_Location()))) {
+        builder.Add(faces, exp.Current());
+      }
+    }
+  }
+  return faces;
+}
 
-  // TODO : do this in-memory instead of using a tempfile
-  // std::istringstream ss;
-  // ss.rdbuf()->pubsetbuf(buf,len);
-  // stepReader.ReadStream()
+/// Meshing parameters for BRepMesh from conversion settings.
+static IMeshTools_Parameters mesh_parameters(const ConvertParams &params) {
+  IMeshTools_Parameters meshParams;
+  params.mesh.Apply(meshParams);
+  meshParams.Deflection = params.tol_linear;
+  meshParams.Angle = params.tol_angle;
+  meshParams.Relative = params.tol_relative;
+  meshParams.InParallel = params.use_parallel;
+  return meshParams;
+}
 
-  if (IFSelect_RetDone != stepReader.ReadFile((Standard_CString)in)) {
-    std::cerr << "Error: Failed to read STEP file \"" << in << "\" !"
-              << std::endl;
-    doc->Close();
-    return 1;
+/// Mesh all faces of `shapes` in a single pass, so `use_parallel`
+/// spreads the faces of every shape over all cores rather than only
+/// the faces of one shape at a time. Returns how many faces went
+/// over `face_timeout`.
+static int64_t mesh_shapes(const TopTools_ListOfShape &shapes,
+                        const ConvertParams &params,
+                        const Message_ProgressRange &progress =
+                            Message_ProgressRange()) {
+  TraceSpan span("mesh", "shapes");
+  span.Arg("shapes", shapes.Size());
+  BRepMesh_IncrementalMesh Mesh;
+  Mesh.SetShape(unique_faces(shapes));
+  Mesh.ChangeParameters() = mesh_parameters(params);
+  std::atomic<int64_t> timeouts(0);
+  if (span.IsActive() || params.mesh.face_timeout > 0.0) {
+    // wrapping every face costs a little, so only when needed
+    Mesh.Perform(face_mesh_context(params.mesh.face_timeout, &timeouts),
+                 progress);
+  } else {
+    Mesh.Perform(progress);
   }
-  stepReader.SetColorMode(true);
-  stepReader.SetNameMode(true);
-  stepReader.SetLayerMode(true);
+  return timeouts;
+}
 
-  // Transferring to XCAF
-  if (!stepReader.Transfer(doc)) {
-    std::cerr << "Error: Failed to read STEP file \"" << in << "\" !"
-              << std::endl;
-    doc->Close();
-    return 1;
+/// Collect the distinct part definitions below `label`, following
+/// references to the shapes they instance and descending assemblies.
+static void collect_prototypes(const TDF_Label &label, TDF_LabelMap &seen,
+                               TDF_LabelSequence &prototypes) {
+  TDF_Label prototype = label;
+  if (XCAFDoc_ShapeTool::IsReference(label)) {
+    XCAFDoc_ShapeTool::GetReferredShape(label, prototype);
+  }
+  if (!seen.Add(prototype)) {
+    return;
   }
+  if (XCAFDoc_ShapeTool::IsAssembly(prototype)) {
+    TDF_LabelSequence components;
+    XCAFDoc_ShapeTool::GetComponents(prototype, components);
+    for (TDF_LabelSequence::Iterator it(components); it.More(); it.Next()) {
+      collect_prototypes(it.Value(), seen, prototypes);
+    }
+  } else {
+    prototypes.Append(prototype);
+  }
+}
+
+/// Every part definition of an XCAF document exactly once, no
+/// matter how many times it is instanced by the assemblies.
+static TDF_LabelSequence document_prototypes(const Handle(TDocStd_Document) &
+                                             doc) {
+  Handle(XCAFDoc_ShapeTool) shapeTool =
+      XCAFDoc_DocumentTool::ShapeTool(doc->Main());
+  TDF_LabelSequence roots;
+  shapeTool->GetFreeShapes(roots);
+
+  TDF_LabelMap seen;
+  TDF_LabelSequence prototypes;
+  for (TDF_LabelSequence::Iterator it(roots); it.More(); it.Next()) {
+    collect_prototypes(it.Value(), seen, prototypes);
+  }
+  return prototypes;
+}
+
+/// Count the distinct faces of `shapes` and their triangles.
+static void count_triangles(const TopTools_ListOfShape &shapes,
+                            ConvertStats *stats) {
+  stats->faces = 0;
+  stats->triangles = 0;
+  for (TopoDS_Iterator it(unique_faces(shapes)); it.More(); it.Next()) {
+    TopLoc_Location loc;
+    Handle(Poly_Triangulation) tri =
+        BRep_Tool::Triangulation(TopoDS::Face(it.Value()), loc);
+    stats->faces++;
+    if (!tri.IsNull()) {
+      stats->triangles += tri->NbTriangles();
+    }
+  }
+}
+
+/// Automatic linear deflection as a fraction of the document
+/// diagonal, about one pixel when the whole model fills the screen.
+static const double autoDeflection = 1e-3;
+
+/// Diagonal of the bounding box of every root of a document, placed
+/// in the document's own length unit, or 0 if there is no geometry.
+static double document_diagonal(const Handle(TDocStd_Document) & doc) {
+  Handle(XCAFDoc_ShapeTool) shapeTool =
+      XCAFDoc_DocumentTool::ShapeTool(doc->Main());
+  TDF_LabelSequence roots;
+  shapeTool->GetFreeShapes(roots);
+
+  Bnd_Box box;
+  for (TDF_LabelSequence::Iterator it(roots); it.More(); it.Next()) {
+    TopoDS_Shape shape = XCAFDoc_ShapeTool::GetShape(it.Value());
+    if (!shape.IsNull()) {
+      BRepBndLib::Add(shape, box, Standard_False);
+    }
+  }
+  return box.IsVoid() ? 0.0 : std::sqrt(box.SquareExtent());
+}
+
+/// Distinct triangles of `shapes` after meshing them with `params`.
+static int64_t sample_triangles(const TopTools_ListOfShape &shapes,
+                                const ConvertParams &params) {
+  ConvertStats counts;
+  mesh_shapes(shapes, params);
+  count_triangles(shapes, &counts);
+  return counts.triangles;
+}
+
+/// Remove every triangulation and edge polygon from `shapes` so a
+/// coarser mesh can replace a finer one.
+static void clean_shapes(const TopTools_ListOfShape &shapes) {
+  for (TopTools_ListIteratorOfListOfShape it(shapes); it.More(); it.Next()) {
+    BRepTools::Clean(it.Value());
+  }
+}
 
-  XSControl_Reader reader = stepReader.Reader();
-  for (int shape_id = 1; shape_id <= reader.NbShapes(); shape_id++) {
-    TopoDS_Shape shape = reader.Shape(shape_id);
-    if (shape.IsNull()) {
+/// Resolve `tol_auto`, `target_triangles` and `max_triangles` into a
+/// plain deflection. The shapes are meshed at two coarse deflections
+/// and the counts fitted to `planar + curved / deflection`, which is
+/// how chordal deflection scales on smooth surfaces, then solved for
+/// the budget. Planar faces do not get coarser, so a cap below their
+/// count gives the coarsest sample instead.
+static ConvertParams choose_tolerance(const Handle(TDocStd_Document) & doc,
+                                      const TopTools_ListOfShape &shapes,
+                                      const ConvertParams &params) {
+  ConvertParams chosen = params;
+  const double diagonal = document_diagonal(doc);
+  if (diagonal <= 0.0) {
+    return chosen;
+  }
+  if (params.mesh.tol_auto) {
+    chosen.tol_linear = diagonal * autoDeflection;
+    chosen.tol_relative = Standard_False;
+  }
+  const int64_t target =
+      params.mesh.tol_auto ? params.mesh.target_triangles : 0;
+  if (target <= 0 && params.mesh.max_triangles <= 0) {
+    return chosen;
+  }
+
+  ConvertParams sample = chosen;
+  const double coarse = chosen.tol_relative ? 0.1 : diagonal * 0.01;
+  sample.tol_linear = coarse / 4.0;
+  const double fine = sample.tol_linear;
+  // finest first so the coarse pass can reuse its edge polygons
+  const double nFine = (double)sample_triangles(shapes, sample);
+  clean_shapes(shapes);
+  sample.tol_linear = coarse;
+  const double nCoarse = (double)sample_triangles(shapes, sample);
+  clean_shapes(shapes);
+
+  const double curved =
+      std::max(0.0, (nFine - nCoarse) / (1.0 / fine - 1.0 / coarse));
+  const double planar = std::max(0.0, nCoarse - curved / coarse);
+  // a deflection below this would take far longer than it is worth
+  const double finest = chosen.tol_relative ? 1e-4 : diagonal * 1e-6;
+  if (curved <= 0.0) {
+    return chosen;
+  }
+  if (target > 0) {
+    chosen.tol_linear = (double)target > planar
+                            ? std::max(finest, curved / (target - planar))
+                            : coarse;
+  }
+  const double predicted = planar + curved / chosen.tol_linear;
+  if (params.mesh.max_triangles > 0 &&
+      predicted > (double)params.mesh.max_triangles) {
+    chosen.tol_linear = (double)params.mesh.max_triangles > planar
+                            ? curved / (params.mesh.max_triangles - planar)
+                            : coarse;
+  }
+  return chosen;
+}
+
+/// Everything which changes the triangulation BRepMesh produces,
+/// as a string to key the tessellation cache with.
+static std::string mesh_settings(const ConvertParams &params) {
+  std::ostringstream settings;
+  settings.precision(17);
+  settings << "linear=" << params.tol_linear << ";angle=" << params.tol_angle
+           << ";relative=" << (int)params.tol_relative << ";"
+           << params.mesh.Key();
+  return settings.str();
+}
+
+/// Key of the deflection `choose_tolerance` resolves the triangle
+/// budget of `params` to for `shapes`, which only their geometry and
+/// the requested settings decide.
+static std::string tolerance_key(const TopTools_ListOfShape &shapes,
+                                 const ConvertParams &params) {
+  std::ostringstream settings;
+  settings << "tolerance;" << mesh_settings(params)
+           << ";auto=" << (int)params.mesh.tol_auto
+           << ";target=" << params.mesh.target_triangles
+           << ";max=" << params.mesh.max_triangles;
+  std::string hashes;
+  for (TopTools_ListIteratorOfListOfShape it(shapes); it.More(); it.Next()) {
+    hashes += geometry_hash(it.Value(), settings.str());
+  }
+  char hex[33];
+  std::snprintf(hex, sizeof(hex), "%016llx%016llx",
+                (unsigned long long)fnv1a(hashes),
+                (unsigned long long)fnv1a(hashes, 0x84222325cbf29ce4ULL));
+  return hex;
+}
+
+/// Whether the output of `params` has the texture coordinates of the
+/// triangulations, which only RWGltf_CafWriter writes.
+static bool writes_uvs(const ConvertParams &params) {
+  return params.write.uvs &&
+         (!params.write.IsStripped() || params.write.draco);
+}
+
+/// Mesh the prototype shapes of an XCAF document.
+/// Each part definition is triangulated once and every instance
+/// shares it, so RWGltf_CafWriter emits nodes sharing one mesh.
+/// Prototypes found in the manifest of the previous conversion or in
+/// the tessellation cache are not meshed at all, and neither is the
+/// deflection a triangle budget resolved to sampled again. A cap on an
+/// explicit deflection is only fitted when the first pass is over it.
+static void mesh_document(const Handle(TDocStd_Document) & doc,
+                          const ConvertParams &requested,
+                          ConvertStats *stats = NULL,
+                          const Message_ProgressRange &progress =
+                              Message_ProgressRange()) {
+  TopTools_ListOfShape all;
+  TDF_LabelSequence prototypes = document_prototypes(doc);
+  for (TDF_LabelSequence::Iterator it(prototypes); it.More(); it.Next()) {
+    TopoDS_Shape shape = XCAFDoc_ShapeTool::GetShape(it.Value());
+    if (!shape.IsNull()) {
+      all.Append(shape);
+    }
+  }
+
+  std::shared_ptr<TessellationCache> cache = tessellation_cache();
+  const bool useManifest = !requested.manifest.empty();
+  PartManifest previous;
+  if (useManifest) {
+    previous.Load(requested.manifest);
+  }
+
+  ConvertParams params = requested;
+  // whether the deflection already accounts for the triangle budget
+  bool fitted = !requested.mesh.tol_auto && requested.mesh.max_triangles <= 0;
+  std::string budget;
+  if (!fitted && (cache || useManifest)) {
+    // a conversion of the same geometry may have settled the budget,
+    // whose parts are then all found without sampling anything
+    budget = tolerance_key(all, requested);
+    double stored = 0.0;
+    if ((useManifest && previous.Tolerance(budget, stored)) ||
+        (cache && cache->LoadTolerance(budget, stored))) {
+      params.tol_linear = stored;
+      if (requested.mesh.tol_auto) {
+        params.tol_relative = Standard_False;
+      }
+      fitted = true;
+    }
+  }
+  if (!fitted && requested.mesh.tol_auto) {
+    params = choose_tolerance(doc, all, requested);
+    fitted = true;
+  }
+  // otherwise only a cap on the requested deflection, which is
+  // sampled for below if the first pass does not fit
+  const std::string settings =
+      cache || useManifest ? mesh_settings(params) : std::string();
+
+  TopTools_ListOfShape shapes;
+  std::vector<std::pair<std::string, TopoDS_Shape>> missed;
+  // the key of every shape in `all`, for the new manifest
+  std::vector<std::string> keys;
+  int64_t reused = 0;
+  for (TopTools_ListIteratorOfListOfShape it(all); it.More(); it.Next()) {
+    const TopoDS_Shape &shape = it.Value();
+    if (!cache && !useManifest) {
+      shapes.Append(shape);
       continue;
     }
-    // Mesh the shape.
-    BRepMesh_IncrementalMesh Mesh(shape, tol_linear, tol_relative, tol_angle,
-                                  use_parallel);
-    Mesh.Perform();
+    const std::string key = geometry_hash(shape, settings);
+    if (useManifest) {
+      keys.push_back(key);
+      if (previous.Apply(key, shape)) {
+        reused++;
+        continue;
+      }
+    }
+    if (cache) {
+      if (cache->Load(key, shape)) {
+        continue;
+      }
+      missed.push_back(std::make_pair(key, shape));
+    }
+    shapes.Append(shape);
+  }
+  int64_t timeouts = mesh_shapes(shapes, params, progress);
+  if (progress.UserBreak()) {
+    // partially meshed shapes must not end up in the cache
+    return;
+  }
+
+  for (int attempt = 0; params.mesh.max_triangles > 0 && attempt < 3;
+       attempt++) {
+    ConvertStats counts;
+    count_triangles(all, &counts);
+    if (counts.triangles <= params.mesh.max_triangles) {
+      break;
+    }
+    clean_shapes(all);
+    if (!fitted) {
+      // the requested deflection is over the cap, so fit it
+      params = choose_tolerance(doc, all, requested);
+      fitted = true;
+    } else {
+      // the fit was off: coarsen by the overshoot and mesh again,
+      // keeping these out of the cache which is keyed to the old value
+      params.tol_linear *= (double)counts.triangles / params.mesh.max_triangles;
+    }
+    timeouts = mesh_shapes(all, params);
+    missed.clear();
+    reused = 0;
+  }
+
+  if (timeouts > 0) {
+    // which shapes got coarse faces is not known, and none of them
+    // may be handed to the next conversion as if meshed in full
+    missed.clear();
+  }
+  for (size_t i = 0; i < missed.size(); i++) {
+    cache->Store(missed[i].first, missed[i].second);
+  }
+  if (cache && !budget.empty() && timeouts == 0) {
+    cache->StoreTolerance(budget, params.tol_linear);
+  }
+
+  if (useManifest && timeouts == 0) {
+    // keyed to the deflection actually used after any retries
+    const std::string used = mesh_settings(params);
+    PartManifest manifest;
+    size_t i = 0;
+    for (TopTools_ListIteratorOfListOfShape it(all); it.More();
+         it.Next(), i++) {
+      manifest.Add(used == settings ? keys[i] : geometry_hash(it.Value(), used),
+                   it.Value());
+    }
+    if (!budget.empty()) {
+      manifest.SetTolerance(budget, params.tol_linear);
+    }
+    if (!manifest.Save(params.manifest)) {
+      std::cerr << "Warning: Failed to write manifest " << params.manifest
+                << std::endl;
+    }
+  }
+
+  if (params.mesh.optimize) {
+    // after storing so the cache always holds what BRepMesh produced
+    optimize_faces(unique_faces(all), params.use_parallel,
+                   writes_uvs(params));
   }
 
-  // Always export as binary GLB
-  // Otherwise this is a multi-file affair.
-  RWGltf_CafWriter cafWriter(out, Standard_True);
+  if (stats != NULL) {
+    stats->shapes = all.Extent();
+    stats->reused = reused;
+    stats->timeouts = timeouts;
+    stats->tol_linear = params.tol_linear;
+    count_triangles(all, stats);
+  }
+}
+
+/// Write a meshed XCAF document as glTF, binary unless
+/// `params.write` says otherwise.
+/// `out` is a path or any URL served by a registered OSD_FileSystem.
+static bool write_glb(const Handle(TDocStd_Document) & doc,
+                      const TCollection_AsciiString &out,
+                      const ConvertParams &params,
+                      const Message_ProgressRange &progress =
+                          Message_ProgressRange()) {
+  // text glTF is a multi-file affair, so only for output to files
+  RWGltf_CafWriter cafWriter(out, params.write.binary);
 
   // Set flag to merge faces within a single part.
   // May reduce JSON size thanks to smaller number of primitive arrays.
-  cafWriter.SetMergeFaces(merge_primitives);
+  cafWriter.SetMergeFaces(params.merge_primitives);
 
   // Set multithreaded execution.
-  cafWriter.SetParallel(use_parallel);
+  cafWriter.SetParallel(params.use_parallel);
+
+  // matrices unless asked for a decomposed rotation-translation-scale
+  cafWriter.SetTransformationFormat(params.write.transform_format);
+  cafWriter.SetNodeNameFormat(params.write.names ? params.write.node_name_format
+                                                 : RWMesh_NameFormat_Empty);
+  cafWriter.SetMeshNameFormat(params.write.names ? params.write.mesh_name_format
+                                                 : RWMesh_NameFormat_Empty);
+  cafWriter.SetSplitIndices16(params.write.split_indices16);
+  cafWriter.SetToEmbedTexturesInGlb(params.write.embed_textures);
 
-  // Always export as matrices rather than a decomposed
-  // rotation-translation-scale
-  cafWriter.SetTransformationFormat(RWGltf_WriterTrsfFormat_Mat4);
+  // Draco encodes every mesh on the writer's thread pool,
+  // and fails the write if OCCT was built without it.
+  if (params.write.draco) {
+    RWGltf_DracoParameters draco;
+    draco.DracoCompression = Standard_True;
+    draco.CompressionLevel = params.write.draco_level;
+    draco.QuantizePositionBits = params.write.quantize_position_bits;
+    draco.QuantizeNormalBits = params.write.quantize_normal_bits;
+    draco.QuantizeTexcoordBits = params.write.quantize_texcoord_bits;
+    cafWriter.SetCompressionParameters(draco);
+  }
 
-  Message_ProgressRange progress;
   TColStd_IndexedDataMapOfStringString theFileInfo;
-  if (!cafWriter.Perform(doc, theFileInfo, progress)) {
-    std::cerr << "Error: Failed to write glTF to file !" << std::endl;
-    return 1;
+  return cafWriter.Perform(doc, theFileInfo, progress);
+}
+
+/// File formats a conversion can read.
+enum InputFormat {
+  InputFormat_STEP,
+  InputFormat_IGES,
+  /// OCCT native BRep, text or binary.
+  InputFormat_BREP
+};
+
+/// Parse a format name or file extension, case insensitive.
+static bool parse_format(std::string name, InputFormat &format) {
+  for (size_t i = 0; i < name.size(); i++) {
+    name[i] = (char)std::tolower((unsigned char)name[i]);
+  }
+  if (name == "step" || name == "stp") {
+    format = InputFormat_STEP;
+  } else if (name == "iges" || name == "igs") {
+    format = InputFormat_IGES;
+  } else if (name == "brep" || name == "brp") {
+    format = InputFormat_BREP;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/// Format of a file from its extension, STEP if not recognized.
+static InputFormat path_format(const char *path) {
+  InputFormat format = InputFormat_STEP;
+  const char *dot = std::strrchr(path, '.');
+  if (dot != NULL) {
+    parse_format(dot + 1, format);
+  }
+  return format;
+}
+
+static const char *format_name(InputFormat format) {
+  switch (format) {
+  case InputFormat_IGES:
+    return "IGES";
+  case InputFormat_BREP:
+    return "BREP";
+  default:
+    return "STEP";
+  }
+}
+
+/// Where the input of a conversion comes from: a path on disk,
+/// optionally memory-mapped, or a buffer in memory which is read
+/// without being copied.
+struct InputSource {
+  InputSource(const char *thePath, bool theMapped = false)
+      : path(thePath), data(NULL), size(0), mapped(theMapped),
+        format(path_format(thePath)) {}
+  InputSource(const char *thePath, InputFormat theFormat,
+              bool theMapped = false)
+      : path(thePath), data(NULL), size(0), mapped(theMapped),
+        format(theFormat) {}
+  InputSource(const char *theData, size_t theSize,
+              InputFormat theFormat = InputFormat_STEP)
+      : path(NULL), data(theData), size(theSize), mapped(false),
+        format(theFormat) {}
+
+  /// Name for messages and the model.
+  const char *Name() const {
+    if (path != NULL) {
+      return path;
+    }
+    return format == InputFormat_IGES   ? "memory.igs"
+           : format == InputFormat_BREP ? "memory.brep"
+                                        : "memory.step";
+  }
+
+  const char *path;
+  const char *data;
+  size_t size;
+  bool mapped;
+  InputFormat format;
+};
+
+/// Run `read` on a stream over the source, from memory, the mapped
+/// file or a file buffer, reporting progress through `range` as the
+/// bytes are consumed when it is attached to an indicator.
+template <typename Read>
+static int read_input_stream(const InputSource &source,
+                             const Message_ProgressRange &range,
+                             Read &read) {
+  std::unique_ptr<MappedFile> mapping;
+  std::unique_ptr<std::streambuf> buffer;
+  int64_t size = 0;
+  if (source.path == NULL) {
+    buffer.reset(new MemoryStreamBuf(source.data, source.size));
+    size = (int64_t)source.size;
+  } else if (source.mapped) {
+    // parse straight from the page cache, dropping pages once read
+    mapping.reset(new MappedFile(source.path));
+    if (!mapping->IsOpen()) {
+      return 1;
+    }
+    buffer.reset(new MappedStreamBuf(*mapping));
+    size = (int64_t)mapping->Size();
+  } else {
+    std::filebuf *file = new std::filebuf();
+    buffer.reset(file);
+    if (file->open(source.path, std::ios::in | std::ios::binary) == NULL) {
+      return 1;
+    }
+    size = file_size(source.path);
+  }
+
+  bool done;
+  if (range.IsActive()) {
+    ProgressStreamBuf progress(buffer.get(), size, range, "Reading");
+    std::istream stream(&progress);
+    done = read(stream);
+  } else {
+    std::istream stream(buffer.get());
+    done = read(stream);
+  }
+  if (range.UserBreak()) {
+    return statusCancelled;
+  }
+  return done ? 0 : 1;
+}
+
+/// Parses STEP from a stream.
+struct StepStreamRead {
+  StepStreamRead(STEPCAFControl_Reader &theReader, const char *theName)
+      : reader(theReader), name(theName) {}
+
+  bool operator()(std::istream &stream) {
+    return reader.ReadStream(name, stream) == IFSelect_RetDone;
+  }
+
+  STEPCAFControl_Reader &reader;
+  const char *name;
+};
+
+/// Parses a text or binary BRep from a stream.
+struct BrepStreamRead {
+  BrepStreamRead(TopoDS_Shape &theShape) : shape(theShape) {}
+
+  bool operator()(std::istream &stream) {
+    // binary files start with "Open CASCADE Topology",
+    // text ones with "CASCADE Topology" or a Draw header, both
+    // after a blank line which either reader skips
+    try {
+      while (std::isspace(stream.peek())) {
+        stream.get();
+      }
+      if (stream.peek() == 'O') {
+        BinTools::Read(shape, stream);
+      } else {
+        BRepTools::Read(shape, stream, BRep_Builder());
+      }
+    } catch (const Standard_Failure &) {
+      // truncated or not a BRep at all
+      shape.Nullify();
+    }
+    return !shape.IsNull();
+  }
+
+  TopoDS_Shape &shape;
+};
+
+/// Apply the reader modes every XCAF transfer uses and transfer.
+template <typename Reader>
+static bool transfer_xcaf(Reader &reader, const Handle(TDocStd_Document) & doc,
+                          const ConvertParams &params,
+                          const Message_ProgressRange &range) {
+  reader.SetColorMode(params.read.colors);
+  // selecting products goes by name
+  reader.SetNameMode(params.read.names || !params.read.filter.products.empty());
+  reader.SetLayerMode(params.read.layers);
+  return reader.Transfer(doc, range);
+}
+
+/// Parse a STEP file from disk or memory into `stepReader`, without
+/// transferring anything from the model.
+static int parse_step(const InputSource &source,
+                      STEPCAFControl_Reader &stepReader, ConvertStats *stats,
+                      const Message_ProgressRange &range) {
+  StageTimer timer(stats ? &stats->read : NULL);
+  TraceSpan span("read", "step");
+  int status;
+  if (source.path != NULL && !source.mapped && !range.IsActive()) {
+    status = IFSelect_RetDone == stepReader.ReadFile(source.path) ? 0 : 1;
+  } else {
+    StepStreamRead read(stepReader, source.Name());
+    status = read_input_stream(source, range, read);
+  }
+  if (status == 0 && stats != NULL) {
+    stats->entities = stepReader.Reader().WS()->Model()->NbEntities();
+  }
+  return status;
+}
+
+/// Read a STEP file from disk or memory into a new document.
+static int read_step(const InputSource &source, const ConvertParams &params,
+                     Handle(TDocStd_Document) & doc, ConvertStats *stats,
+                     const Message_ProgressRange &range) {
+  Message_ProgressScope scope(range, "Reading", 60);
+  // on the heap so `release_async` can hand over the last reference
+  std::unique_ptr<STEPCAFControl_Reader> reader(new STEPCAFControl_Reader());
+  STEPCAFControl_Reader &stepReader = *reader;
+  const int status = parse_step(source, stepReader, stats, scope.Next(20));
+  if (status != 0) {
+    return status;
+  }
+
+  StageTimer timer(stats ? &stats->transfer : NULL);
+  TraceSpan span("transfer", "step");
+  span.Arg("entities", stepReader.Reader().WS()->Model()->NbEntities());
+  doc = new_document();
+  // validation properties, PMI, saved views and density materials
+  // never reach the output and cost a full pass over the model each
+  stepReader.SetPropsMode(params.read.metadata);
+  stepReader.SetGDTMode(params.read.metadata);
+  stepReader.SetViewMode(params.read.metadata);
+  stepReader.SetMatMode(params.read.metadata);
+  if (!transfer_xcaf(stepReader, doc, params, scope.Next(40)) ||
+      !scope.More()) {
+    close_document(doc);
+    return scope.More() ? 1 : statusCancelled;
+  }
+  if (params.read.release_async) {
+    // the parsed model is larger than the document built from it
+    ReleaseQueue::Instance().Add(reader);
+  }
+  return 0;
+}
+
+/// Read an IGES file into a new document. The IGES parser only opens
+/// files by name, so in-memory data goes through a temporary file.
+static int read_iges(const InputSource &source, const ConvertParams &params,
+                     Handle(TDocStd_Document) & doc, ConvertStats *stats,
+                     const Message_ProgressRange &range) {
+  Message_ProgressScope scope(range, "Reading", 60);
+  std::unique_ptr<IGESCAFControl_Reader> reader(new IGESCAFControl_Reader());
+  IGESCAFControl_Reader &igesReader = *reader;
+  int status = 1;
+  {
+    StageTimer timer(stats ? &stats->read : NULL);
+    TraceSpan span("read", "iges");
+    if (source.path != NULL) {
+      status = IFSelect_RetDone == igesReader.ReadFile(source.path) ? 0 : 1;
+    } else {
+      OSD_Directory folder = OSD_Directory::BuildTemporary();
+      OSD_Path folderPath;
+      folder.Path(folderPath);
+      TCollection_AsciiString name;
+      folderPath.SystemName(name);
+      name += "/memory.igs";
+      bool written;
+      {
+        std::ofstream file(name.ToCString(), std::ios::binary);
+        file.write(source.data, (std::streamsize)source.size);
+        file.close();
+        written = !file.fail();
+      }
+      if (!written) {
+        // a full disk would otherwise read as a truncated IGES file
+        std::cerr << "Error: Failed to write temporary file \""
+                  << name.ToCString() << "\" !" << std::endl;
+        status = 1;
+      } else {
+        status =
+            IFSelect_RetDone == igesReader.ReadFile(name.ToCString()) ? 0 : 1;
+      }
+      std::remove(name.ToCString());
+      folder.Remove();
+    }
+    scope.Next(20);
+  }
+  if (status != 0) {
+    return status;
+  }
+  if (stats != NULL) {
+    stats->entities = igesReader.WS()->Model()->NbEntities();
+  }
+
+  StageTimer timer(stats ? &stats->transfer : NULL);
+  TraceSpan span("transfer", "iges");
+  span.Arg("entities", igesReader.WS()->Model()->NbEntities());
+  doc = new_document();
+  if (!transfer_xcaf(igesReader, doc, params, scope.Next(40)) ||
+      !scope.More()) {
+    close_document(doc);
+    return scope.More() ? 1 : statusCancelled;
+  }
+  if (params.read.release_async) {
+    ReleaseQueue::Instance().Add(reader);
+  }
+  return 0;
+}
+
+/// Read a text or binary BRep into a new document, expanding
+/// compounds into assemblies like the XCAF readers do.
+static int read_brep(const InputSource &source, const ConvertParams &params,
+                     Handle(TDocStd_Document) & doc, ConvertStats *stats,
+                     const Message_ProgressRange &range) {
+  Message_ProgressScope scope(range, "Reading", 60);
+  TopoDS_Shape shape;
+  int status;
+  {
+    StageTimer timer(stats ? &stats->read : NULL);
+    TraceSpan span("read", "brep");
+    BrepStreamRead read(shape);
+    status = read_input_stream(source, scope.Next(60), read);
+  }
+  if (status != 0) {
+    return status;
+  }
+
+  StageTimer timer(stats ? &stats->transfer : NULL);
+  TraceSpan span("transfer", "brep");
+  doc = new_document();
+  XCAFDoc_DocumentTool::ShapeTool(doc->Main())->AddShape(shape);
+  return 0;
+}
+
+/// Read any supported input into a new XCAF document. Returns 0 on
+/// success, 1 on failure or `statusCancelled`, with no document left
+/// open unless successful.
+static int read_document(const InputSource &source,
+                         const ConvertParams &params,
+                         Handle(TDocStd_Document) & doc, ConvertStats *stats,
+                         const Message_ProgressRange &range) {
+  int status;
+  switch (source.format) {
+  case InputFormat_IGES:
+    status = read_iges(source, params, doc, stats, range);
+    break;
+  case InputFormat_BREP:
+    status = read_brep(source, params, doc, stats, range);
+    break;
+  default:
+    status = read_step(source, params, doc, stats, range);
+  }
+  if (status == 1) {
+    std::cerr << "Error: Failed to read " << format_name(source.format)
+              << " file \"" << source.Name() << "\" !" << std::endl;
+  }
+  return status;
+}
+
+/// Select, share copies and mesh a document which has just been
+/// read. Returns 0, or 1 or `statusCancelled` after closing it.
+static int prepare_document(const Handle(TDocStd_Document) & doc,
+                            const ConvertParams &params, ConvertStats *stats,
+                            const Message_ProgressRange &progress) {
+  if (!params.read.filter.IsEmpty()) {
+    StageTimer timer(stats ? &stats->transfer : NULL);
+    TraceSpan span("transfer", "select");
+    if (select_parts(doc, params.read.filter) == 0) {
+      std::cerr << "Error: No parts match the selection !" << std::endl;
+      close_document(doc);
+      return 1;
+    }
+  }
+  if (params.mesh.dedupe) {
+    StageTimer timer(stats ? &stats->transfer : NULL);
+    TraceSpan span("transfer", "dedupe");
+    const int copies =
+        dedupe_parts(doc, document_prototypes(doc), params.use_parallel);
+    span.Arg("duplicates", copies);
+    if (stats != NULL) {
+      stats->duplicates = copies;
+    }
   }
 
+  if (params.write.low_memory) {
+    // the output meshes each part just before writing it
+    return 0;
+  }
+  {
+    StageTimer timer(stats ? &stats->mesh : NULL);
+    TraceSpan span("mesh", "document");
+    mesh_document(doc, params, stats, progress);
+  }
+  if (progress.UserBreak()) {
+    close_document(doc);
+    return statusCancelled;
+  }
   return 0;
 }
+
+/// Whether `low_memory` applies: Draco needs RWGltf_CafWriter.
+static bool meshes_by_part(const ConvertParams &params) {
+  return params.write.low_memory && !params.write.draco;
+}
+
+/// Read, transfer and mesh an input, then hand the document and
+/// the remaining progress to `output`, which returns a status.
+/// Outputs which cannot mesh parts themselves get a document meshed
+/// up front even with `low_memory`.
+template <typename Output>
+static int convert_input(const InputSource &source,
+                         const ConvertParams &requested, ConvertStats *stats,
+                         const Handle(Message_ProgressIndicator) & progress,
+                         Output &output) {
+  ConvertParams params = requested;
+  params.write.low_memory = Output::meshesParts && meshes_by_part(requested);
+  init_occt();
+  TraceSpan span("convert", source.Name());
+  span.Arg("format", std::string(format_name(source.format)));
+  Message_ProgressScope scope(start_progress(progress), "Converting", 100);
+
+  Handle(TDocStd_Document) doc;
+  int status = read_document(source, params, doc, stats, scope.Next(60));
+  if (status != 0) {
+    return status;
+  }
+
+  status = prepare_document(doc, params, stats, scope.Next(20));
+  if (status != 0) {
+    return status;
+  }
+
+  status = output(doc, scope.Next(20));
+  {
+    // the application holds every open document, so one left open
+    // keeps its whole model alive until the process exits
+    StageTimer timer(stats ? &stats->release : NULL);
+    TraceSpan release("release", "document");
+    close_document(doc);
+    if (params.read.release_async) {
+      // takes the last reference, leaving `doc` null
+      ReleaseQueue::Instance().Add(doc);
+    }
+    doc.Nullify();
+  }
+  if (status != 0 && !scope.More()) {
+    status = statusCancelled;
+  }
+  return status;
+}
+
+/// Mesh and write a document one part definition at a time with
+/// `GlbStreamWriter`, freeing each triangulation once it has been
+/// written, for `low_memory`. Every instance of a part is written
+/// right after it is meshed.
+static bool write_glb_by_part(const Handle(TDocStd_Document) & doc,
+                              const char *path,
+                              const ConvertParams &requested,
+                              ConvertStats *stats,
+                              const Message_ProgressRange &progress) {
+  std::vector<TDF_Label> parts;
+  std::vector<std::vector<XCAFPrs_DocumentNode>> instances;
+  group_instances(document_leaves(doc), parts, instances);
+  TopTools_ListOfShape all;
+  for (size_t i = 0; i < parts.size(); i++) {
+    all.Append(XCAFDoc_ShapeTool::GetShape(parts[i]));
+  }
+
+  ConvertParams params = requested;
+  if (requested.mesh.tol_auto || requested.mesh.max_triangles > 0) {
+    // only estimated: the parts are never all meshed at once to check
+    params = choose_tolerance(doc, all, requested);
+  }
+
+  GlbStreamWriter writer(path);
+  writer.SetNormals(params.write.normals);
+  writer.SetNames(params.write.names);
+  if (!writer.IsOpen()) {
+    return false;
+  }
+  ConvertStats counts;
+  int64_t faces = 0, triangles = 0, timeouts = 0;
+  Message_ProgressScope scope(progress, "Writing parts",
+                              (Standard_Real)std::max<size_t>(1, parts.size()));
+  for (size_t i = 0; i < parts.size() && scope.More(); i++) {
+    TopTools_ListOfShape part;
+    part.Append(XCAFDoc_ShapeTool::GetShape(parts[i]));
+    {
+      StageTimer timer(stats ? &stats->mesh : NULL);
+      timeouts += mesh_shapes(part, params);
+      if (params.mesh.optimize) {
+        // the streaming writer never writes texture coordinates
+        optimize_faces(unique_faces(part), params.use_parallel, false);
+      }
+      count_triangles(part, &counts);
+      faces += counts.faces;
+      triangles += counts.triangles;
+    }
+
+    {
+      StageTimer timer(stats ? &stats->write : NULL);
+      TraceSpan span("write", "part");
+      span.Arg("instances", instances[i].size());
+      write_part_instances(writer, parts[i], instances[i]);
+    }
+    // the buffers are on disk now
+    BRepTools::Clean(part.First());
+    scope.Next();
+  }
+  if (!scope.More()) {
+    return false;
+  }
+
+  if (stats != NULL) {
+    stats->shapes = (int64_t)parts.size();
+    stats->tol_linear = params.tol_linear;
+    stats->faces = faces;
+    stats->triangles = triangles;
+    stats->timeouts = timeouts;
+  }
+  StageTimer timer(stats ? &stats->write : NULL);
+  TraceSpan span("write", "finish");
+  return writer.Finish(document_meters(doc));
+}
+
+/// Drop the texture coordinates of every face of a meshed document.
+static void remove_uvs(const Handle(TDocStd_Document) & doc) {
+  TDF_LabelSequence prototypes = document_prototypes(doc);
+  for (TDF_LabelSequence::Iterator it(prototypes); it.More(); it.Next()) {
+    for (TopExp_Explorer exp(XCAFDoc_ShapeTool::GetShape(it.Value()),
+                             TopAbs_FACE);
+         exp.More(); exp.Next()) {
+      TopLoc_Location loc;
+      const Handle(Poly_Triangulation) &tri =
+          BRep_Tool::Triangulation(TopoDS::Face(exp.Current()), loc);
+      if (!tri.IsNull()) {
+        tri->RemoveUVNodes();
+      }
+    }
+  }
+}
+
+/// Write a meshed document with `GlbStreamWriter`, for the outputs
+/// RWGltf_CafWriter cannot strip. Writes the file at `path`, or
+/// into `out` with an empty path.
+static bool write_glb_stripped(const Handle(TDocStd_Document) & doc,
+                               const std::string &path,
+                               const ConvertParams &params,
+                               std::string *out = NULL) {
+  std::vector<TDF_Label> parts;
+  std::vector<std::vector<XCAFPrs_DocumentNode>> instances;
+  group_instances(document_leaves(doc), parts, instances);
+  GlbStreamWriter writer(path);
+  writer.SetNormals(params.write.normals);
+  writer.SetNames(params.write.names);
+  if (!writer.IsOpen()) {
+    return false;
+  }
+  for (size_t i = 0; i < parts.size(); i++) {
+    write_part_instances(writer, parts[i], instances[i]);
+  }
+  return path.empty() ? writer.Finish(document_meters(doc), *out)
+                      : writer.Finish(document_meters(doc));
+}
+
+/// Write a meshed document as glTF with whichever writer can leave
+/// out what `params.write` asks to, into `out` if `path` is empty.
+static bool write_output(const Handle(TDocStd_Document) & doc,
+                         const std::string &path, const ConvertParams &params,
+                         const Message_ProgressRange &progress,
+                         std::string *out = NULL) {
+  TraceSpan span("write", path.empty() ? "memory" : path);
+  if (!params.write.uvs) {
+    remove_uvs(doc);
+  }
+  if (params.write.IsStripped() && !params.write.draco) {
+    return write_glb_stripped(doc, path, params, out);
+  }
+  if (!path.empty()) {
+    return write_glb(doc, path.c_str(), params, progress);
+  }
+  // RWGltf_CafWriter only takes a file name, so point it at a
+  // folder of the in-memory file system and collect the result
+  const Handle(MemoryFileSystem) &memory = MemoryFileSystem::Instance();
+  const TCollection_AsciiString folder = memory->NewFolder();
+  const TCollection_AsciiString url = folder + "model.glb";
+  // a single file is all there is to take back
+  ConvertParams binary = params;
+  binary.write.binary = Standard_True;
+  const bool written = write_glb(doc, url, binary, progress) &&
+                       memory->Take(url, *out);
+  memory->Release(folder);
+  return written;
+}
+
+/// Conversion output writing a GLB to a file.
+struct GlbFileOutput {
+  static const bool meshesParts = true;
+
+  GlbFileOutput(const char *thePath, const ConvertParams &theParams,
+                ConvertStats *theStats)
+      : path(thePath), params(theParams), stats(theStats) {}
+
+  int operator()(const Handle(TDocStd_Document) & doc,
+                 const Message_ProgressRange &progress) {
+    if (meshes_by_part(params)) {
+      if (!write_glb_by_part(doc, path, params, stats, progress)) {
+        std::cerr << "Error: Failed to write glTF to file !" << std::endl;
+        return 1;
+      }
+      if (stats != NULL) {
+        stats->output_bytes = file_size(path);
+      }
+      return 0;
+    }
+    StageTimer timer(stats ? &stats->write : NULL);
+    if (!write_output(doc, path, params, progress)) {
+      std::cerr << "Error: Failed to write glTF to file !" << std::endl;
+      return 1;
+    }
+    if (stats != NULL) {
+      stats->output_bytes = file_size(path);
+    }
+    return 0;
+  }
+
+  const char *path;
+  const ConvertParams &params;
+  ConvertStats *stats;
+};
+
+/// Conversion output partitioning the placed parts of a meshed
+/// document into tiles of at most `tile_triangles` triangles with a
+/// bounding volume hierarchy, and writing every tile as its own GLB
+/// in parallel with a 3D Tiles `tileset.json` indexing them.
+struct TilesOutput {
+  static const bool meshesParts = false;
+
+  TilesOutput(const char *theDirectory, int64_t theTileTriangles,
+              const ConvertParams &theParams, ConvertStats *theStats)
+      : directory(theDirectory), tile_triangles(theTileTriangles),
+        params(theParams), stats(theStats) {}
+
+  int operator()(const Handle(TDocStd_Document) & doc,
+                 const Message_ProgressRange &progress) {
+    StageTimer timer(stats ? &stats->write : NULL);
+    const std::vector<XCAFPrs_DocumentNode> nodes = document_leaves(doc);
+
+    // instances are bounded by their triangles, so parts without
+    // any are left out
+    std::map<std::string, int64_t> partTriangles;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      TCollection_AsciiString entry;
+      TDF_Tool::Entry(nodes[i].RefLabel, entry);
+      if (partTriangles.count(entry.ToCString()) == 0) {
+        TopTools_ListOfShape part;
+        part.Append(XCAFDoc_ShapeTool::GetShape(nodes[i].RefLabel));
+        ConvertStats counts;
+        count_triangles(part, &counts);
+        partTriangles[entry.ToCString()] = counts.triangles;
+      }
+    }
+    std::vector<TileItem> all(nodes.size());
+    OSD_Parallel::For(
+        0, (int)nodes.size(),
+        [&all, &nodes](int i) {
+          const XCAFPrs_DocumentNode &node = nodes[(size_t)i];
+          BRepBndLib::Add(
+              XCAFDoc_ShapeTool::GetShape(node.RefLabel).Moved(node.Location),
+              all[(size_t)i].box, Standard_True);
+          all[(size_t)i].index = (size_t)i;
+        },
+        !params.use_parallel);
+    std::vector<TileItem> items;
+    for (size_t i = 0; i < nodes.size(); i++) {
+      TCollection_AsciiString entry;
+      TDF_Tool::Entry(nodes[i].RefLabel, entry);
+      all[i].triangles = partTriangles[entry.ToCString()];
+      if (!all[i].box.IsVoid() && all[i].triangles > 0) {
+        items.push_back(all[i]);
+      }
+    }
+    if (items.empty()) {
+      std::cerr << "Error: No triangles to write as tiles !" << std::endl;
+      return 1;
+    }
+
+    std::vector<TileNode> tree;
+    int tiles = 0;
+    build_tiles(items, 0, items.size(), std::max<int64_t>(1, tile_triangles),
+                tree, tiles);
+    std::vector<int> leaves((size_t)tiles);
+    std::vector<std::string> uris((size_t)tiles);
+    for (size_t i = 0; i < tree.size(); i++) {
+      if (tree[i].tile >= 0) {
+        leaves[(size_t)tree[i].tile] = (int)i;
+        char name[32];
+        std::snprintf(name, sizeof(name), "tile_%05d.glb", tree[i].tile);
+        uris[(size_t)tree[i].tile] = name;
+      }
+    }
+
+    std::string folder = directory;
+    if (!folder.empty() && folder[folder.size() - 1] != '/' &&
+        folder[folder.size() - 1] != '\\') {
+      folder += '/';
+    }
+    OSD_Directory output((OSD_Path(folder.c_str())));
+    if (!output.Exists()) {
+      output.Build(OSD_Protection());
+    }
+    const double unit = document_meters(doc);
+
+    Message_ProgressScope scope(progress, "Writing tiles", (Standard_Real)tiles);
+    std::vector<Message_ProgressRange> ranges;
+    for (int i = 0; i < tiles; i++) {
+      ranges.push_back(scope.Next());
+    }
+    std::atomic<int> failed(0);
+    OSD_Parallel::For(
+        0, tiles,
+        [&](int i) {
+          Message_ProgressScope tileScope(ranges[(size_t)i], NULL, 1);
+          if (!tileScope.More()) {
+            return;
+          }
+          TraceSpan span("write", uris[(size_t)i]);
+          const TileNode &leaf = tree[(size_t)leaves[(size_t)i]];
+          span.Arg("instances", leaf.end - leaf.begin);
+          std::vector<XCAFPrs_DocumentNode> placed;
+          for (size_t j = leaf.begin; j < leaf.end; j++) {
+            placed.push_back(nodes[items[j].index]);
+          }
+          std::vector<TDF_Label> parts;
+          std::vector<std::vector<XCAFPrs_DocumentNode>> instances;
+          group_instances(placed, parts, instances);
+          GlbStreamWriter writer(folder + uris[(size_t)i]);
+          writer.SetNormals(params.write.normals);
+          writer.SetNames(params.write.names);
+          for (size_t j = 0; j < parts.size(); j++) {
+            write_part_instances(writer, parts[j], instances[j]);
+          }
+          if (!writer.IsOpen() || !writer.Finish(unit)) {
+            failed++;
+          }
+          tileScope.Next();
+        },
+        !params.use_parallel);
+    if (failed > 0 || !scope.More()) {
+      std::cerr << "Error: Failed to write tiles !" << std::endl;
+      return 1;
+    }
+
+    const std::string tileset = folder + "tileset.json";
+    std::ofstream out(tileset.c_str(), std::ios::binary | std::ios::trunc);
+    out.precision(17);
+    out << "{\"asset\":{\"version\":\"1.1\",\"generator\":\"cascadio\"},"
+        << "\"geometricError\":";
+    std::ostringstream ignored;
+    out << write_tile_box(ignored, tree[0].box, unit) << ",\"root\":";
+    write_tile_json(out, tree, 0, uris, unit);
+    out << "}";
+    out.close();
+    if (out.fail()) {
+      std::cerr << "Error: Failed to write " << tileset << " !" << std::endl;
+      return 1;
+    }
+
+    if (stats != NULL) {
+      stats->output_bytes = file_size(tileset);
+      for (size_t i = 0; i < uris.size(); i++) {
+        stats->output_bytes += file_size(folder + uris[i]);
+      }
+    }
+    return 0;
+  }
+
+  const char *directory;
+  int64_t tile_triangles;
+  const ConvertParams &params;
+  ConvertStats *stats;
+};
+
+/// Conversion output writing a GLB into a string.
+struct GlbMemoryOutput {
+  static const bool meshesParts = false;
+
+  GlbMemoryOutput(std::string &theOut, const ConvertParams &theParams,
+                  ConvertStats *theStats)
+      : out(theOut), params(theParams), stats(theStats) {}
+
+  int operator()(const Handle(TDocStd_Document) & doc,
+                 const Message_ProgressRange &progress) {
+    StageTimer timer(stats ? &stats->write : NULL);
+    if (!write_output(doc, std::string(), params, progress, &out)) {
+      std::cerr << "Error: Failed to write glTF to memory !" << std::endl;
+      return 1;
+    }
+    if (stats != NULL) {
+      stats->output_bytes = (int64_t)out.size();
+    }
+    return 0;
+  }
+
+  std::string &out;
+  const ConvertParams &params;
+  ConvertStats *stats;
+};
+
+/// Conversion output collecting mesh arrays instead of writing glTF.
+struct ArraysOutput {
+  static const bool meshesParts = false;
+
+  ArraysOutput(SceneArrays &theScene, ConvertStats *theStats)
+      : scene(theScene), stats(theStats) {}
+
+  int operator()(const Handle(TDocStd_Document) & doc,
+                 const Message_ProgressRange &) {
+    StageTimer timer(stats ? &stats->write : NULL);
+    document_arrays(doc, scene);
+    return 0;
+  }
+
+  SceneArrays &scene;
+  ConvertStats *stats;
+};
+
+/// Conversion output writing one GLB per level of detail. The
+/// document arrives meshed at the coarsest tolerance and is refined
+/// in place after each write, so BRepMesh reuses the edge polygons
+/// which already satisfy the finer tolerance.
+struct LodOutput {
+  static const bool meshesParts = false;
+
+  /// `levels` pairs tolerances with outputs, sorted coarse to fine.
+  LodOutput(const std::vector<std::pair<double, std::string>> &theLevels,
+            const ConvertParams &theParams, ConvertStats *theStats)
+      : levels(theLevels), params(theParams), stats(theStats) {}
+
+  int operator()(const Handle(TDocStd_Document) & doc,
+                 const Message_ProgressRange &progress) {
+    Message_ProgressScope scope(progress, "Levels of detail",
+                                (Standard_Real)(levels.size() * 2));
+    int64_t written = 0;
+    for (size_t i = 0; i < levels.size(); i++) {
+      ConvertParams level = params;
+      level.tol_linear = levels[i].first;
+      if (i > 0) {
+        StageTimer timer(stats ? &stats->mesh : NULL);
+        mesh_document(doc, level, stats, scope.Next());
+      } else {
+        scope.Next();
+      }
+      GlbFileOutput output(levels[i].second.c_str(), level, stats);
+      if (!scope.More() || output(doc, scope.Next()) != 0) {
+        return 1;
+      }
+      written += stats ? stats->output_bytes : 0;
+    }
+    if (stats != NULL) {
+      stats->output_bytes = written;
+    }
+    return 0;
+  }
+
+  const std::vector<std::pair<double, std::string>> &levels;
+  const ConvertParams &params;
+  ConvertStats *stats;
+};
+
+/// Transcode STEP to glTF
+static int step_to_glb(const InputSource &in, const char *out,
+                       const ConvertParams &params,
+                       ConvertStats *stats = NULL,
+                       const Handle(Message_ProgressIndicator) &progress =
+                           NULL) {
+  GlbFileOutput output(out, params, stats);
+  return convert_input(in, params, stats, progress, output);
+}
+
+/// Transcode STEP to one GLB per linear tolerance, reading and
+/// transferring the file only once.
+static int step_to_glb_lods(const InputSource &in,
+                            const std::vector<std::string> &outputs,
+                            const std::vector<double> &tolerances,
+                            const ConvertParams &params,
+                            ConvertStats *stats = NULL,
+                            const Handle(Message_ProgressIndicator) &
+                                progress = NULL) {
+  if (outputs.empty() || outputs.size() != tolerances.size()) {
+    return 1;
+  }
+  std::vector<std::pair<double, std::string>> levels;
+  for (size_t i = 0; i < outputs.size(); i++) {
+    levels.push_back(std::make_pair(tolerances[i], outputs[i]));
+  }
+  // coarse to fine: a finer mesh would never be replaced by a coarser one
+  std::stable_sort(levels.begin(), levels.end(),
+                   [](const std::pair<double, std::string> &a,
+                      const std::pair<double, std::string> &b) {
+                     return a.first > b.first;
+                   });
+
+  ConvertParams coarsest = params;
+  coarsest.tol_linear = levels[0].first;
+  LodOutput output(levels, coarsest, stats);
+  return convert_input(in, coarsest, stats, progress, output);
+}
+
+/// `params` for outputs without texture coordinates, so that
+/// `MeshOptions::optimize` welds seams across them.
+static ConvertParams without_uvs(const ConvertParams &params) {
+  ConvertParams plain = params;
+  plain.write.uvs = false;
+  return plain;
+}
+
+/// Transcode a file to a folder of GLB tiles with a `tileset.json`.
+static int step_to_tiles(const InputSource &in, const char *directory,
+                         int64_t tile_triangles, const ConvertParams &params,
+                         ConvertStats *stats = NULL,
+                         const Handle(Message_ProgressIndicator) &progress =
+                             NULL) {
+  const ConvertParams plain = without_uvs(params);
+  TilesOutput output(directory, tile_triangles, plain, stats);
+  return convert_input(in, plain, stats, progress, output);
+}
+
+/// Transcode an in-memory file to an in-memory GLB. STEP and BREP
+/// are streamed straight from `data` without a copy.
+static int step_bytes_to_glb(const char *data, size_t size,
+                             InputFormat format, std::string &out,
+                             const ConvertParams &params,
+                             ConvertStats *stats = NULL,
+                             const Handle(Message_ProgressIndicator) &
+                                 progress = NULL) {
+  GlbMemoryOutput output(out, params, stats);
+  return convert_input(InputSource(data, size, format), params, stats,
+                       progress, output);
+}
+
+/// Mesh a file from disk or memory into arrays per part.
+static int step_to_arrays(const InputSource &source, SceneArrays &scene,
+                          const ConvertParams &params,
+                          ConvertStats *stats = NULL,
+                          const Handle(Message_ProgressIndicator) &progress =
+                              NULL) {
+  ArraysOutput output(scene, stats);
+  return convert_input(source, without_uvs(params), stats, progress, output);
+}
+
+/// Converts any number of inputs with the same settings. The OCCT
+/// globals and the shared thread pool are set up once, and every
+/// document is closed as its conversion ends, so a long-lived worker
+/// can keep one converter and call it indefinitely.
+class Converter {
+public:
+  Converter(const ConvertParams &theParams) : myParams(theParams) {
+    init_occt();
+    // the pool and its threads then stay alive between conversions
+    OSD_ThreadPool::DefaultPool();
+  }
+
+  const ConvertParams &Params() const { return myParams; }
+
+  /// Write a GLB file.
+  int ToGlb(const InputSource &in, const char *out, ConvertStats *stats = NULL,
+            const Handle(Message_ProgressIndicator) &progress = NULL) const {
+    GlbFileOutput output(out, myParams, stats);
+    return convert_input(in, myParams, stats, progress, output);
+  }
+
+  /// Write a GLB into `out`.
+  int ToGlb(const InputSource &in, std::string &out,
+            ConvertStats *stats = NULL,
+            const Handle(Message_ProgressIndicator) &progress = NULL) const {
+    GlbMemoryOutput output(out, myParams, stats);
+    return convert_input(in, myParams, stats, progress, output);
+  }
+
+  /// Write GLB tiles and a `tileset.json` into `directory`.
+  int ToTiles(const InputSource &in, const char *directory,
+              int64_t tile_triangles, ConvertStats *stats = NULL,
+              const Handle(Message_ProgressIndicator) &progress =
+                  NULL) const {
+    const ConvertParams plain = without_uvs(myParams);
+    TilesOutput output(directory, tile_triangles, plain, stats);
+    return convert_input(in, plain, stats, progress, output);
+  }
+
+  /// Collect mesh arrays per part into `scene`.
+  int ToArrays(const InputSource &in, SceneArrays &scene,
+               ConvertStats *stats = NULL,
+               const Handle(Message_ProgressIndicator) &progress =
+                   NULL) const {
+    ArraysOutput output(scene, stats);
+    return convert_input(in, without_uvs(myParams), stats, progress, output);
+  }
+
+private:
+  ConvertParams myParams;
+};
+
+/// Converts a single file of a batch.
+struct StepBatchJob {
+  StepBatchJob(const std::vector<std::string> &theInputs,
+               const std::vector<std::string> &theOutputs,
+               const ConvertParams &theParams)
+      : inputs(theInputs), outputs(theOutputs), params(theParams) {}
+
+  int operator()(size_t index) const {
+    return step_to_glb(inputs[index].c_str(), outputs[index].c_str(), params);
+  }
+
+  const std::vector<std::string> &inputs;
+  const std::vector<std::string> &outputs;
+  const ConvertParams &params;
+};
+
+/// Transcode many STEP files to glTF concurrently, largest first.
+/// Returns the `step_to_glb` status of every file.
+static std::vector<int>
+step_to_glb_batch(const std::vector<std::string> &inputs,
+                  const std::vector<std::string> &outputs,
+                  const ConvertParams &params, int num_threads) {
+  init_occt();
+  std::vector<int64_t> weights(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    weights[i] = file_size(inputs[i]);
+  }
+  return run_batch(weights, StepBatchJob(inputs, outputs, params),
+                   params.use_parallel ? num_threads : 1);
+}
+
+/// Collect the product structure and part bounds of a file without
+/// meshing. A STEP file without a selection is only parsed and its
+/// model walked by `scan_step_model`; anything else is transferred
+/// and walked by `scan_document`. Either walk is timed as `transfer`.
+static int scan_input(const InputSource &source, const ConvertParams &params,
+                      ScanResult &result, ConvertStats *stats = NULL,
+                      const Handle(Message_ProgressIndicator) &progress =
+                          NULL) {
+  init_occt();
+  Message_ProgressScope scope(start_progress(progress), "Scanning", 100);
+  if (source.format == InputFormat_STEP && params.read.filter.IsEmpty()) {
+    // the product structure is all in the parsed model, so nothing
+    // is transferred
+    std::unique_ptr<STEPCAFControl_Reader> reader(new STEPCAFControl_Reader());
+    int status = parse_step(source, *reader, stats, scope.Next(90));
+    if (status == 1) {
+      std::cerr << "Error: Failed to read " << format_name(source.format)
+                << " file \"" << source.Name() << "\" !" << std::endl;
+    }
+    if (status != 0) {
+      return status;
+    }
+    {
+      StageTimer timer(stats ? &stats->transfer : NULL);
+      TraceSpan span("transfer", "scan");
+      scan_step_model(reader->Reader().WS(), params.read, result);
+      if (stats != NULL) {
+        stats->shapes = (int64_t)result.parts.size();
+      }
+    }
+    scope.Next(10);
+    StageTimer timer(stats ? &stats->release : NULL);
+    TraceSpan release("release", "model");
+    if (params.read.release_async) {
+      ReleaseQueue::Instance().Add(reader);
+    }
+    reader.reset();
+    return 0;
+  }
+
+  Handle(TDocStd_Document) doc;
+  int status = read_document(source, params, doc, stats, scope.Next(90));
+  if (status != 0) {
+    return status;
+  }
+  if (!params.read.filter.IsEmpty() &&
+      select_parts(doc, params.read.filter) == 0) {
+    std::cerr << "Error: No parts match the selection !" << std::endl;
+    status = 1;
+  } else {
+    StageTimer timer(stats ? &stats->transfer : NULL);
+    scan_document(doc, result, params.use_parallel);
+    if (stats != NULL) {
+      stats->shapes = (int64_t)result.parts.size();
+    }
+  }
+  scope.Next(10);
+  {
+    StageTimer timer(stats ? &stats->release : NULL);
+    TraceSpan release("release", "document");
+    close_document(doc);
+    if (params.read.release_async) {
+      // takes the last reference, leaving `doc` null
+      ReleaseQueue::Instance().Add(doc);
+    }
+    doc.Nullify();
+  }
+  return status;
+}
+
+/// Scans a single file of a batch.
+struct ScanBatchJob {
+  ScanBatchJob(const std::vector<std::string> &theInputs,
+               std::vector<ScanResult> &theResults,
+               const ConvertParams &theParams)
+      : inputs(theInputs), results(theResults), params(theParams) {}
+
+  int operator()(size_t index) const {
+    return scan_input(inputs[index].c_str(), params, results[index]);
+  }
+
+  const std::vector<std::string> &inputs;
+  std::vector<ScanResult> &results;
+  const ConvertParams &params;
+};
+
+/// Scan many files concurrently, largest first. Returns the
+/// `scan_input` status of every file.
+static std::vector<int> scan_batch(const std::vector<std::string> &inputs,
+                                   std::vector<ScanResult> &results,
+                                   const ConvertParams &params,
+                                   int num_threads) {
+  init_occt();
+  results.assign(inputs.size(), ScanResult());
+  std::vector<int64_t> weights(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    weights[i] = file_size(inputs[i]);
+  }
+  // one file per thread: bounding in parallel inside a file
+  // would only contend with the other files
+  ConvertParams single = params;
+  single.use_parallel = Standard_False;
+  return run_batch(weights, ScanBatchJob(inputs, results, single),
+                   params.use_parallel ? num_threads : 1);
+}
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <BRepAdaptor_Surface.hxx>
+#include <BRepGProp.hxx>
+#include <BRep_Tool.hxx>
+#include <GProp_GProps.hxx>
+#include <GProp_PrincipalProps.hxx>
+#include <OSD_Parallel.hxx>
+#include <Precision.hxx>
+#include <Quantity_ColorRGBA.hxx>
+#include <TDF_LabelSequence.hxx>
+#include <TDataStd_Name.hxx>
+#include <TDocStd_Document.hxx>
+#include <TopExp.hxx>
+#include <TopExp_Explorer.hxx>
+#include <TopTools_IndexedMapOfShape.hxx>
+#include <TopoDS.hxx>
+#include <XCAFDoc_ColorTool.hxx>
+#include <XCAFDoc_DocumentTool.hxx>
+#include <XCAFDoc_ShapeTool.hxx>
+#include <gp_Ax3.hxx>
+#include <gp_Trsf.hxx>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Rigid-motion invariants of a part definition, plus the principal
+/// frame of its edges which is used to recover the motion between two
+/// parts with the same invariants.
+struct PartFingerprint {
+  PartFingerprint() : length(0.0), size(0.0) {
+    moments[0] = moments[1] = moments[2] = 0.0;
+  }
+
+  TDF_Label label;
+  TopoDS_Shape shape;
+  /// Topology and surface type counts, compared exactly.
+  std::string topology;
+  /// Total edge length and principal moments of the edges, sorted.
+  double length;
+  double moments[3];
+  /// Centre of mass and principal axes, in order of `moments`.
+  gp_Pnt center;
+  gp_Dir axes[3];
+  /// Radius of gyration of the edges, the scale of tolerances.
+  double size;
+};
+
+/// Count sub-shapes and face types: cheap and exact, so parts
+/// which cannot be copies of each other never get any further.
+static std::string topology_key(const TopoDS_Shape &shape) {
+  std::ostringstream key;
+  const TopAbs_ShapeEnum types[] = {TopAbs_SOLID, TopAbs_SHELL, TopAbs_FACE,
+                                    TopAbs_EDGE, TopAbs_VERTEX};
+  for (int i = 0; i < 5; i++) {
+    TopTools_IndexedMapOfShape map;
+    TopExp::MapShapes(shape, types[i], map);
+    key << map.Extent() << ",";
+  }
+  int surfaces[GeomAbs_OtherSurface + 1] = {0};
+  TopTools_IndexedMapOfShape faces;
+  TopExp::MapShapes(shape, TopAbs_FACE, faces);
+  for (int i = 1; i <= faces.Extent(); i++) {
+    surfaces[BRepAdaptor_Surface(TopoDS::Face(faces(i)), Standard_False)
+                 .GetType()]++;
+  }
+  for (int i = 0; i <= GeomAbs_OtherSurface; i++) {
+    key << surfaces[i] << ",";
+  }
+  return key.str();
+}
+
+/// Fill the edge inertia of a fingerprint. Edges are integrated
+/// rather than volumes because it is far cheaper and still tells
+/// apart parts with the same topology.
+static void edge_inertia(PartFingerprint &part) {
+  GProp_GProps props;
+  try {
+    BRepGProp::LinearProperties(part.shape, props, Standard_True);
+  } catch (const Standard_Failure &) {
+    // a part we cannot integrate is simply never shared
+    return;
+  }
+  part.length = props.Mass();
+  if (part.length <= 0.0) {
+    return;
+  }
+  part.center = props.CentreOfMass();
+
+  Standard_Real m[3];
+  const GProp_PrincipalProps principal = props.PrincipalProperties();
+  principal.Moments(m[0], m[1], m[2]);
+  gp_Vec axes[3] = {principal.FirstAxisOfInertia(),
+                    principal.SecondAxisOfInertia(),
+                    principal.ThirdAxisOfInertia()};
+  int order[3] = {0, 1, 2};
+  std::sort(order, order + 3, [&m](int a, int b) { return m[a] < m[b]; });
+  for (int i = 0; i < 3; i++) {
+    part.moments[i] = m[order[i]];
+    part.axes[i] = gp_Dir(axes[order[i]]);
+  }
+  part.size = std::sqrt((m[0] + m[1] + m[2]) / part.length);
+}
+
+/// Whether two values agree to a relative tolerance.
+static bool nearly_equal(double a, double b, double tolerance) {
+  return std::fabs(a - b) <= tolerance * std::max(std::fabs(a), std::fabs(b));
+}
+
+/// Points of every vertex of a shape, sorted by X.
+static std::vector<gp_Pnt> sorted_vertices(const TopoDS_Shape &shape) {
+  TopTools_IndexedMapOfShape vertices;
+  TopExp::MapShapes(shape, TopAbs_VERTEX, vertices);
+  std::vector<gp_Pnt> points;
+  for (int i = 1; i <= vertices.Extent(); i++) {
+    points.push_back(BRep_Tool::Pnt(TopoDS::Vertex(vertices(i))));
+  }
+  std::sort(points.begin(), points.end(),
+            [](const gp_Pnt &a, const gp_Pnt &b) { return a.X() < b.X(); });
+  return points;
+}
+
+/// Whether `trsf` maps every vertex of `from` onto one of `to`.
+static bool vertices_match(const std::vector<gp_Pnt> &from,
+                           const std::vector<gp_Pnt> &to, const gp_Trsf &trsf,
+                           double tolerance) {
+  for (size_t i = 0; i < from.size(); i++) {
+    const gp_Pnt p = from[i].Transformed(trsf);
+    std::vector<gp_Pnt>::const_iterator it = std::lower_bound(
+        to.begin(), to.end(), p.X() - tolerance,
+        [](const gp_Pnt &a, double x) { return a.X() < x; });
+    bool found = false;
+    for (; it != to.end() && it->X() <= p.X() + tolerance; ++it) {
+      if (it->Distance(p) <= tolerance) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// The part of `v` perpendicular to `axis`.
+static gp_Vec radial_part(const gp_Vec &v, const gp_Dir &axis) {
+  return v - gp_Vec(axis) * v.Dot(gp_Vec(axis));
+}
+
+/// Find the motion taking `from` onto `to` for parts symmetric about
+/// one principal axis, whose other two axes are any pair in the plane
+/// across it. The vertex farthest from the axis of `from` fixes the
+/// free rotation: every vertex of `to` at the same height and radius
+/// is tried as its image, with the axis either way up.
+static bool find_motion_about_axis(const PartFingerprint &from,
+                                   const PartFingerprint &to, int axis,
+                                   const std::vector<gp_Pnt> &fromVertices,
+                                   const std::vector<gp_Pnt> &toVertices,
+                                   double tolerance, gp_Trsf &motion) {
+  const gp_Dir &fromAxis = from.axes[axis];
+  size_t anchor = 0;
+  double radius = 0.0;
+  for (size_t i = 0; i < fromVertices.size(); i++) {
+    const double r =
+        radial_part(gp_Vec(from.center, fromVertices[i]), fromAxis).Magnitude();
+    if (r > radius) {
+      radius = r;
+      anchor = i;
+    }
+  }
+  if (radius <= tolerance) {
+    // vertices on the axis alone cannot fix the rotation
+    return false;
+  }
+  const gp_Vec offset(from.center, fromVertices[anchor]);
+  const double height = offset.Dot(gp_Vec(fromAxis));
+  const gp_Ax3 source(from.center, fromAxis,
+                      gp_Dir(radial_part(offset, fromAxis)));
+  for (int flip = 0; flip < 2; flip++) {
+    const gp_Dir toAxis = flip ? to.axes[axis].Reversed() : to.axes[axis];
+    for (size_t i = 0; i < toVertices.size(); i++) {
+      const gp_Vec image(to.center, toVertices[i]);
+      const gp_Vec across = radial_part(image, toAxis);
+      if (std::fabs(image.Dot(gp_Vec(toAxis)) - height) > tolerance ||
+          std::fabs(across.Magnitude() - radius) > tolerance) {
+        continue;
+      }
+      gp_Trsf candidate;
+      candidate.SetDisplacement(source,
+                                gp_Ax3(to.center, toAxis, gp_Dir(across)));
+      if (vertices_match(fromVertices, toVertices, candidate, tolerance)) {
+        motion = candidate;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/// Find the motion taking `from` onto `to` for parts with three equal
+/// moments, whose principal axes say nothing. The vertex farthest from
+/// the centre and the one farthest from the line through both fix a
+/// frame, and every pair of vertices of `to` at the same distances is
+/// tried as their images.
+static bool find_motion_about_center(const PartFingerprint &from,
+                                     const PartFingerprint &to,
+                                     const std::vector<gp_Pnt> &fromVertices,
+                                     const std::vector<gp_Pnt> &toVertices,
+                                     double tolerance, gp_Trsf &motion) {
+  size_t first = 0;
+  double radius = 0.0;
+  for (size_t i = 0; i < fromVertices.size(); i++) {
+    const double r = from.center.Distance(fromVertices[i]);
+    if (r > radius) {
+      radius = r;
+      first = i;
+    }
+  }
+  if (radius <= tolerance) {
+    return false;
+  }
+  const gp_Vec a(from.center, fromVertices[first]);
+  size_t second = 0;
+  double area = 0.0;
+  for (size_t i = 0; i < fromVertices.size(); i++) {
+    const double s = a.Crossed(gp_Vec(from.center, fromVertices[i])).Magnitude();
+    if (s > area) {
+      area = s;
+      second = i;
+    }
+  }
+  if (area <= tolerance * radius) {
+    // every vertex on one line through the centre
+    return false;
+  }
+  const gp_Vec b(from.center, fromVertices[second]);
+  const double radius2 = b.Magnitude();
+  const double apart = fromVertices[first].Distance(fromVertices[second]);
+  const gp_Ax3 source(from.center, gp_Dir(a ^ b), gp_Dir(a));
+  for (size_t i = 0; i < toVertices.size(); i++) {
+    const gp_Vec p(to.center, toVertices[i]);
+    if (std::fabs(p.Magnitude() - radius) > tolerance) {
+      continue;
+    }
+    for (size_t j = 0; j < toVertices.size(); j++) {
+      const gp_Vec q(to.center, toVertices[j]);
+      if (std::fabs(q.Magnitude() - radius2) > tolerance ||
+          std::fabs(toVertices[i].Distance(toVertices[j]) - apart) >
+              tolerance ||
+          p.Crossed(q).Magnitude() <= tolerance * radius) {
+        continue;
+      }
+      gp_Trsf candidate;
+      candidate.SetDisplacement(source,
+                                gp_Ax3(to.center, gp_Dir(p ^ q), gp_Dir(p)));
+      if (vertices_match(fromVertices, toVertices, candidate, tolerance)) {
+        motion = candidate;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/// Find the rigid motion taking `from` onto `to`, trying the four
+/// right-handed sign choices of the principal axes of `to`. Where
+/// moments repeat, as for rotationally symmetric parts, the axes for
+/// them are arbitrary and the free rotation is searched instead.
+static bool find_motion(const PartFingerprint &from,
+                        const PartFingerprint &to, gp_Trsf &motion) {
+  const gp_Ax3 source(from.center, from.axes[0] ^ from.axes[1], from.axes[0]);
+  const std::vector<gp_Pnt> fromVertices = sorted_vertices(from.shape);
+  const std::vector<gp_Pnt> toVertices = sorted_vertices(to.shape);
+  const double tolerance = std::max(Precision::Confusion(), 1e-6 * to.size);
+  for (int flip = 0; flip < 4; flip++) {
+    const gp_Dir x = (flip & 1) ? to.axes[0].Reversed() : to.axes[0];
+    const gp_Dir y = (flip & 2) ? to.axes[1].Reversed() : to.axes[1];
+    gp_Trsf candidate;
+    candidate.SetDisplacement(source, gp_Ax3(to.center, x ^ y, x));
+    if (vertices_match(fromVertices, toVertices, candidate, tolerance)) {
+      motion = candidate;
+      return true;
+    }
+  }
+
+  // axes of moments this close are only known up to a rotation
+  const double spread = 1e-4 * from.moments[2];
+  const bool low = from.moments[1] - from.moments[0] <= spread;
+  const bool high = from.moments[2] - from.moments[1] <= spread;
+  if (low && high) {
+    return find_motion_about_center(from, to, fromVertices, toVertices,
+                                    tolerance, motion);
+  }
+  if (low || high) {
+    return find_motion_about_axis(from, to, low ? 2 : 0, fromVertices,
+                                  toVertices, tolerance, motion);
+  }
+  return false;
+}
+
+/// Surface colour of a part label as a string, empty if none.
+static std::string part_color(const Handle(XCAFDoc_ColorTool) & colorTool,
+                              const TDF_Label &label) {
+  Quantity_ColorRGBA color;
+  if (!colorTool->GetColor(label, XCAFDoc_ColorSurf, color) &&
+      !colorTool->GetColor(label, XCAFDoc_ColorGen, color)) {
+    return std::string();
+  }
+  std::ostringstream key;
+  const NCollection_Vec4<float> &rgba = color;
+  key << rgba[0] << "," << rgba[1] << "," << rgba[2] << "," << rgba[3];
+  return key.str();
+}
+
+/// Move the shape of part `label` to a new part definition and make
+/// `label` an assembly holding a single instance of it. Referencing
+/// the new label rather than `label` keeps `label` a free shape.
+static TDF_Label split_part(const Handle(XCAFDoc_ShapeTool) & shapeTool,
+                            const TDF_Label &label) {
+  TDF_Label part = shapeTool->NewShape();
+  shapeTool->SetShape(part, XCAFDoc_ShapeTool::GetShape(label));
+  Handle(TDataStd_Name) name;
+  if (label.FindAttribute(TDataStd_Name::GetID(), name)) {
+    TDataStd_Name::Set(part, name->Get());
+  }
+  shapeTool->AddComponent(label, part, TopLoc_Location());
+  return part;
+}
+
+/// Find part definitions of `prototypes` which are copies of one
+/// another under a rigid motion. The first of each group moves to a
+/// new part definition, and it and every copy become assemblies
+/// holding one instance of that part, so it is meshed and written
+/// once. Parts with sub-shape colours or names are left alone as
+/// sharing would lose them. Returns the number of copies replaced.
+static int dedupe_parts(const Handle(TDocStd_Document) & doc,
+                        const TDF_LabelSequence &prototypes,
+                        Standard_Boolean use_parallel) {
+  Handle(XCAFDoc_ShapeTool) shapeTool =
+      XCAFDoc_DocumentTool::ShapeTool(doc->Main());
+  Handle(XCAFDoc_ColorTool) colorTool =
+      XCAFDoc_DocumentTool::ColorTool(doc->Main());
+
+  // group by the exact keys first, which costs no integration
+  std::map<std::string, std::vector<PartFingerprint>> groups;
+  for (TDF_LabelSequence::Iterator it(prototypes); it.More(); it.Next()) {
+    TDF_LabelSequence subShapes;
+    XCAFDoc_ShapeTool::GetSubShapes(it.Value(), subShapes);
+    if (!subShapes.IsEmpty()) {
+      continue;
+    }
+    PartFingerprint part;
+    part.label = it.Value();
+    part.shape = XCAFDoc_ShapeTool::GetShape(it.Value());
+    if (part.shape.IsNull()) {
+      continue;
+    }
+    part.topology = topology_key(part.shape);
+    groups[part.topology + part_color(colorTool, part.label)].push_back(part);
+  }
+
+  std::vector<PartFingerprint *> candidates;
+  for (std::map<std::string, std::vector<PartFingerprint>>::iterator it =
+           groups.begin();
+       it != groups.end(); ++it) {
+    for (size_t i = 0; it->second.size() > 1 && i < it->second.size(); i++) {
+      candidates.push_back(&it->second[i]);
+    }
+  }
+  OSD_Parallel::For(
+      0, (int)candidates.size(),
+      [&candidates](int i) { edge_inertia(*candidates[i]); }, !use_parallel);
+
+  int replaced = 0;
+  for (std::map<std::string, std::vector<PartFingerprint>>::iterator it =
+           groups.begin();
+       it != groups.end(); ++it) {
+    std::vector<PartFingerprint> &parts = it->second;
+    std::vector<char> done(parts.size(), 0);
+    for (size_t r = 0; r < parts.size(); r++) {
+      if (done[r] || parts[r].length <= 0.0) {
+        continue;
+      }
+      TDF_Label shared;
+      for (size_t d = r + 1; d < parts.size(); d++) {
+        const PartFingerprint &copy = parts[d];
+        if (done[d] || !nearly_equal(copy.length, parts[r].length, 1e-7)) {
+          continue;
+        }
+        bool same = true;
+        for (int k = 0; k < 3 && same; k++) {
+          same = nearly_equal(copy.moments[k], parts[r].moments[k], 1e-6);
+        }
+        gp_Trsf motion;
+        if (!same || !find_motion(parts[r], copy, motion)) {
+          continue;
+        }
+        if (shared.IsNull()) {
+          shared = split_part(shapeTool, parts[r].label);
+        }
+        shapeTool->AddComponent(copy.label, shared, TopLoc_Location(motion));
+        done[d] = 1;
+        replaced++;
+      }
+    }
+  }
+
+  if (replaced > 0) {
+    // rebuild the compounds of the copies turned into assemblies
+    shapeTool->UpdateAssemblies();
+  }
+  return replaced;
+}
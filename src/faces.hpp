@@ -0,0 +1,169 @@
+#pragma once
+
+#include <BRepMesh_Context.hxx>
+#include <BRepMesh_FaceDiscret.hxx>
+#include <BRepMesh_MeshAlgoFactory.hxx>
+#include <BRep_Tool.hxx>
+#include <GeomAbs_SurfaceType.hxx>
+#include <IMeshData_Face.hxx>
+#include <IMeshTools_MeshAlgo.hxx>
+#include <IMeshTools_MeshAlgoFactory.hxx>
+#include <Message_ProgressIndicator.hxx>
+#include <Poly_Triangulation.hxx>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#include "trace.hpp"
+
+static const char *surface_name(GeomAbs_SurfaceType type) {
+  switch (type) {
+  case GeomAbs_Plane:
+    return "plane";
+  case GeomAbs_Cylinder:
+    return "cylinder";
+  case GeomAbs_Cone:
+    return "cone";
+  case GeomAbs_Sphere:
+    return "sphere";
+  case GeomAbs_Torus:
+    return "torus";
+  case GeomAbs_BezierSurface:
+    return "bezier";
+  case GeomAbs_BSplineSurface:
+    return "bspline";
+  case GeomAbs_SurfaceOfRevolution:
+    return "revolution";
+  case GeomAbs_SurfaceOfExtrusion:
+    return "extrusion";
+  case GeomAbs_OffsetSurface:
+    return "offset";
+  default:
+    return "other";
+  }
+}
+
+/// Progress of meshing one face, which breaks once its time is up
+/// or when the conversion is cancelled. BRepMesh checks it wherever
+/// it checks for cancellation, which is in every loop over nodes.
+class FaceDeadline : public Message_ProgressIndicator {
+  DEFINE_STANDARD_RTTI_INLINE(FaceDeadline, Message_ProgressIndicator)
+public:
+  FaceDeadline(double theSeconds, const Message_ProgressRange &theOuter)
+      : myEnd(std::chrono::steady_clock::now() +
+              std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                  std::chrono::duration<double>(theSeconds))),
+        myOuter(theOuter), myExpired(false) {}
+
+  virtual Standard_Boolean UserBreak() override {
+    if (!myExpired && std::chrono::steady_clock::now() >= myEnd) {
+      myExpired = true;
+    }
+    return myExpired || myOuter.UserBreak();
+  }
+
+  virtual void Show(const Message_ProgressScope &,
+                    const Standard_Boolean) override {}
+
+  /// Whether the time ran out, as opposed to a cancellation.
+  bool IsExpired() const { return myExpired; }
+
+private:
+  std::chrono::steady_clock::time_point myEnd;
+  const Message_ProgressRange &myOuter;
+  bool myExpired;
+};
+
+/// Meshes one face with the algorithm BRepMesh would have used and
+/// records it as a span of the running trace. With a `timeout` in
+/// seconds, a face which takes longer is meshed again from the nodes
+/// of its boundary only, which are already there and bound the time,
+/// and counted in `timeouts`.
+class FaceMeshAlgo : public IMeshTools_MeshAlgo {
+public:
+  FaceMeshAlgo(const Handle(IMeshTools_MeshAlgoFactory) & theFactory,
+               GeomAbs_SurfaceType theType,
+               const IMeshTools_Parameters &theParameters, double theTimeout,
+               std::atomic<int64_t> *theTimeouts)
+      : myFactory(theFactory),
+        myAlgo(theFactory->GetAlgo(theType, theParameters)), myType(theType),
+        myTimeout(theTimeout), myTimeouts(theTimeouts) {}
+
+  virtual void Perform(const IMeshData::IFaceHandle &theDFace,
+                       const IMeshTools_Parameters &theParameters,
+                       const Message_ProgressRange &theRange =
+                           Message_ProgressRange()) Standard_OVERRIDE {
+    TraceSpan span("mesh", "face");
+    bool fallback = false;
+    if (myTimeout > 0.0) {
+      Handle(FaceDeadline) deadline = new FaceDeadline(myTimeout, theRange);
+      myAlgo->Perform(theDFace, theParameters, deadline->Start());
+      fallback = deadline->IsExpired() && !theRange.UserBreak();
+    } else {
+      myAlgo->Perform(theDFace, theParameters, theRange);
+    }
+    if (fallback) {
+      IMeshTools_Parameters coarse = theParameters;
+      coarse.InternalVerticesMode = Standard_False;
+      coarse.ControlSurfaceDeflection = Standard_False;
+      myFactory->GetAlgo(myType, coarse)->Perform(theDFace, coarse, theRange);
+      if (myTimeouts != NULL) {
+        (*myTimeouts)++;
+      }
+    }
+    if (span.IsActive()) {
+      span.Arg("surface", std::string(surface_name(myType)));
+      if (fallback) {
+        span.Arg("fallback", 1);
+      }
+      TopLoc_Location loc;
+      const Handle(Poly_Triangulation) &tri =
+          BRep_Tool::Triangulation(theDFace->GetFace(), loc);
+      span.Arg("triangles", tri.IsNull() ? 0 : tri->NbTriangles());
+    }
+  }
+
+  DEFINE_STANDARD_RTTI_INLINE(FaceMeshAlgo, IMeshTools_MeshAlgo)
+
+private:
+  Handle(IMeshTools_MeshAlgoFactory) myFactory;
+  Handle(IMeshTools_MeshAlgo) myAlgo;
+  GeomAbs_SurfaceType myType;
+  double myTimeout;
+  std::atomic<int64_t> *myTimeouts;
+};
+
+/// Hands BRepMesh a `FaceMeshAlgo` around each algorithm of the
+/// default factory.
+class FaceMeshAlgoFactory : public IMeshTools_MeshAlgoFactory {
+public:
+  FaceMeshAlgoFactory(double theTimeout, std::atomic<int64_t> *theTimeouts)
+      : myFactory(new BRepMesh_MeshAlgoFactory()), myTimeout(theTimeout),
+        myTimeouts(theTimeouts) {}
+
+  virtual Handle(IMeshTools_MeshAlgo)
+      GetAlgo(const GeomAbs_SurfaceType theSurfaceType,
+              const IMeshTools_Parameters &theParameters) const
+      Standard_OVERRIDE {
+    return new FaceMeshAlgo(myFactory, theSurfaceType, theParameters,
+                            myTimeout, myTimeouts);
+  }
+
+  DEFINE_STANDARD_RTTI_INLINE(FaceMeshAlgoFactory, IMeshTools_MeshAlgoFactory)
+
+private:
+  Handle(IMeshTools_MeshAlgoFactory) myFactory;
+  double myTimeout;
+  std::atomic<int64_t> *myTimeouts;
+};
+
+/// A BRepMesh context meshing faces through `FaceMeshAlgo`, for
+/// `BRepMesh_IncrementalMesh::Perform`.
+static Handle(IMeshTools_Context)
+    face_mesh_context(double timeout = 0.0,
+                      std::atomic<int64_t> *timeouts = NULL) {
+  Handle(BRepMesh_Context) context = new BRepMesh_Context();
+  context->SetFaceDiscret(
+      new BRepMesh_FaceDiscret(new FaceMeshAlgoFactory(timeout, timeouts)));
+  return context;
+}
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <Quantity_ColorRGBA.hxx>
+#include <RWMesh_FaceIterator.hxx>
+#include <TCollection_AsciiString.hxx>
+#include <TDF_Label.hxx>
+#include <TDF_Tool.hxx>
+#include <TDocStd_Document.hxx>
+#include <UnitsMethods_LengthUnit.hxx>
+#include <XCAFDoc_DocumentTool.hxx>
+#include <XCAFPrs_DocumentExplorer.hxx>
+#include <XCAFPrs_DocumentNode.hxx>
+#include <XCAFPrs_Style.hxx>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "arrays.hpp"
+
+/// Triangles of one colour of a part, ready to write to glTF.
+struct GlbPrimitive {
+  GlbPrimitive() : has_color(false) {
+    for (int i = 0; i < 4; i++) {
+      color[i] = 1.0f;
+    }
+  }
+
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<uint32_t> indices;
+  /// Linear RGBA base colour.
+  bool has_color;
+  float color[4];
+};
+
+/// Triangulated faces of a part definition in its own coordinates,
+/// one primitive per face colour, with `style` inherited from the
+/// assembly for faces without their own colour.
+static std::vector<GlbPrimitive> part_primitives(const TDF_Label &part,
+                                                 const XCAFPrs_Style &style) {
+  std::vector<GlbPrimitive> primitives;
+  std::map<std::string, size_t> byColor;
+  for (RWMesh_FaceIterator face(part, TopLoc_Location(), Standard_True,
+                                style);
+       face.More(); face.Next()) {
+    if (face.IsEmptyMesh()) {
+      continue;
+    }
+    std::ostringstream key;
+    NCollection_Vec4<float> rgba(1.0f);
+    if (face.HasFaceColor()) {
+      rgba = face.FaceColor();
+      key << rgba[0] << "," << rgba[1] << "," << rgba[2] << "," << rgba[3];
+    }
+    std::map<std::string, size_t>::iterator found = byColor.find(key.str());
+    if (found == byColor.end()) {
+      found = byColor.insert(std::make_pair(key.str(), primitives.size())).first;
+      primitives.push_back(GlbPrimitive());
+      primitives.back().has_color = face.HasFaceColor();
+      for (int i = 0; i < 4; i++) {
+        primitives.back().color[i] = rgba[i];
+      }
+    }
+    GlbPrimitive &primitive = primitives[found->second];
+
+    const uint32_t base = (uint32_t)(primitive.positions.size() / 3);
+    for (int n = face.NodeLower(); n <= face.NodeUpper(); n++) {
+      const gp_Pnt p = face.NodeTransformed(n);
+      const gp_Dir d = face.NormalTransformed(n);
+      primitive.positions.push_back((float)p.X());
+      primitive.positions.push_back((float)p.Y());
+      primitive.positions.push_back((float)p.Z());
+      primitive.normals.push_back((float)d.X());
+      primitive.normals.push_back((float)d.Y());
+      primitive.normals.push_back((float)d.Z());
+    }
+    for (int t = face.ElemLower(); t <= face.ElemUpper(); t++) {
+      int a, b, c;
+      face.TriangleOriented(t).Get(a, b, c);
+      primitive.indices.push_back(base + (uint32_t)(a - face.NodeLower()));
+      primitive.indices.push_back(base + (uint32_t)(b - face.NodeLower()));
+      primitive.indices.push_back(base + (uint32_t)(c - face.NodeLower()));
+    }
+  }
+  return primitives;
+}
+
+/// A string as a JSON literal.
+static std::string json_string(const std::string &value) {
+  std::ostringstream out;
+  out << '"';
+  for (size_t i = 0; i < value.size(); i++) {
+    const unsigned char c = (unsigned char)value[i];
+    if (c == '"' || c == '\\') {
+      out << '\\' << (char)c;
+    } else if (c < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out << escaped;
+    } else {
+      out << (char)c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+/// Writes binary glTF one mesh at a time. Buffer data goes straight
+/// to a temporary file as meshes are added and only the JSON, which
+/// is small, is kept in memory, so memory use does not grow with the
+/// size of the model. `Finish` assembles the GLB, which must have
+/// the JSON before the buffer. Without a path the buffer is kept in
+/// memory and `Finish` returns the GLB in a string.
+class GlbStreamWriter {
+public:
+  GlbStreamWriter(const std::string &thePath = std::string())
+      : myPath(thePath), myBytes(0), myToWriteNormals(true),
+        myToWriteNames(true) {
+    if (!myPath.empty()) {
+      myBinPath = myPath + ".bin.part";
+      myFile.open(myBinPath.c_str(), std::ios::binary | std::ios::trunc);
+    }
+  }
+
+  ~GlbStreamWriter() {
+    if (myFile.is_open()) {
+      myFile.close();
+    }
+    if (!myBinPath.empty()) {
+      std::remove(myBinPath.c_str());
+    }
+  }
+
+  bool IsOpen() const { return myPath.empty() || myFile.is_open(); }
+
+  /// Whether to write NORMAL attributes, true by default.
+  void SetNormals(bool theToWrite) { myToWriteNormals = theToWrite; }
+
+  /// Whether to write node and mesh names, true by default.
+  void SetNames(bool theToWrite) { myToWriteNames = theToWrite; }
+
+  /// Write the buffers of a mesh and return its index.
+  int AddMesh(const std::string &name,
+              const std::vector<GlbPrimitive> &primitives) {
+    std::ostringstream mesh;
+    mesh << "{";
+    if (myToWriteNames) {
+      mesh << "\"name\":" << json_string(name) << ",";
+    }
+    mesh << "\"primitives\":[";
+    for (size_t i = 0; i < primitives.size(); i++) {
+      const GlbPrimitive &p = primitives[i];
+      mesh << (i > 0 ? "," : "") << "{\"attributes\":{\"POSITION\":"
+           << addAccessor(p.positions, true);
+      if (myToWriteNormals) {
+        mesh << ",\"NORMAL\":" << addAccessor(p.normals, false);
+      }
+      mesh << "},\"indices\":" << addIndices(p.indices) << ",\"mode\":4";
+      if (p.has_color) {
+        mesh << ",\"material\":" << material(p.color);
+      }
+      mesh << "}";
+    }
+    mesh << "]}";
+    myMeshes.push_back(mesh.str());
+    return (int)myMeshes.size() - 1;
+  }
+
+  /// Place `mesh` with a row-major 4x4 `transform`.
+  void AddNode(int mesh, const std::string &name, const double transform[16]) {
+    std::ostringstream node;
+    node.precision(17);
+    node << "{";
+    if (myToWriteNames) {
+      node << "\"name\":" << json_string(name) << ",";
+    }
+    node << "\"mesh\":" << mesh << ",\"matrix\":[";
+    // glTF matrices are column-major
+    for (int col = 0; col < 4; col++) {
+      for (int row = 0; row < 4; row++) {
+        node << (col + row > 0 ? "," : "") << transform[row * 4 + col];
+      }
+    }
+    node << "]}";
+    myNodes.push_back(node.str());
+  }
+
+  /// Write the GLB to the path, scaling the model by `scale` to meters.
+  bool Finish(double scale) {
+    myFile.close();
+    if (myFile.fail()) {
+      return false;
+    }
+    std::ofstream out(myPath.c_str(), std::ios::binary | std::ios::trunc);
+    std::ifstream bin(myBinPath.c_str(), std::ios::binary);
+    writeGlb(out, bin, scale);
+    out.close();
+    return !out.fail();
+  }
+
+  /// Return the GLB written without a path in `out`.
+  bool Finish(double scale, std::string &out) {
+    std::istringstream bin(myMemory.str());
+    myMemory.str(std::string());
+    std::ostringstream glb;
+    writeGlb(glb, bin, scale);
+    out = glb.str();
+    return true;
+  }
+
+private:
+  /// Write the header, the JSON and then everything in `bin`.
+  void writeGlb(std::ostream &out, std::istream &bin, double scale) {
+    std::ostringstream json;
+    json.precision(17);
+    json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"cascadio\"},"
+         << "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"matrix\":["
+         << scale << ",0,0,0,0," << scale << ",0,0,0,0," << scale
+         << ",0,0,0,0,1],\"children\":[";
+    for (size_t i = 0; i < myNodes.size(); i++) {
+      json << (i > 0 ? "," : "") << i + 1;
+    }
+    json << "]}";
+    for (size_t i = 0; i < myNodes.size(); i++) {
+      json << "," << myNodes[i];
+    }
+    json << "]";
+    writeList(json, "meshes", myMeshes);
+    writeList(json, "materials", myMaterials);
+    writeList(json, "accessors", myAccessors);
+    writeList(json, "bufferViews", myViews);
+    if (myBytes > 0) {
+      json << ",\"buffers\":[{\"byteLength\":" << myBytes << "}]";
+    }
+    json << "}";
+    std::string text = json.str();
+    text.append((4 - text.size() % 4) % 4, ' ');
+
+    const uint32_t binLength = (uint32_t)((myBytes + 3) / 4 * 4);
+    const uint32_t header[5] = {
+        0x46546C67, 2,
+        (uint32_t)(12 + 8 + text.size() + (myBytes > 0 ? 8 + binLength : 0)),
+        (uint32_t)text.size(), 0x4E4F534A};
+    out.write((const char *)header, sizeof(header));
+    out.write(text.data(), (std::streamsize)text.size());
+    if (myBytes > 0) {
+      const uint32_t chunk[2] = {binLength, 0x004E4942};
+      out.write((const char *)chunk, sizeof(chunk));
+      std::vector<char> block(1 << 20);
+      while (bin) {
+        bin.read(&block[0], (std::streamsize)block.size());
+        out.write(&block[0], bin.gcount());
+      }
+      const char zeros[4] = {0, 0, 0, 0};
+      out.write(zeros, (std::streamsize)(binLength - myBytes));
+    }
+  }
+
+  /// Append raw bytes as a buffer view and return its index. Every
+  /// element is four bytes, so views stay aligned.
+  int addView(const void *data, size_t size, int target) {
+    if (myPath.empty()) {
+      myMemory.write((const char *)data, (std::streamsize)size);
+    } else {
+      myFile.write((const char *)data, (std::streamsize)size);
+    }
+    std::ostringstream view;
+    view << "{\"buffer\":0,\"byteOffset\":" << myBytes
+         << ",\"byteLength\":" << size << ",\"target\":" << target << "}";
+    myViews.push_back(view.str());
+    myBytes += size;
+    return (int)myViews.size() - 1;
+  }
+
+  /// A VEC3 float accessor, with bounds for positions.
+  int addAccessor(const std::vector<float> &values, bool bounds) {
+    const int view = addView(values.data(), values.size() * sizeof(float),
+                             34962);
+    std::ostringstream accessor;
+    accessor.precision(9);
+    accessor << "{\"bufferView\":" << view
+             << ",\"componentType\":5126,\"count\":" << values.size() / 3
+             << ",\"type\":\"VEC3\"";
+    if (bounds && !values.empty()) {
+      float lower[3] = {values[0], values[1], values[2]};
+      float upper[3] = {values[0], values[1], values[2]};
+      for (size_t i = 3; i < values.size(); i++) {
+        lower[i % 3] = std::min(lower[i % 3], values[i]);
+        upper[i % 3] = std::max(upper[i % 3], values[i]);
+      }
+      accessor << ",\"min\":[" << lower[0] << "," << lower[1] << ","
+               << lower[2] << "],\"max\":[" << upper[0] << "," << upper[1]
+               << "," << upper[2] << "]";
+    }
+    accessor << "}";
+    myAccessors.push_back(accessor.str());
+    return (int)myAccessors.size() - 1;
+  }
+
+  int addIndices(const std::vector<uint32_t> &indices) {
+    const int view = addView(indices.data(), indices.size() * sizeof(uint32_t),
+                             34963);
+    std::ostringstream accessor;
+    accessor << "{\"bufferView\":" << view
+             << ",\"componentType\":5125,\"count\":" << indices.size()
+             << ",\"type\":\"SCALAR\"}";
+    myAccessors.push_back(accessor.str());
+    return (int)myAccessors.size() - 1;
+  }
+
+  /// Index of the material of a colour, shared by every mesh using it.
+  int material(const float color[4]) {
+    std::ostringstream key;
+    key.precision(9);
+    key << "[" << color[0] << "," << color[1] << "," << color[2] << ","
+        << color[3] << "]";
+    std::map<std::string, int>::iterator found =
+        myMaterialIndex.find(key.str());
+    if (found != myMaterialIndex.end()) {
+      return found->second;
+    }
+    std::ostringstream material;
+    material << "{\"pbrMetallicRoughness\":{\"baseColorFactor\":" << key.str()
+             << ",\"metallicFactor\":0,\"roughnessFactor\":1}";
+    if (color[3] < 1.0f) {
+      material << ",\"alphaMode\":\"BLEND\"";
+    }
+    material << ",\"doubleSided\":true}";
+    myMaterials.push_back(material.str());
+    myMaterialIndex[key.str()] = (int)myMaterials.size() - 1;
+    return (int)myMaterials.size() - 1;
+  }
+
+  static void writeList(std::ostringstream &json, const char *name,
+                        const std::vector<std::string> &items) {
+    if (items.empty()) {
+      return;
+    }
+    json << ",\"" << name << "\":[";
+    for (size_t i = 0; i < items.size(); i++) {
+      json << (i > 0 ? "," : "") << items[i];
+    }
+    json << "]";
+  }
+
+  std::string myPath;
+  std::string myBinPath;
+  std::ofstream myFile;
+  std::ostringstream myMemory;
+  size_t myBytes;
+  bool myToWriteNormals;
+  bool myToWriteNames;
+  std::vector<std::string> myNodes;
+  std::vector<std::string> myMeshes;
+  std::vector<std::string> myMaterials;
+  std::map<std::string, int> myMaterialIndex;
+  std::vector<std::string> myAccessors;
+  std::vector<std::string> myViews;
+};
+
+/// Write every instance in `nodes` of the meshed part definition
+/// `part`, adding one mesh per distinct inherited colour and skipping
+/// instances of a part without triangles.
+static void write_part_instances(GlbStreamWriter &writer,
+                                 const TDF_Label &part,
+                                 const std::vector<XCAFPrs_DocumentNode> &nodes) {
+  std::map<std::string, int> meshes;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const XCAFPrs_DocumentNode &node = nodes[i];
+    std::ostringstream key;
+    if (node.Style.IsSetColorSurf()) {
+      const NCollection_Vec4<float> rgba = node.Style.GetColorSurfRGBA();
+      key << rgba[0] << "," << rgba[1] << "," << rgba[2] << "," << rgba[3];
+    }
+    std::map<std::string, int>::iterator mesh = meshes.find(key.str());
+    if (mesh == meshes.end()) {
+      const std::vector<GlbPrimitive> primitives =
+          part_primitives(part, node.Style);
+      const int index =
+          primitives.empty() ? -1 : writer.AddMesh(label_name(part), primitives);
+      mesh = meshes.insert(std::make_pair(key.str(), index)).first;
+    }
+    if (mesh->second < 0) {
+      continue;
+    }
+    std::string name = label_name(node.Label);
+    if (name.empty()) {
+      name = label_name(part);
+    }
+    double transform[16] = {0.0};
+    const gp_Trsf trsf = node.Location.Transformation();
+    for (int row = 1; row <= 3; row++) {
+      for (int col = 1; col <= 4; col++) {
+        transform[(row - 1) * 4 + (col - 1)] = trsf.Value(row, col);
+      }
+    }
+    transform[15] = 1.0;
+    writer.AddNode(mesh->second, name, transform);
+  }
+}
+
+/// Every placed part of a document, in document order.
+static std::vector<XCAFPrs_DocumentNode>
+document_leaves(const Handle(TDocStd_Document) & doc) {
+  std::vector<XCAFPrs_DocumentNode> nodes;
+  for (XCAFPrs_DocumentExplorer explorer(
+           doc, XCAFPrs_DocumentExplorerFlags_OnlyLeafNodes);
+       explorer.More(); explorer.Next()) {
+    nodes.push_back(explorer.Current());
+  }
+  return nodes;
+}
+
+/// Group placed parts by part definition, in order of first use.
+static void group_instances(const std::vector<XCAFPrs_DocumentNode> &nodes,
+                            std::vector<TDF_Label> &parts,
+                            std::vector<std::vector<XCAFPrs_DocumentNode>> &
+                                instances) {
+  std::map<std::string, size_t> partIndex;
+  for (size_t i = 0; i < nodes.size(); i++) {
+    TCollection_AsciiString entry;
+    TDF_Tool::Entry(nodes[i].RefLabel, entry);
+    std::map<std::string, size_t>::iterator found =
+        partIndex.find(entry.ToCString());
+    if (found == partIndex.end()) {
+      found = partIndex.insert(std::make_pair(entry.ToCString(), parts.size()))
+                  .first;
+      parts.push_back(nodes[i].RefLabel);
+      instances.push_back(std::vector<XCAFPrs_DocumentNode>());
+    }
+    instances[found->second].push_back(nodes[i]);
+  }
+}
+
+/// Scale from document units to meters as RWGltf_CafWriter applies
+/// it, leaving a document without a unit unscaled.
+static double document_meters(const Handle(TDocStd_Document) & doc) {
+  Standard_Real unit = 1.0;
+  XCAFDoc_DocumentTool::GetLengthUnit(doc, unit, UnitsMethods_LengthUnit_Meter);
+  return unit;
+}
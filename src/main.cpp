@@ -1,5 +1,11 @@
 #include "convert.hpp"
+#include <Standard_Version.hxx>
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <cctype>
+#include <stdexcept>
+#include <string>
 
 #define STRINGIFY(x) #x
 #define MACRO_STRINGIFY(x) STRINGIFY(x)
@@ -8,6 +14,751 @@ int add(int i, int j) { return i + j; }
 
 namespace py = pybind11;
 
+/// Raised in Python when a conversion was stopped by its cancel token.
+struct ConvertCancelled : public std::runtime_error {
+  ConvertCancelled() : std::runtime_error("conversion cancelled") {}
+};
+
+/// Bridge a Python progress callback and cancel token to OCCT,
+/// or return null if neither is given. The callback is only
+/// called with the GIL held and an exception raised by it
+/// cancels the conversion.
+static Handle(Message_ProgressIndicator)
+    make_progress(const py::object &callback,
+                  std::shared_ptr<CancelToken> cancel) {
+  if (callback.is_none() && !cancel) {
+    return NULL;
+  }
+  if (!cancel) {
+    cancel = std::make_shared<CancelToken>();
+  }
+  ConvertProgress::Callback bridge;
+  if (!callback.is_none()) {
+    // the function may be released from any thread
+    std::shared_ptr<py::function> function(
+        new py::function(callback.cast<py::function>()),
+        [](py::function *f) {
+          py::gil_scoped_acquire gil;
+          delete f;
+        });
+    bridge = [function, cancel](double position, const std::string &stage) {
+      py::gil_scoped_acquire gil;
+      try {
+        (*function)(position, stage);
+      } catch (py::error_already_set &e) {
+        e.discard_as_unraisable("cascadio progress callback");
+        cancel->Cancel();
+      }
+    };
+  }
+  return new ConvertProgress(bridge, cancel);
+}
+
+/// Raise for `WriteOptions` which the streaming writer of
+/// `low_memory` and tiles would ignore: it always writes binary
+/// GLB with 4x4 matrices, 32-bit indices and the names as read.
+static void check_stream_write(const WriteOptions &options,
+                               const std::string &writer) {
+  const WriteOptions defaults;
+  if (options.transform_format != defaults.transform_format ||
+      options.node_name_format != defaults.node_name_format ||
+      options.mesh_name_format != defaults.mesh_name_format ||
+      options.split_indices16 != defaults.split_indices16 ||
+      options.binary != defaults.binary) {
+    throw std::invalid_argument(
+        "only the normals, uvs and names of write options apply to " + writer);
+  }
+}
+
+/// Conversion settings from the Python arguments, where any of the
+/// option objects may be None for their defaults.
+static ConvertParams make_params(double tol_linear, double tol_angular,
+                                 bool tol_relative, bool merge_primitives,
+                                 bool use_parallel, const py::object &read,
+                                 const py::object &mesh,
+                                 const py::object &write) {
+  ConvertParams params(tol_linear, tol_angular, tol_relative,
+                       merge_primitives, use_parallel);
+  if (!read.is_none()) {
+    params.read = read.cast<ReadOptions>();
+  }
+  if (!mesh.is_none()) {
+    params.mesh = mesh.cast<MeshOptions>();
+  }
+  if (!write.is_none()) {
+    params.write = write.cast<WriteOptions>();
+  }
+  const WriteOptions &options = params.write;
+  if (options.draco_level < 0 || options.draco_level > 10) {
+    throw std::invalid_argument("draco_level must be between 0 and 10");
+  }
+  if (options.quantize_position_bits < 1 ||
+      options.quantize_position_bits > 30 ||
+      options.quantize_normal_bits < 1 || options.quantize_normal_bits > 30 ||
+      options.quantize_texcoord_bits < 1 ||
+      options.quantize_texcoord_bits > 30) {
+    throw std::invalid_argument("quantization bits must be between 1 and 30");
+  }
+  if (options.low_memory) {
+    check_stream_write(options, "low_memory");
+  }
+  return params;
+}
+
+/// A `ConvertFilter` box from a Python pair of corners, or no box
+/// for None.
+static void set_box(ConvertFilter &filter, const py::object &bbox) {
+  filter.has_box = false;
+  if (bbox.is_none()) {
+    return;
+  }
+  const std::vector<std::vector<double>> corners =
+      bbox.cast<std::vector<std::vector<double>>>();
+  if (corners.size() != 2 || corners[0].size() != 3 ||
+      corners[1].size() != 3) {
+    throw std::invalid_argument("bbox must be ((x, y, z), (x, y, z))");
+  }
+  filter.has_box = true;
+  for (int i = 0; i < 3; i++) {
+    filter.box_min[i] = corners[0][i];
+    filter.box_max[i] = corners[1][i];
+  }
+}
+
+/// The box of a `ConvertFilter` as a Python pair of corners, or None.
+static py::object get_box(const ConvertFilter &filter) {
+  if (!filter.has_box) {
+    return py::none();
+  }
+  return py::make_tuple(
+      py::make_tuple(filter.box_min[0], filter.box_min[1], filter.box_min[2]),
+      py::make_tuple(filter.box_max[0], filter.box_max[1], filter.box_max[2]));
+}
+
+/// Options of type `T` with the fields named by `kwargs` set through
+/// their Python properties, so they are checked as assignments are.
+template <typename T> static T options_from_kwargs(const py::kwargs &kwargs) {
+  py::object options = py::cast(T());
+  for (auto item : kwargs) {
+    const std::string name = py::str(item.first);
+    if (!py::hasattr(options, name.c_str())) {
+      throw py::type_error("unexpected keyword argument: " + name);
+    }
+    options.attr(item.first) = item.second;
+  }
+  return options.cast<T>();
+}
+
+/// Convert a file to a GLB file with the settings of `converter`,
+/// and the part manifest at `manifest` if not empty.
+static int file_to_glb(const Converter &converter, const std::string &file_name,
+                       const std::string &file_out, ConvertStats *stats,
+                       const py::object &progress,
+                       std::shared_ptr<CancelToken> cancel, bool use_mmap,
+                       const std::string &manifest) {
+  Handle(Message_ProgressIndicator) indicator =
+      make_progress(progress, cancel);
+  py::gil_scoped_release release;
+  const InputSource source(file_name.c_str(), use_mmap);
+  if (manifest.empty()) {
+    return converter.ToGlb(source, file_out.c_str(), stats, indicator);
+  }
+  ConvertParams params = converter.Params();
+  params.manifest = manifest;
+  return Converter(params).ToGlb(source, file_out.c_str(), stats, indicator);
+}
+
+/// Convert a file to a GLB file.
+static int step_to_glb_py(const std::string &file_name,
+                          const std::string &file_out, double tol_linear,
+                          double tol_angular, bool tol_relative,
+                          bool merge_primitives, bool use_parallel,
+                          ConvertStats *stats, const py::object &progress,
+                          std::shared_ptr<CancelToken> cancel, bool use_mmap,
+                          const std::string &manifest, const py::object &read,
+                          const py::object &mesh, const py::object &write) {
+  ConvertParams params =
+      make_params(tol_linear, tol_angular, tol_relative, merge_primitives,
+                  use_parallel, read, mesh, write);
+  params.manifest = manifest;
+  return file_to_glb(Converter(params), file_name, file_out, stats, progress,
+                     cancel, use_mmap, std::string());
+}
+
+/// Format of an in-memory file type, raising unless we can read it.
+static InputFormat check_file_type(const std::string &file_type) {
+  InputFormat format;
+  if (!parse_format(file_type, format)) {
+    throw std::invalid_argument("unsupported file_type: " + file_type);
+  }
+  return format;
+}
+
+/// Convert a file to one GLB file per linear tolerance.
+static int step_to_glb_lods(const std::string &file_name,
+                            const std::vector<std::string> &file_outs,
+                            const std::vector<double> &tol_linears,
+                            double tol_angular, bool tol_relative,
+                            bool merge_primitives, bool use_parallel,
+                            ConvertStats *stats, const py::object &progress,
+                            std::shared_ptr<CancelToken> cancel,
+                            bool use_mmap) {
+  if (file_outs.empty() || file_outs.size() != tol_linears.size()) {
+    throw std::invalid_argument(
+        "file_outs and tol_linears must be the same non-zero length");
+  }
+  ConvertParams params(tol_linears[0], tol_angular, tol_relative,
+                       merge_primitives, use_parallel);
+  Handle(Message_ProgressIndicator) indicator =
+      make_progress(progress, cancel);
+  py::gil_scoped_release release;
+  return step_to_glb_lods(InputSource(file_name.c_str(), use_mmap), file_outs,
+                          tol_linears, params, stats, indicator);
+}
+
+/// Convert a file to GLB tiles with the settings of `converter`.
+static int file_to_tiles(const Converter &converter,
+                         const std::string &file_name,
+                         const std::string &directory, int64_t tile_triangles,
+                         ConvertStats *stats, const py::object &progress,
+                         std::shared_ptr<CancelToken> cancel, bool use_mmap) {
+  Handle(Message_ProgressIndicator) indicator =
+      make_progress(progress, cancel);
+  py::gil_scoped_release release;
+  return converter.ToTiles(InputSource(file_name.c_str(), use_mmap),
+                           directory.c_str(), tile_triangles, stats,
+                           indicator);
+}
+
+/// Convert a file to a folder of GLB tiles and a `tileset.json`.
+static int step_to_tiles_py(const std::string &file_name,
+                            const std::string &directory,
+                            int64_t tile_triangles, double tol_linear,
+                            double tol_angular, bool tol_relative,
+                            bool use_parallel, ConvertStats *stats,
+                            const py::object &progress,
+                            std::shared_ptr<CancelToken> cancel,
+                            bool use_mmap, const py::object &read,
+                            const py::object &mesh, const py::object &write) {
+  ConvertParams params = make_params(tol_linear, tol_angular, tol_relative,
+                                     true, use_parallel, read, mesh, write);
+  check_stream_write(params.write, "tiles");
+  if (params.write.draco || params.write.low_memory) {
+    throw std::invalid_argument("draco and low_memory do not apply to tiles");
+  }
+  return file_to_tiles(Converter(params), file_name, directory,
+                       tile_triangles, stats, progress, cancel, use_mmap);
+}
+
+/// Owns converted GLB bytes for Python, exporting them through the
+/// buffer protocol so a memoryview keeps them alive.
+struct GlbBuffer {
+  std::string data;
+};
+
+/// Hand GLB bytes to Python as `bytes`, or with `copy` false as a
+/// read-only memoryview without copying: the string moves to a
+/// `GlbBuffer` the view owns.
+static py::object to_python(std::string &out, bool copy) {
+  if (copy) {
+    return py::bytes(out);
+  }
+  GlbBuffer *owned = new GlbBuffer();
+  owned->data.swap(out);
+  return py::memoryview(
+      py::cast(owned, py::return_value_policy::take_ownership));
+}
+
+/// Convert an in-memory file into in-memory GLB bytes with the
+/// settings of `converter`.
+static py::object bytes_to_glb(const Converter &converter, py::buffer data,
+                               const std::string &file_type,
+                               ConvertStats *stats, const py::object &progress,
+                               std::shared_ptr<CancelToken> cancel, bool copy) {
+  const InputFormat format = check_file_type(file_type);
+
+  // read straight out of the Python buffer
+  py::buffer_info info = data.request();
+  Handle(Message_ProgressIndicator) indicator =
+      make_progress(progress, cancel);
+  std::string out;
+  int status;
+  {
+    // `info` keeps the buffer alive while other threads run
+    py::gil_scoped_release release;
+    status = converter.ToGlb(InputSource((const char *)info.ptr,
+                                         (size_t)(info.size * info.itemsize),
+                                         format),
+                             out, stats, indicator);
+  }
+  if (status == statusCancelled) {
+    throw ConvertCancelled();
+  }
+  if (status != 0) {
+    throw std::runtime_error("failed to convert " + file_type + " data to GLB");
+  }
+  return to_python(out, copy);
+}
+
+/// Convert an in-memory file into in-memory GLB bytes.
+static py::object convert_to_glb(py::buffer data, const std::string &file_type,
+                                 double tol_linear, double tol_angular,
+                                 bool tol_relative, bool merge_primitives,
+                                 bool use_parallel, ConvertStats *stats,
+                                 const py::object &progress,
+                                 std::shared_ptr<CancelToken> cancel,
+                                 const py::object &read,
+                                 const py::object &mesh,
+                                 const py::object &write, bool copy) {
+  ConvertParams params =
+      make_params(tol_linear, tol_angular, tol_relative, merge_primitives,
+                  use_parallel, read, mesh, write);
+  return bytes_to_glb(Converter(params), data, file_type, stats, progress,
+                      cancel, copy);
+}
+
+/// Hand a vector to numpy as a (rows, columns) array without
+/// copying: the vector moves to the heap and a capsule owns it.
+template <typename T>
+static py::array_t<T> to_numpy(std::vector<T> &values, size_t columns) {
+  std::vector<T> *owned = new std::vector<T>();
+  owned->swap(values);
+  py::capsule free(owned,
+                   [](void *p) { delete static_cast<std::vector<T> *>(p); });
+  const size_t rows = owned->size() / columns;
+  return py::array_t<T>({rows, columns},
+                        {columns * sizeof(T), sizeof(T)}, owned->data(),
+                        free);
+}
+
+/// Mesh arrays as Python dicts of numpy arrays, emptying `scene`.
+static py::dict scene_dict(SceneArrays &scene) {
+  py::list meshes;
+  for (size_t i = 0; i < scene.meshes.size(); i++) {
+    MeshArrays &mesh = scene.meshes[i];
+    py::dict item;
+    item["name"] = mesh.name;
+    item["vertices"] = to_numpy(mesh.vertices, 3);
+    item["normals"] = to_numpy(mesh.normals, 3);
+    item["faces"] = to_numpy(mesh.faces, 3);
+    if (mesh.face_colors.empty()) {
+      item["face_colors"] = py::none();
+    } else {
+      item["face_colors"] = to_numpy(mesh.face_colors, 4);
+    }
+    meshes.append(item);
+  }
+
+  py::list instances;
+  for (size_t i = 0; i < scene.instances.size(); i++) {
+    const InstanceArrays &instance = scene.instances[i];
+    py::array_t<double> transform({4, 4});
+    std::copy(instance.transform, instance.transform + 16,
+              transform.mutable_data());
+    py::dict item;
+    item["mesh"] = instance.mesh;
+    item["name"] = instance.name;
+    item["transform"] = transform;
+    if (instance.has_color) {
+      item["color"] = py::make_tuple(instance.color[0], instance.color[1],
+                                     instance.color[2], instance.color[3]);
+    } else {
+      item["color"] = py::none();
+    }
+    instances.append(item);
+  }
+
+  py::dict result;
+  result["meshes"] = meshes;
+  result["instances"] = instances;
+  return result;
+}
+
+/// Mesh an input source into numpy arrays, raising on failure.
+static py::dict source_to_arrays(const Converter &converter,
+                                 const InputSource &source,
+                                 ConvertStats *stats,
+                                 const py::object &progress,
+                                 std::shared_ptr<CancelToken> cancel) {
+  Handle(Message_ProgressIndicator) indicator =
+      make_progress(progress, cancel);
+  SceneArrays scene;
+  int status;
+  {
+    py::gil_scoped_release release;
+    status = converter.ToArrays(source, scene, stats, indicator);
+  }
+  if (status == statusCancelled) {
+    throw ConvertCancelled();
+  }
+  if (status != 0) {
+    throw std::runtime_error(std::string("failed to mesh ") + source.Name());
+  }
+  return scene_dict(scene);
+}
+
+/// Mesh an in-memory file into numpy arrays, raising on failure.
+static py::dict bytes_to_arrays(const Converter &converter, py::buffer data,
+                                const std::string &file_type,
+                                ConvertStats *stats,
+                                const py::object &progress,
+                                std::shared_ptr<CancelToken> cancel) {
+  const InputFormat format = check_file_type(file_type);
+  // `info` keeps the buffer alive while other threads run
+  py::buffer_info info = data.request();
+  return source_to_arrays(
+      converter,
+      InputSource((const char *)info.ptr, (size_t)(info.size * info.itemsize),
+                  format),
+      stats, progress, cancel);
+}
+
+/// Mesh a file into numpy arrays.
+static py::dict step_to_arrays_py(const std::string &file_name,
+                                  double tol_linear, double tol_angular,
+                                  bool tol_relative, bool use_parallel,
+                                  ConvertStats *stats,
+                                  const py::object &progress,
+                                  std::shared_ptr<CancelToken> cancel,
+                                  bool use_mmap, const py::object &read,
+                                  const py::object &mesh) {
+  ConvertParams params =
+      make_params(tol_linear, tol_angular, tol_relative, true, use_parallel,
+                  read, mesh, py::none());
+  return source_to_arrays(Converter(params),
+                          InputSource(file_name.c_str(), use_mmap), stats,
+                          progress, cancel);
+}
+
+/// Mesh an in-memory file into numpy arrays.
+static py::dict convert_to_arrays(py::buffer data,
+                                  const std::string &file_type,
+                                  double tol_linear, double tol_angular,
+                                  bool tol_relative, bool use_parallel,
+                                  ConvertStats *stats,
+                                  const py::object &progress,
+                                  std::shared_ptr<CancelToken> cancel,
+                                  const py::object &read,
+                                  const py::object &mesh) {
+  ConvertParams params =
+      make_params(tol_linear, tol_angular, tol_relative, true, use_parallel,
+                  read, mesh, py::none());
+  return bytes_to_arrays(Converter(params), data, file_type, stats, progress,
+                         cancel);
+}
+
+/// A converter from the Python settings arguments.
+static Converter *make_converter(double tol_linear, double tol_angular,
+                                 bool tol_relative, bool merge_primitives,
+                                 bool use_parallel, const py::object &read,
+                                 const py::object &mesh,
+                                 const py::object &write) {
+  return new Converter(make_params(tol_linear, tol_angular, tol_relative,
+                                   merge_primitives, use_parallel, read, mesh,
+                                   write));
+}
+
+/// A scanned product structure as Python lists of dicts.
+static py::dict scan_dict(const ScanResult &scan) {
+  py::list parts;
+  for (size_t i = 0; i < scan.parts.size(); i++) {
+    const ScanPart &part = scan.parts[i];
+    py::dict item;
+    item["name"] = part.name;
+    item["layers"] = part.layers;
+    if (part.has_box) {
+      item["bounds"] = py::make_tuple(
+          py::make_tuple(part.box_min[0], part.box_min[1], part.box_min[2]),
+          py::make_tuple(part.box_max[0], part.box_max[1], part.box_max[2]));
+    } else {
+      item["bounds"] = py::none();
+    }
+    parts.append(item);
+  }
+
+  py::list nodes;
+  for (size_t i = 0; i < scan.nodes.size(); i++) {
+    const ScanNode &node = scan.nodes[i];
+    py::array_t<double> transform({4, 4});
+    std::copy(node.transform, node.transform + 16, transform.mutable_data());
+    py::dict item;
+    item["name"] = node.name;
+    item["part"] = node.part < 0 ? py::object(py::none()) : py::int_(node.part);
+    item["parent"] =
+        node.parent < 0 ? py::object(py::none()) : py::int_(node.parent);
+    item["layers"] = node.layers;
+    item["transform"] = transform;
+    if (node.has_color) {
+      item["color"] = py::make_tuple(node.color[0], node.color[1],
+                                     node.color[2], node.color[3]);
+    } else {
+      item["color"] = py::none();
+    }
+    nodes.append(item);
+  }
+
+  py::dict result;
+  result["parts"] = parts;
+  result["nodes"] = nodes;
+  return result;
+}
+
+/// Scan the product structure of a file, raising on failure.
+static py::dict scan_step_py(const std::string &file_name, bool use_parallel,
+                             ConvertStats *stats, const py::object &progress,
+                             std::shared_ptr<CancelToken> cancel,
+                             bool use_mmap) {
+  ConvertParams params;
+  params.use_parallel = use_parallel;
+  Handle(Message_ProgressIndicator) indicator =
+      make_progress(progress, cancel);
+  ScanResult scan;
+  int status;
+  {
+    py::gil_scoped_release release;
+    status = scan_input(InputSource(file_name.c_str(), use_mmap), params,
+                        scan, stats, indicator);
+  }
+  if (status == statusCancelled) {
+    throw ConvertCancelled();
+  }
+  if (status != 0) {
+    throw std::runtime_error("failed to scan " + file_name);
+  }
+  return scan_dict(scan);
+}
+
+/// Scan many files on the shared thread pool, None for failures.
+static py::list scan_step_batch(const std::vector<std::string> &inputs,
+                                bool use_parallel, int num_threads) {
+  ConvertParams params;
+  params.use_parallel = use_parallel;
+  std::vector<ScanResult> scans;
+  std::vector<int> status;
+  {
+    py::gil_scoped_release release;
+    status = scan_batch(inputs, scans, params, num_threads);
+  }
+  py::list results;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (status[i] == 0) {
+      results.append(scan_dict(scans[i]));
+    } else {
+      results.append(py::none());
+    }
+  }
+  return results;
+}
+
+/// A conversion waiting on the job queue for an asyncio future.
+/// Every Python object here is only touched with the GIL held.
+struct AsyncCall {
+  /// Runs on a queue thread without the GIL and returns a status.
+  std::function<int()> work;
+  /// Turns the status into the result with the GIL held, or throws.
+  std::function<py::object(int)> finish;
+  py::object loop;
+  py::object future;
+  /// Arguments which must outlive the conversion.
+  py::object keep;
+};
+
+/// Run `call` on the job queue and return its future, which is
+/// resolved on the event loop thread. Cancelling the future cancels
+/// the conversion through `cancel`.
+static py::object submit_async(AsyncCall *call,
+                               std::shared_ptr<CancelToken> cancel) {
+  call->loop = py::module_::import("asyncio").attr("get_running_loop")();
+  call->future = call->loop.attr("create_future")();
+  call->future.attr("add_done_callback")(
+      py::cpp_function([cancel](const py::object &future) {
+        if (future.attr("cancelled")().cast<bool>()) {
+          cancel->Cancel();
+        }
+      }));
+  py::object future = call->future;
+
+  JobQueue::Instance().Submit([call]() {
+    int status = 1;
+    std::string error;
+    try {
+      status = call->work();
+    } catch (const Standard_Failure &e) {
+      error = e.GetMessageString();
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+    if (!Py_IsInitialized()) {
+      // the interpreter is gone and so is anyone waiting
+      return;
+    }
+
+    py::gil_scoped_acquire gil;
+    py::object result = py::none();
+    py::object exception;
+    try {
+      if (!error.empty()) {
+        throw std::runtime_error(error);
+      }
+      result = call->finish(status);
+    } catch (py::error_already_set &e) {
+      exception = e.value();
+    } catch (const ConvertCancelled &e) {
+      exception = py::module_::import("cascadio").attr("CancelledError")(
+          e.what());
+    } catch (const std::exception &e) {
+      exception = py::reinterpret_borrow<py::object>(PyExc_RuntimeError)(
+          e.what());
+    }
+    py::object future = call->future;
+    try {
+      call->loop.attr("call_soon_threadsafe")(
+          py::cpp_function([future, result, exception]() {
+            if (future.attr("done")().cast<bool>()) {
+              return;
+            }
+            if (exception) {
+              future.attr("set_exception")(exception);
+            } else {
+              future.attr("set_result")(result);
+            }
+          }));
+    } catch (py::error_already_set &e) {
+      // the loop was closed before the conversion finished
+      e.discard_as_unraisable("cascadio async conversion");
+    }
+    delete call;
+  });
+  return future;
+}
+
+/// A converter from a Python argument, or one with default settings.
+static py::object async_converter(const py::object &converter) {
+  if (converter.is_none()) {
+    return py::module_::import("cascadio").attr("Converter")();
+  }
+  return converter;
+}
+
+/// Convert in-memory data to GLB bytes on the job queue.
+static py::object convert_async(py::buffer data, const std::string &file_type,
+                                py::object converter, py::object stats,
+                                const py::object &progress,
+                                std::shared_ptr<CancelToken> cancel,
+                                bool copy) {
+  const InputFormat format = check_file_type(file_type);
+  if (!cancel) {
+    cancel = std::make_shared<CancelToken>();
+  }
+  converter = async_converter(converter);
+  const Converter *settings = converter.cast<const Converter *>();
+  ConvertStats *target = stats.is_none() ? NULL : stats.cast<ConvertStats *>();
+  Handle(Message_ProgressIndicator) indicator =
+      make_progress(progress, cancel);
+  // released with the GIL held when `call` is deleted
+  std::shared_ptr<py::buffer_info> info(new py::buffer_info(data.request()));
+  std::shared_ptr<std::string> out(new std::string());
+
+  AsyncCall *call = new AsyncCall();
+  call->work = [settings, info, format, out, target, indicator]() {
+    return settings->ToGlb(InputSource((const char *)info->ptr,
+                                       (size_t)(info->size * info->itemsize),
+                                       format),
+                           *out, target, indicator);
+  };
+  call->finish = [out, file_type, copy](int status) -> py::object {
+    if (status == statusCancelled) {
+      throw ConvertCancelled();
+    }
+    if (status != 0) {
+      throw std::runtime_error("failed to convert " + file_type +
+                               " data to GLB");
+    }
+    return to_python(*out, copy);
+  };
+  call->keep = py::make_tuple(data, converter, stats);
+  return submit_async(call, cancel);
+}
+
+/// Convert a file to a GLB file on the job queue.
+static py::object step_to_glb_async(const std::string &file_name,
+                                    const std::string &file_out,
+                                    py::object converter, py::object stats,
+                                    const py::object &progress,
+                                    std::shared_ptr<CancelToken> cancel,
+                                    bool use_mmap) {
+  if (!cancel) {
+    cancel = std::make_shared<CancelToken>();
+  }
+  converter = async_converter(converter);
+  const Converter *settings = converter.cast<const Converter *>();
+  ConvertStats *target = stats.is_none() ? NULL : stats.cast<ConvertStats *>();
+  Handle(Message_ProgressIndicator) indicator =
+      make_progress(progress, cancel);
+
+  AsyncCall *call = new AsyncCall();
+  call->work = [settings, file_name, file_out, use_mmap, target,
+                indicator]() {
+    return settings->ToGlb(InputSource(file_name.c_str(), use_mmap),
+                           file_out.c_str(), target, indicator);
+  };
+  call->finish = [](int status) -> py::object {
+    if (status == statusCancelled) {
+      throw ConvertCancelled();
+    }
+    return py::int_(status);
+  };
+  call->keep = py::make_tuple(converter, stats);
+  return submit_async(call, cancel);
+}
+
+/// Stage statistics as a Python dict.
+static py::dict stage_dict(const StageStats &stage) {
+  py::dict result;
+  result["wall"] = stage.wall;
+  result["cpu"] = stage.cpu;
+  result["peak_rss"] = stage.peak_rss;
+  result["heap"] = stage.heap;
+  result["allocations"] = stage.allocations;
+  result["frees"] = stage.frees;
+  return result;
+}
+
+/// Conversion statistics as a Python dict for metrics pipelines.
+static py::dict stats_dict(const ConvertStats &stats) {
+  py::dict result;
+  result["read"] = stage_dict(stats.read);
+  result["transfer"] = stage_dict(stats.transfer);
+  result["mesh"] = stage_dict(stats.mesh);
+  result["write"] = stage_dict(stats.write);
+  result["release"] = stage_dict(stats.release);
+  result["entities"] = stats.entities;
+  result["shapes"] = stats.shapes;
+  result["faces"] = stats.faces;
+  result["triangles"] = stats.triangles;
+  result["output_bytes"] = stats.output_bytes;
+  result["tol_linear"] = stats.tol_linear;
+  result["duplicates"] = stats.duplicates;
+  result["reused"] = stats.reused;
+  result["timeouts"] = stats.timeouts;
+  return result;
+}
+
+/// Convert many files to GLB files on the shared thread pool.
+static std::vector<int>
+step_to_glb_batch(const std::vector<std::string> &inputs,
+                  const std::vector<std::string> &outputs, double tol_linear,
+                  double tol_angular, bool tol_relative,
+                  bool merge_primitives, bool use_parallel, int num_threads) {
+  if (inputs.size() != outputs.size()) {
+    throw std::invalid_argument("inputs and outputs must be the same length");
+  }
+  ConvertParams params(tol_linear, tol_angular, tol_relative,
+                       merge_primitives, use_parallel);
+  py::gil_scoped_release release;
+  return step_to_glb_batch(inputs, outputs, params, num_threads);
+}
+
 PYBIND11_MODULE(cascadio, m) {
   m.doc() = R"pbdoc(
         cascadio
@@ -15,15 +766,293 @@ PYBIND11_MODULE(cascadio, m) {
         A module for converting BREP files into GLB.
     )pbdoc";
 
+  py::class_<StageStats>(m, "StageStats",
+			 "Cost of one stage of a conversion.")
+      .def_readonly("wall", &StageStats::wall, "Elapsed seconds.")
+      .def_readonly("cpu", &StageStats::cpu,
+		    "Process CPU seconds, including worker threads.")
+      .def_readonly("peak_rss", &StageStats::peak_rss,
+		    "Peak resident set size in bytes at the end of the stage.")
+      .def_readonly("heap", &StageStats::heap,
+		    "Heap bytes in use at the end of the stage, 0 if unknown.")
+      .def_readonly("allocations", &StageStats::allocations,
+		    "Heap allocations of the process during the stage, "
+		    "-1 unless the allocator is jemalloc.")
+      .def_readonly("frees", &StageStats::frees,
+		    "Heap frees of the process during the stage, "
+		    "-1 unless the allocator is jemalloc.")
+      .def("to_dict", &stage_dict);
+
+  py::class_<ConvertStats>(m, "ConvertStats",
+R"pbdoc(
+Measurements of a conversion, filled in when passed
+as the `stats` argument of a conversion function.
+
+The `read`, `transfer`, `mesh`, `write` and `release` stages
+each have `wall` and `cpu` seconds plus `peak_rss` and `heap`
+bytes.
+)pbdoc")
+      .def(py::init<>())
+      .def_readonly("read", &ConvertStats::read, "Parsing the input file.")
+      .def_readonly("transfer", &ConvertStats::transfer,
+		    "Transferring entities to the XCAF document.")
+      .def_readonly("mesh", &ConvertStats::mesh, "Triangulating faces.")
+      .def_readonly("write", &ConvertStats::write, "Writing the GLB.")
+      .def_readonly("release", &ConvertStats::release,
+		    "Closing and freeing the document.")
+      .def_readonly("entities", &ConvertStats::entities,
+		    "Entities in the parsed STEP or IGES model.")
+      .def_readonly("shapes", &ConvertStats::shapes,
+		    "Distinct part definitions.")
+      .def_readonly("faces", &ConvertStats::faces,
+		    "Distinct faces after instancing.")
+      .def_readonly("triangles", &ConvertStats::triangles,
+		    "Triangles over the distinct faces.")
+      .def_readonly("output_bytes", &ConvertStats::output_bytes,
+		    "Size of the written GLB in bytes.")
+      .def_readonly("tol_linear", &ConvertStats::tol_linear,
+		    "Linear deflection the faces were meshed with.")
+      .def_readonly("duplicates", &ConvertStats::duplicates,
+		    "Parts shared with an identical part moved elsewhere.")
+      .def_readonly("reused", &ConvertStats::reused,
+		    "Parts reused from the manifest instead of meshed.")
+      .def_readonly("timeouts", &ConvertStats::timeouts,
+		    "Faces over `face_timeout`, meshed from their boundary.")
+      .def("to_dict", &stats_dict, "All measurements as a nested dict.")
+      .def("__repr__", [](const ConvertStats &stats) {
+	return "ConvertStats(" + py::repr(stats_dict(stats)).cast<std::string>() +
+	       ")";
+      });
+
+  py::register_exception<ConvertCancelled>(m, "CancelledError");
+
+  py::class_<CancelToken, std::shared_ptr<CancelToken>>(m, "CancelToken",
+R"pbdoc(
+Pass as `cancel` to a conversion and call `cancel()`
+from any thread to stop it at the next check.
+)pbdoc")
+      .def(py::init<>())
+      .def("cancel", &CancelToken::Cancel, "Ask the conversion to stop.")
+      .def_property_readonly("cancelled", &CancelToken::IsCancelled);
+
+  py::enum_<RWGltf_WriterTrsfFormat>(m, "TransformFormat",
+				     "How glTF node transforms are written.")
+      .value("COMPACT", RWGltf_WriterTrsfFormat_Compact,
+	     "A matrix or TRS, whichever is shorter.")
+      .value("MAT4", RWGltf_WriterTrsfFormat_Mat4, "A 4x4 matrix.")
+      .value("TRS", RWGltf_WriterTrsfFormat_TRS,
+	     "Separate rotation, translation and scale.");
+
+  py::enum_<RWMesh_NameFormat>(m, "NameFormat",
+			       "What glTF node and mesh names are made of.")
+      .value("EMPTY", RWMesh_NameFormat_Empty)
+      .value("PRODUCT", RWMesh_NameFormat_Product)
+      .value("INSTANCE", RWMesh_NameFormat_Instance)
+      .value("INSTANCE_OR_PRODUCT", RWMesh_NameFormat_InstanceOrProduct)
+      .value("PRODUCT_OR_INSTANCE", RWMesh_NameFormat_ProductOrInstance)
+      .value("PRODUCT_AND_INSTANCE", RWMesh_NameFormat_ProductAndInstance)
+      .value("PRODUCT_AND_INSTANCE_AND_OCAF",
+	     RWMesh_NameFormat_ProductAndInstanceAndOcaf);
+
+  py::class_<GlbBuffer>(m, "_GlbBuffer", py::buffer_protocol())
+      .def_buffer([](GlbBuffer &buffer) {
+	return py::buffer_info((void *)buffer.data.data(), 1, "B", 1,
+			       {(py::ssize_t)buffer.data.size()}, {1}, true);
+      });
+
+  py::class_<ReadOptions>(m, "ReadOptions",
+R"pbdoc(
+What STEP and IGES transfer besides the geometry, all on by
+default, which parts are converted and how the model is freed.
+Geometry-only pipelines transfer faster without names, colours
+and layers. Pass as `read` to any conversion, creating it as
+`ReadOptions(colors=False, ...)` or setting its fields.
+
+`products` converts only the products or instances with these
+names and everything below them. A name containing "/" is a path
+of names from a top-level shape, such as "Plant/Unit 2/Pump".
+`bbox` converts only the parts whose bounds meet a box given as
+`((xmin, ymin, zmin), (xmax, ymax, zmax))` in document units.
+The rest is dropped after transfer, before any meshing.
+
+`release_async` frees each parsed model and document on a
+background thread so results return without waiting for it.
+The `release` stage of `ConvertStats` measures what that saves,
+and conversions wait once too many models are queued, see
+`set_release_limit`.
+)pbdoc")
+      .def(py::init(&options_from_kwargs<ReadOptions>))
+      .def_readwrite("names", &ReadOptions::names,
+		     "Product and instance names, kept when selecting `products`.")
+      .def_readwrite("colors", &ReadOptions::colors, "Surface colours.")
+      .def_readwrite("layers", &ReadOptions::layers, "Layer assignments.")
+      .def_readwrite("metadata", &ReadOptions::metadata,
+		     "STEP validation properties, GD&T, saved views and "
+		     "materials, off by default as no output uses them.")
+      .def_property("products",
+		    [](const ReadOptions &options) {
+		      return options.filter.products;
+		    },
+		    [](ReadOptions &options,
+		       const std::vector<std::string> &products) {
+		      options.filter.products = products;
+		    },
+		    "Names or paths of the products to convert, all if empty.")
+      .def_property("bbox",
+		    [](const ReadOptions &options) {
+		      return get_box(options.filter);
+		    },
+		    [](ReadOptions &options, const py::object &bbox) {
+		      set_box(options.filter, bbox);
+		    },
+		    "Bounds the converted parts must meet, or None.")
+      .def_readwrite("release_async", &ReadOptions::release_async,
+		     "Free the model on a background thread.");
+
+  py::class_<MeshOptions>(m, "MeshOptions",
+R"pbdoc(
+How the deflection is chosen, what is done with the triangles,
+and the BRepMesh settings beyond the deflections with the BRepMesh
+defaults. Pass as `mesh` to any conversion, creating it as
+`MeshOptions(tol_auto=True, ...)` or setting its fields; the same
+object may be reused for any number of them. Every BRepMesh
+setting but `face_timeout` is part of the tessellation cache
+and manifest keys.
+
+`tol_auto` ignores `tol_linear` and derives it from the bounding
+box of the document, so the result looks the same at any unit
+scale. With it `target_triangles` chooses the deflection expected
+to give about that many distinct triangles instead of a fixed
+fraction of the model size. `max_triangles` coarsens the
+deflection as needed to keep the distinct triangles below it.
+
+`optimize` welds the duplicated seam vertices of every face and
+reorders triangles and vertices for GPU vertex cache and fetch
+locality, in parallel over faces. Seams keep their two sets of
+texture coordinates unless the output leaves them out.
+
+`dedupe` finds parts which are copies of each other moved to
+another place, as in exports without assembly instancing, and
+meshes and writes each only once as instances of one part.
+
+With `face_timeout` in seconds, a face which takes longer to
+mesh is meshed again from the nodes of its boundary only, so
+one degenerate face cannot hold up a conversion.
+`ConvertStats.timeouts` counts those faces, and a conversion
+with any keeps its triangulations out of the cache and the
+manifest.
+)pbdoc")
+      .def(py::init(&options_from_kwargs<MeshOptions>))
+      .def_readwrite("tol_auto", &MeshOptions::tol_auto,
+		     "Derive `tol_linear` from the size of the document.")
+      .def_readwrite("target_triangles", &MeshOptions::target_triangles,
+		     "With `tol_auto`, about how many triangles to aim for, "
+		     "0 for a fixed fraction of the size.")
+      .def_readwrite("max_triangles", &MeshOptions::max_triangles,
+		     "Most distinct triangles to allow, 0 for no limit.")
+      .def_readwrite("optimize", &MeshOptions::optimize,
+		     "Weld seams and reorder for the GPU vertex cache.")
+      .def_readwrite("dedupe", &MeshOptions::dedupe,
+		     "Share parts which are moved copies of each other.")
+      .def_readwrite("angle_interior", &MeshOptions::angle_interior,
+		     "Angular deflection inside faces, negative for `tol_angular`.")
+      .def_readwrite("deflection_interior", &MeshOptions::deflection_interior,
+		     "Linear deflection inside faces, negative for `tol_linear`.")
+      .def_readwrite("min_size", &MeshOptions::min_size,
+		     "Smallest element size, negative to derive it from `tol_linear`.")
+      .def_readwrite("internal_vertices", &MeshOptions::internal_vertices,
+		     "Insert nodes inside faces, not only on their boundary.")
+      .def_readwrite("control_surface_deflection",
+		     &MeshOptions::control_surface_deflection,
+		     "Refine until within the deflection of the surface.")
+      .def_readwrite("control_all_surfaces", &MeshOptions::control_all_surfaces,
+		     "Also check the deflection of planes and analytic surfaces.")
+      .def_readwrite("clean_model", &MeshOptions::clean_model,
+		     "Clear BRepMesh's temporary data model once meshing ends.")
+      .def_readwrite("adjust_min_size", &MeshOptions::adjust_min_size,
+		     "Shrink `min_size` for faces smaller than it.")
+      .def_readwrite("force_face_deflection",
+		     &MeshOptions::force_face_deflection,
+		     "Ignore the tolerance of each face.")
+      .def_readwrite("allow_quality_decrease",
+		     &MeshOptions::allow_quality_decrease,
+		     "Let a coarser mesh replace a finer one already on a face.")
+      .def_readwrite("face_timeout", &MeshOptions::face_timeout,
+		     "Seconds per face before meshing its boundary only, 0 for none.");
+
+  py::class_<WriteOptions>(m, "WriteOptions",
+R"pbdoc(
+Compression, memory use and glTF writer settings, defaulting
+to what conversions always wrote. Pass as `write` to the GLB
+conversions, creating it as `WriteOptions(draco=True, ...)` or
+setting its fields.
+
+`draco` compresses meshes with `KHR_draco_mesh_compression`,
+encoding them in parallel with `use_parallel`. Positions and
+normals are quantized, so expect errors up to the quantization
+step. `draco_level` must be between 0 and 10 and each of the
+quantization bits between 1 and 30, or conversions raise
+`ValueError`.
+
+`low_memory` meshes, writes and frees one part at a time,
+streaming buffers to disk, so peak memory follows the largest
+part instead of the whole model. Parts are merged per colour,
+the mesh cache and `max_triangles` retries are not used, and it
+has no effect with `draco`. The low-memory and tiled writers
+only use `normals`, `uvs` and `names`, and raise `ValueError`
+for the other writer settings. Tiles raise it for `draco` and
+`low_memory` too.
+
+Turning off `normals` writes with cascadio's own writer, as
+RWGltf_CafWriter always writes them, and so ignores the other
+settings. Turning off `names` keeps every other setting. Draco
+always keeps normals.
+)pbdoc")
+      .def(py::init(&options_from_kwargs<WriteOptions>))
+      .def_readwrite("draco", &WriteOptions::draco,
+		     "Compress meshes with Draco.")
+      .def_readwrite("draco_level", &WriteOptions::draco_level,
+		     "Draco speed against size, 0 fastest and 10 smallest.")
+      .def_readwrite("quantize_position_bits",
+		     &WriteOptions::quantize_position_bits,
+		     "Bits per Draco position component.")
+      .def_readwrite("quantize_normal_bits",
+		     &WriteOptions::quantize_normal_bits,
+		     "Bits per Draco normal component.")
+      .def_readwrite("quantize_texcoord_bits",
+		     &WriteOptions::quantize_texcoord_bits,
+		     "Bits per Draco texture coordinate component.")
+      .def_readwrite("low_memory", &WriteOptions::low_memory,
+		     "Mesh, write and free one part at a time to a GLB file.")
+      .def_readwrite("transform_format", &WriteOptions::transform_format,
+		     "A `TransformFormat`, `MAT4` by default.")
+      .def_readwrite("node_name_format", &WriteOptions::node_name_format,
+		     "A `NameFormat` for node names.")
+      .def_readwrite("mesh_name_format", &WriteOptions::mesh_name_format,
+		     "A `NameFormat` for mesh names.")
+      .def_readwrite("split_indices16", &WriteOptions::split_indices16,
+		     "Write 16-bit indices where they fit.")
+      .def_readwrite("embed_textures", &WriteOptions::embed_textures,
+		     "Embed textures in the binary buffer.")
+      .def_readwrite("binary", &WriteOptions::binary,
+		     "Write GLB, or glTF JSON and a `.bin` beside a file.")
+      .def_readwrite("normals", &WriteOptions::normals,
+		     "Write vertex normals.")
+      .def_readwrite("uvs", &WriteOptions::uvs,
+		     "Write texture coordinates.")
+      .def_readwrite("names", &WriteOptions::names,
+		     "Write node and mesh names.");
+
   m.def("step_to_glb",
-	&step_to_glb,
+	&step_to_glb_py,
 R"pbdoc(
-Convert a step file to a GLB file.
+Convert a STEP, IGES or BREP file to a GLB file.
 
 Parameters
 ----------
 file_name
-  The input STEP file to load.
+  The input STEP, IGES or BREP file to load, with
+  the format taken from the extension.
 file_out
   The path to save the GLB file.
 tol_linear
@@ -36,7 +1065,42 @@ merge_primitives
   Produce a GLB with one mesh primitive per part.
 use_parallel
   Use parallel execution to produce meshes and exports.
+stats
+  A `ConvertStats` to fill with per-stage measurements.
+progress
+  Called as `progress(fraction, stage)` with the overall
+  fraction done between 0.0 and 1.0 and the name of the
+  current stage. Raising an exception cancels the conversion.
+cancel
+  A `CancelToken` which stops the conversion when cancelled.
+use_mmap
+  Memory-map the file and parse it straight from the page
+  cache, releasing pages once parsed, so very large files
+  never need a second copy in memory.
+manifest
+  Path of a part manifest kept next to `file_out` for
+  incremental conversion of later revisions of the same file.
+  Parts whose geometry and mesh settings match an entry of the
+  manifest reuse its triangulation instead of being meshed, and
+  the manifest is then rewritten with the parts of this file.
+  Created if missing. Not used with `low_memory`.
+read
+  A `ReadOptions` choosing what to transfer and which parts
+  to convert.
+mesh
+  A `MeshOptions` choosing the deflection, sharing and welding,
+  and further BRepMesh settings.
+write
+  A `WriteOptions` with Draco, `low_memory` and further glTF
+  writer settings.
 
+Returns
+-------
+status
+  0 on success, 1 on failure and 2 if cancelled.
+
+The GIL is released during conversion so calls
+from multiple Python threads run concurrently.
 )pbdoc",
 	py::arg("file_name"),
 	py::arg("file_out"),
@@ -44,12 +1108,748 @@ use_parallel
 	py::arg("tol_angular") = 0.5,
 	py::arg("tol_relative") = false,
 	py::arg("merge_primitives") = true,
-	py::arg("use_parallel") = true
+	py::arg("use_parallel") = true,
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("use_mmap") = false,
+	py::arg("manifest") = "",
+	py::arg("read") = py::none(),
+	py::arg("mesh") = py::none(),
+	py::arg("write") = py::none()
+	);
+
+  m.def("step_to_glb_lods",
+	&step_to_glb_lods,
+R"pbdoc(
+Convert a STEP, IGES or BREP file to one GLB file per level of detail.
+
+The file is read and transferred once, meshed at the coarsest
+tolerance and refined from coarse to fine, writing each level
+before the next replaces its triangles. This is much cheaper
+than calling `step_to_glb` once per tolerance.
+
+Parameters
+----------
+file_name
+  The input STEP, IGES or BREP file to load, with
+  the format taken from the extension.
+file_outs
+  The path to save the GLB file of each level.
+tol_linears
+  The linear deflection of each level, in any order.
+tol_angular
+  How large should angular deflection be allowed.
+tol_relative
+  Is tol_linear relative to edge length, or an absolute distance?
+merge_primitives
+  Produce a GLB with one mesh primitive per part.
+use_parallel
+  Use parallel execution to produce meshes and exports.
+stats
+  A `ConvertStats` to fill with per-stage measurements. Mesh
+  counts are for the finest level and `output_bytes` is the
+  total over all levels.
+progress
+  Called as `progress(fraction, stage)` with the overall
+  fraction done between 0.0 and 1.0 and the name of the
+  current stage. Raising an exception cancels the conversion.
+cancel
+  A `CancelToken` which stops the conversion when cancelled.
+use_mmap
+  Memory-map the file and parse it straight from the page
+  cache, releasing pages once parsed.
+
+Returns
+-------
+status
+  0 on success, 1 on failure and 2 if cancelled.
+)pbdoc",
+	py::arg("file_name"),
+	py::arg("file_outs"),
+	py::arg("tol_linears"),
+	py::arg("tol_angular") = 0.5,
+	py::arg("tol_relative") = false,
+	py::arg("merge_primitives") = true,
+	py::arg("use_parallel") = true,
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("use_mmap") = false
+	);
+
+  m.def("step_to_tiles",
+	&step_to_tiles_py,
+R"pbdoc(
+Convert a STEP, IGES or BREP file to a folder of GLB tiles.
+
+The placed parts are split into tiles of nearby parts with a
+bounding volume hierarchy, and every tile is written as its own
+GLB in parallel. A 3D Tiles `tileset.json` indexes the tiles
+with their bounds, so a client can load only what is in view.
+
+Parameters
+----------
+file_name
+  The input STEP, IGES or BREP file to load, with
+  the format taken from the extension.
+directory
+  The folder to write `tileset.json` and the tiles to,
+  created if missing.
+tile_triangles
+  Keep splitting until a tile has at most this many
+  triangles. A single instance is never split.
+tol_linear
+  How large should linear deflection be allowed.
+tol_angular
+  How large should angular deflection be allowed.
+tol_relative
+  Is tol_linear relative to edge length, or an absolute distance?
+use_parallel
+  Use parallel execution to produce meshes and tiles.
+stats
+  A `ConvertStats` to fill with per-stage measurements.
+  `output_bytes` is the total over every file written.
+progress
+  Called as `progress(fraction, stage)` with the overall
+  fraction done between 0.0 and 1.0 and the name of the
+  current stage. Raising an exception cancels the conversion.
+cancel
+  A `CancelToken` which stops the conversion when cancelled.
+use_mmap
+  Memory-map the file and parse it straight from the page
+  cache, releasing pages once parsed.
+read
+  A `ReadOptions` choosing what to transfer and which parts
+  to convert.
+mesh
+  A `MeshOptions` choosing the deflection, sharing and welding,
+  and further BRepMesh settings.
+write
+  A `WriteOptions`, of which only `normals`, `uvs` and
+  `names` apply to tiles, and any other setting raises
+  `ValueError`.
+
+Returns
+-------
+status
+  0 on success, 1 on failure and 2 if cancelled.
+)pbdoc",
+	py::arg("file_name"),
+	py::arg("directory"),
+	py::arg("tile_triangles") = 500000,
+	py::arg("tol_linear") = 0.01,
+	py::arg("tol_angular") = 0.5,
+	py::arg("tol_relative") = false,
+	py::arg("use_parallel") = true,
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("use_mmap") = false,
+	py::arg("read") = py::none(),
+	py::arg("mesh") = py::none(),
+	py::arg("write") = py::none()
+	);
+
+  m.def("convert_to_glb",
+	&convert_to_glb,
+R"pbdoc(
+Convert an in-memory file to in-memory GLB bytes
+without touching the file system.
+
+Parameters
+----------
+data
+  The contents of the input file, any object
+  supporting the buffer protocol such as `bytes`
+  or an `mmap.mmap`, which is read without a copy.
+file_type
+  The format of `data`: "step" or "stp", "iges" or "igs",
+  or "brep" or "brp" for text or binary OpenCASCADE BRep.
+tol_linear
+  How large should linear deflection be allowed.
+tol_angular
+  How large should angular deflection be allowed.
+tol_relative
+  Is tol_linear relative to edge length, or an absolute distance?
+merge_primitives
+  Produce a GLB with one mesh primitive per part.
+use_parallel
+  Use parallel execution to produce meshes and exports.
+stats
+  A `ConvertStats` to fill with per-stage measurements.
+progress
+  Called as `progress(fraction, stage)` with the overall
+  fraction done between 0.0 and 1.0 and the name of the
+  current stage. Raising an exception cancels the conversion.
+cancel
+  A `CancelToken` which stops the conversion when cancelled.
+read
+  A `ReadOptions` choosing what to transfer and which parts
+  to convert.
+mesh
+  A `MeshOptions` choosing the deflection, sharing and welding,
+  and further BRepMesh settings.
+write
+  A `WriteOptions` with Draco, `low_memory` and further glTF
+  writer settings.
+copy
+  Return `bytes`. If False return a read-only `memoryview`
+  owning the converted data instead, which saves copying
+  a large GLB once more.
+
+Returns
+-------
+glb
+  The converted binary glTF as `bytes`, or a
+  `memoryview` if `copy` is False.
+
+Raises
+------
+CancelledError
+  If the conversion was cancelled.
+
+The GIL is released during conversion so calls
+from multiple Python threads run concurrently.
+)pbdoc",
+	py::arg("data"),
+	py::arg("file_type"),
+	py::arg("tol_linear") = 0.01,
+	py::arg("tol_angular") = 0.5,
+	py::arg("tol_relative") = false,
+	py::arg("merge_primitives") = true,
+	py::arg("use_parallel") = true,
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("read") = py::none(),
+	py::arg("mesh") = py::none(),
+	py::arg("write") = py::none(),
+	py::arg("copy") = true
 	);
 
+  m.def("step_to_arrays",
+	&step_to_arrays_py,
+R"pbdoc(
+Mesh a STEP, IGES or BREP file straight into numpy arrays, skipping
+GLB serialization and parsing it back.
+
+Each part definition is meshed once and every placement
+of it is listed as an instance. Coordinates are in the
+document units of the file with the original Z axis up,
+unlike a GLB which is in meters with Y up.
+
+Parameters
+----------
+file_name
+  The input STEP, IGES or BREP file to load, with
+  the format taken from the extension.
+tol_linear
+  How large should linear deflection be allowed.
+tol_angular
+  How large should angular deflection be allowed.
+tol_relative
+  Is tol_linear relative to edge length, or an absolute distance?
+use_parallel
+  Use parallel execution to produce meshes.
+stats
+  A `ConvertStats` to fill with per-stage measurements.
+progress
+  Called as `progress(fraction, stage)` with the overall
+  fraction done between 0.0 and 1.0 and the name of the
+  current stage. Raising an exception cancels the conversion.
+cancel
+  A `CancelToken` which stops the conversion when cancelled.
+use_mmap
+  Memory-map the file and parse it straight from the page
+  cache, releasing pages once parsed.
+read
+  A `ReadOptions` choosing what to transfer and which parts
+  to convert.
+mesh
+  A `MeshOptions` choosing the deflection, sharing and welding,
+  and further BRepMesh settings.
+
+Returns
+-------
+scene
+  A dict with `meshes`, a list of dicts with `name`,
+  `vertices` (n, 3) float32, `normals` (n, 3) float32,
+  `faces` (m, 3) uint32 and `face_colors` (m, 4) uint8
+  or None, and `instances`, a list of dicts with `mesh`
+  indexing `meshes`, `name`, a (4, 4) float64 `transform`
+  and a linear RGBA `color` tuple or None.
+
+Raises
+------
+CancelledError
+  If the conversion was cancelled.
+)pbdoc",
+	py::arg("file_name"),
+	py::arg("tol_linear") = 0.01,
+	py::arg("tol_angular") = 0.5,
+	py::arg("tol_relative") = false,
+	py::arg("use_parallel") = true,
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("use_mmap") = false,
+	py::arg("read") = py::none(),
+	py::arg("mesh") = py::none()
+	);
+
+  m.def("convert_to_arrays",
+	&convert_to_arrays,
+R"pbdoc(
+Mesh an in-memory file straight into numpy arrays.
+
+Parameters
+----------
+data
+  The contents of the input file, any object
+  supporting the buffer protocol such as `bytes`.
+file_type
+  The format of `data`: "step" or "stp", "iges" or "igs",
+  or "brep" or "brp" for text or binary OpenCASCADE BRep.
+tol_linear
+  How large should linear deflection be allowed.
+tol_angular
+  How large should angular deflection be allowed.
+tol_relative
+  Is tol_linear relative to edge length, or an absolute distance?
+use_parallel
+  Use parallel execution to produce meshes.
+stats
+  A `ConvertStats` to fill with per-stage measurements.
+progress
+  Called as `progress(fraction, stage)` with the overall
+  fraction done between 0.0 and 1.0 and the name of the
+  current stage. Raising an exception cancels the conversion.
+cancel
+  A `CancelToken` which stops the conversion when cancelled.
+read
+  A `ReadOptions` choosing what to transfer and which parts
+  to convert.
+mesh
+  A `MeshOptions` choosing the deflection, sharing and welding,
+  and further BRepMesh settings.
+
+Returns
+-------
+scene
+  The same dict as `step_to_arrays`.
+
+Raises
+------
+CancelledError
+  If the conversion was cancelled.
+)pbdoc",
+	py::arg("data"),
+	py::arg("file_type"),
+	py::arg("tol_linear") = 0.01,
+	py::arg("tol_angular") = 0.5,
+	py::arg("tol_relative") = false,
+	py::arg("use_parallel") = true,
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("read") = py::none(),
+	py::arg("mesh") = py::none()
+	);
+
+  py::class_<Converter>(m, "Converter",
+R"pbdoc(
+Converts any number of files with the same settings, for
+long-lived workers. The settings are checked and OpenCASCADE
+and its thread pool are set up once, and every document is
+closed as its conversion ends so memory use stays bounded.
+
+The settings are those of `step_to_glb`, with the `read`,
+`mesh` and `write` options copied when the converter is made.
+A converter may be used from several threads at once.
+`ReadOptions.release_async` is most useful here, and
+`WriteOptions.low_memory` only applies when writing a GLB file.
+)pbdoc")
+      .def(py::init(&make_converter),
+	   py::arg("tol_linear") = 0.01,
+	   py::arg("tol_angular") = 0.5,
+	   py::arg("tol_relative") = false,
+	   py::arg("merge_primitives") = true,
+	   py::arg("use_parallel") = true,
+	   py::arg("read") = py::none(),
+	   py::arg("mesh") = py::none(),
+	   py::arg("write") = py::none())
+      .def("step_to_glb", &file_to_glb,
+	   "Convert a file to a GLB file, as `cascadio.step_to_glb`.",
+	   py::arg("file_name"),
+	   py::arg("file_out"),
+	   py::arg("stats") = py::none(),
+	   py::arg("progress") = py::none(),
+	   py::arg("cancel") = py::none(),
+	   py::arg("use_mmap") = false,
+	   py::arg("manifest") = "")
+      .def("step_to_tiles", &file_to_tiles,
+	   "Convert a file to GLB tiles, as `cascadio.step_to_tiles`.",
+	   py::arg("file_name"),
+	   py::arg("directory"),
+	   py::arg("tile_triangles") = 500000,
+	   py::arg("stats") = py::none(),
+	   py::arg("progress") = py::none(),
+	   py::arg("cancel") = py::none(),
+	   py::arg("use_mmap") = false)
+      .def("convert_to_glb", &bytes_to_glb,
+	   "Convert in-memory data to GLB bytes, as "
+	   "`cascadio.convert_to_glb`.",
+	   py::arg("data"),
+	   py::arg("file_type"),
+	   py::arg("stats") = py::none(),
+	   py::arg("progress") = py::none(),
+	   py::arg("cancel") = py::none(),
+	   py::arg("copy") = true)
+      .def("step_to_arrays",
+	   [](const Converter &converter, const std::string &file_name,
+	      ConvertStats *stats, const py::object &progress,
+	      std::shared_ptr<CancelToken> cancel, bool use_mmap) {
+	     return source_to_arrays(converter,
+				     InputSource(file_name.c_str(), use_mmap),
+				     stats, progress, cancel);
+	   },
+	   "Mesh a file into numpy arrays, as `cascadio.step_to_arrays`.",
+	   py::arg("file_name"),
+	   py::arg("stats") = py::none(),
+	   py::arg("progress") = py::none(),
+	   py::arg("cancel") = py::none(),
+	   py::arg("use_mmap") = false)
+      .def("convert_to_arrays", &bytes_to_arrays,
+	   "Mesh in-memory data into numpy arrays, as "
+	   "`cascadio.convert_to_arrays`.",
+	   py::arg("data"),
+	   py::arg("file_type"),
+	   py::arg("stats") = py::none(),
+	   py::arg("progress") = py::none(),
+	   py::arg("cancel") = py::none());
+
+  m.def("step_to_glb_batch",
+	&step_to_glb_batch,
+R"pbdoc(
+Convert many STEP, IGES or BREP files to GLB files concurrently.
+
+Files are converted on one shared thread pool with the
+largest files started first so cores stay busy. A failed
+file never stops the rest of the batch.
+
+Parameters
+----------
+inputs
+  The input STEP, IGES or BREP files to load.
+outputs
+  The path to save each GLB file, same length as `inputs`.
+tol_linear
+  How large should linear deflection be allowed.
+tol_angular
+  How large should angular deflection be allowed.
+tol_relative
+  Is tol_linear relative to edge length, or an absolute distance?
+merge_primitives
+  Produce a GLB with one mesh primitive per part.
+use_parallel
+  Convert files in parallel, otherwise one after another.
+num_threads
+  Maximum number of files converted at once, all cores if -1.
+
+Returns
+-------
+status
+  The `step_to_glb` result for every input, 0 on success.
+)pbdoc",
+	py::arg("inputs"),
+	py::arg("outputs"),
+	py::arg("tol_linear") = 0.01,
+	py::arg("tol_angular") = 0.5,
+	py::arg("tol_relative") = false,
+	py::arg("merge_primitives") = true,
+	py::arg("use_parallel") = true,
+	py::arg("num_threads") = -1
+	);
+
+  m.def("scan_step",
+	&scan_step_py,
+R"pbdoc(
+Read the assembly tree of a STEP, IGES or BREP file with
+names, colours, layers and part bounds, without meshing.
+
+Parameters
+----------
+file_name
+  The input STEP, IGES or BREP file to load, with
+  the format taken from the extension.
+use_parallel
+  Bound the parts of an IGES or BREP file in parallel.
+stats
+  A `ConvertStats` to fill with per-stage measurements,
+  with the walk of the tree recorded as `transfer`.
+progress
+  Called as `progress(fraction, stage)`, as for `step_to_glb`.
+cancel
+  A `CancelToken` which stops the scan when cancelled.
+use_mmap
+  Memory-map the file and parse it straight from the page
+  cache, releasing pages once parsed.
+
+Returns
+-------
+scan
+  A dict with a list of `parts`, each with a `name`, its
+  `layers` and `bounds` as `((xmin, ymin, zmin), (xmax,
+  ymax, zmax))` in the part's own coordinates or None, and
+  a list of `nodes` of the tree, each with a `name`, the
+  index of its `part` or None for an assembly, the index of
+  its `parent` or None, its `layers`, a (4, 4) `transform`
+  to world coordinates and a linear RGBA `color` or None.
+  Parents always come before their children.
+
+Raises
+------
+CancelledError
+  If the scan was cancelled.
+)pbdoc",
+	py::arg("file_name"),
+	py::arg("use_parallel") = true,
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("use_mmap") = false
+	);
+
+  m.def("scan_step_batch",
+	&scan_step_batch,
+R"pbdoc(
+Scan many files concurrently on the shared thread pool,
+largest first, as `scan_step` does for one.
+
+Parameters
+----------
+inputs
+  The input STEP, IGES or BREP files to load.
+use_parallel
+  Scan files in parallel, otherwise one after another.
+num_threads
+  Maximum number of files scanned at once, all cores if -1.
+
+Returns
+-------
+scans
+  The `scan_step` result for every input, None if it failed.
+)pbdoc",
+	py::arg("inputs"),
+	py::arg("use_parallel") = true,
+	py::arg("num_threads") = -1
+	);
+
+  m.def("convert_async",
+	&convert_async,
+R"pbdoc(
+Convert in-memory data to GLB bytes without blocking the
+running asyncio event loop, returning an awaitable future.
+
+The conversion runs on a native worker thread which never
+holds the GIL, and at most `set_async_limit` conversions
+run at once while the rest wait in order. Cancelling the
+future, or the task awaiting it, cancels the conversion.
+
+Parameters
+----------
+data
+  The contents of the input file, any object
+  supporting the buffer protocol such as `bytes`.
+file_type
+  The format of `data`, as for `convert_to_glb`.
+converter
+  A `Converter` with the settings to use, or None
+  for the defaults.
+stats
+  A `ConvertStats` to fill with per-stage measurements.
+progress
+  Called as `progress(fraction, stage)` from the worker
+  thread. Raising an exception cancels the conversion.
+cancel
+  A `CancelToken` which stops the conversion when cancelled.
+copy
+  Resolve to `bytes`, or if False to a read-only `memoryview`
+  as for `convert_to_glb`.
+
+Returns
+-------
+future
+  An `asyncio.Future` resolving to the GLB bytes,
+  or raising
+  `CancelledError` or `RuntimeError`.
+)pbdoc",
+	py::arg("data"),
+	py::arg("file_type"),
+	py::arg("converter") = py::none(),
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("copy") = true
+	);
+
+  m.def("step_to_glb_async",
+	&step_to_glb_async,
+R"pbdoc(
+Convert a file to a GLB file without blocking the running
+asyncio event loop, as `convert_async` does for data.
+
+Parameters
+----------
+file_name
+  The input STEP, IGES or BREP file to load.
+file_out
+  The path to save the GLB file.
+converter
+  A `Converter` with the settings to use, or None
+  for the defaults.
+stats
+  A `ConvertStats` to fill with per-stage measurements.
+progress
+  Called as `progress(fraction, stage)` from the worker thread.
+cancel
+  A `CancelToken` which stops the conversion when cancelled.
+use_mmap
+  Memory-map the file and parse it straight from the page cache.
+
+Returns
+-------
+future
+  An `asyncio.Future` resolving to the `step_to_glb` status.
+)pbdoc",
+	py::arg("file_name"),
+	py::arg("file_out"),
+	py::arg("converter") = py::none(),
+	py::arg("stats") = py::none(),
+	py::arg("progress") = py::none(),
+	py::arg("cancel") = py::none(),
+	py::arg("use_mmap") = false
+	);
+
+  m.def("set_async_limit",
+	[](int limit) { JobQueue::Instance().SetLimit(limit); },
+	"Set how many asynchronous conversions may run at once, "
+	"by default one per core.",
+	py::arg("limit"));
+
+  m.def("async_limit",
+	[]() { return JobQueue::Instance().Limit(); },
+	"How many asynchronous conversions may run at once.");
+
+  m.def("set_release_limit",
+	[](int limit) { ReleaseQueue::Instance().SetLimit(limit); },
+	"Set how many models freed with `release_async` may wait at once "
+	"before conversions wait for them, by default 4.",
+	py::arg("limit"));
+
+  m.def("release_limit",
+	[]() { return ReleaseQueue::Instance().Limit(); },
+	"How many models freed with `release_async` may wait at once.");
+
+  m.def("wait_released",
+	[]() { ReleaseQueue::Instance().Wait(); },
+	"Block until every model queued by `release_async` has been freed.",
+	py::call_guard<py::gil_scoped_release>());
+
+  // the queue thread is detached, so let it finish before exit
+  py::module_::import("atexit").attr("register")(py::cpp_function([]() {
+    py::gil_scoped_release release;
+    ReleaseQueue::Instance().Wait();
+  }));
+
+  m.def("enable_cache",
+	&set_tessellation_cache,
+R"pbdoc(
+Cache triangulations on disk so repeated conversions of
+unchanged geometry with the same tolerances skip meshing.
+
+Each part definition is keyed by a hash of its B-rep geometry
+and the meshing tolerances. When the directory grows past
+`max_bytes` the least recently used entries are removed.
+
+Parameters
+----------
+directory
+  Where to keep cached triangulations, created if missing.
+  The directory may be shared between processes.
+max_bytes
+  Maximum total size of the cache in bytes.
+)pbdoc",
+	py::arg("directory"),
+	py::arg("max_bytes") = (int64_t)1 << 30
+	);
+
+  m.def("disable_cache",
+	[]() { set_tessellation_cache(std::string(), 0); },
+	"Stop using the tessellation cache, leaving its files on disk.");
+
+  m.def("cache_info",
+	[]() {
+	  py::dict info;
+	  std::shared_ptr<TessellationCache> cache = tessellation_cache();
+	  if (!cache) {
+	    return info;
+	  }
+	  info["directory"] = cache->Directory();
+	  info["max_bytes"] = cache->MaxBytes();
+	  info["bytes"] = cache->Bytes();
+	  info["entries"] = cache->Entries();
+	  info["hits"] = cache->Hits();
+	  info["misses"] = cache->Misses();
+	  return info;
+	},
+R"pbdoc(
+Statistics of the tessellation cache, empty if disabled.
+
+Returns
+-------
+info
+  `directory`, `max_bytes`, `bytes`, `entries`, and the
+  `hits` and `misses` counted since it was enabled.
+)pbdoc");
+
+  m.def("start_trace",
+	[]() { TraceRecorder::Instance().Start(); },
+R"pbdoc(
+Record a timed span for every stage of every conversion from now
+on, on every thread, until `stop_trace`. Spans include reading,
+transfer, meshing of each face, and writing of each part or tile.
+)pbdoc");
+
+  m.def("stop_trace",
+	[](const std::string &file_name) {
+	  const int64_t spans = TraceRecorder::Instance().Stop(file_name);
+	  if (spans < 0) {
+	    throw std::runtime_error("failed to write trace to " + file_name);
+	  }
+	  return spans;
+	},
+R"pbdoc(
+Stop recording spans and write them as a Chrome trace event JSON
+file, which chrome://tracing and https://ui.perfetto.dev open.
+
+Parameters
+----------
+file_name
+  Path of the JSON file to write.
+
+Returns
+-------
+spans
+  How many spans were written.
+)pbdoc",
+	py::arg("file_name"));
+
 #ifdef VERSION_INFO
   m.attr("__version__") = MACRO_STRINGIFY(VERSION_INFO);
 #else
   m.attr("__version__") = "dev";
 #endif
+  m.attr("__occt_version__") = OCC_VERSION_COMPLETE;
 }
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <TopoDS_Shape.hxx>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "cache.hpp"
+
+static const char manifestMagic[8] = {'C', 'A', 'S', 'C',
+                                      'M', 'A', 'N', '1'};
+
+/// Triangulations of every part of one conversion keyed by
+/// `geometry_hash`, saved next to its output so the conversion of the
+/// next revision of the same file only meshes the parts which changed.
+/// Unlike `TessellationCache` it belongs to one output and holds
+/// exactly the parts of its last conversion.
+class PartManifest {
+public:
+  /// Read a manifest written by `Save`. A missing or unreadable file
+  /// leaves the manifest empty, so every part is meshed.
+  bool Load(const std::string &path) {
+    myEntries.clear();
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char magic[sizeof(manifestMagic)];
+    if (!in.read(magic, sizeof(magic)) ||
+        !std::equal(magic, magic + sizeof(magic), manifestMagic)) {
+      return false;
+    }
+    int32_t count = 0;
+    if (!read_pod(in, count) || count < 0) {
+      return false;
+    }
+    std::map<std::string, std::string> entries;
+    for (int32_t i = 0; i < count; i++) {
+      std::string key, data;
+      if (!readString(in, key) || !readString(in, data)) {
+        return false;
+      }
+      entries[key].swap(data);
+    }
+    myEntries.swap(entries);
+    return true;
+  }
+
+  /// Attach the triangulations stored for `key` to `shape` if present.
+  bool Apply(const std::string &key, const TopoDS_Shape &shape) const {
+    std::map<std::string, std::string>::const_iterator found =
+        myEntries.find(key);
+    if (found == myEntries.end()) {
+      return false;
+    }
+    std::istringstream in(found->second);
+    return read_triangulations(shape, in);
+  }
+
+  /// Store the triangulations of `shape` under `key`.
+  void Add(const std::string &key, const TopoDS_Shape &shape) {
+    std::ostringstream data;
+    write_triangulations(shape, data);
+    myEntries[key] = data.str();
+  }
+
+  /// The deflection stored for `key` by `SetTolerance`, if present.
+  bool Tolerance(const std::string &key, double &tolerance) const {
+    std::map<std::string, std::string>::const_iterator found =
+        myEntries.find(key);
+    if (found == myEntries.end() || found->second.size() != sizeof(double)) {
+      return false;
+    }
+    std::istringstream in(found->second);
+    return read_pod(in, tolerance);
+  }
+
+  /// Store the deflection a triangle budget resolved to under `key`.
+  void SetTolerance(const std::string &key, double tolerance) {
+    std::ostringstream data;
+    write_pod(data, tolerance);
+    myEntries[key] = data.str();
+  }
+
+  /// Write to a temporary name and rename into place, so a failed
+  /// write keeps the previous manifest.
+  bool Save(const std::string &path) const {
+    const std::string temp = path + ".tmp";
+    {
+      std::ofstream out(temp.c_str(), std::ios::binary | std::ios::trunc);
+      out.write(manifestMagic, sizeof(manifestMagic));
+      write_pod(out, (int32_t)myEntries.size());
+      for (std::map<std::string, std::string>::const_iterator it =
+               myEntries.begin();
+           it != myEntries.end(); ++it) {
+        writeString(out, it->first);
+        writeString(out, it->second);
+      }
+      if (!out) {
+        std::remove(temp.c_str());
+        return false;
+      }
+    }
+    std::remove(path.c_str());
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+      std::remove(temp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  size_t Size() const { return myEntries.size(); }
+
+private:
+  static void writeString(std::ostream &out, const std::string &value) {
+    write_pod(out, (uint64_t)value.size());
+    out.write(value.data(), (std::streamsize)value.size());
+  }
+
+  static bool readString(std::istream &in, std::string &value) {
+    uint64_t size = 0;
+    if (!read_pod(in, size)) {
+      return false;
+    }
+    // refuse sizes a truncated or foreign file could claim
+    const std::streampos here = in.tellg();
+    in.seekg(0, std::ios::end);
+    const std::streampos end = in.tellg();
+    in.seekg(here);
+    if (here < 0 || end < here || size > (uint64_t)(end - here)) {
+      return false;
+    }
+    value.resize((size_t)size);
+    return size == 0 || (bool)in.read(&value[0], (std::streamsize)size);
+  }
+
+  std::map<std::string, std::string> myEntries;
+};
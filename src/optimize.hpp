@@ -0,0 +1,291 @@
+#pragma once
+
+#include <BRepLib_ToolTriangulatedShape.hxx>
+#include <BRep_Builder.hxx>
+#include <BRep_Tool.hxx>
+#include <OSD_Parallel.hxx>
+#include <Poly_Triangulation.hxx>
+#include <TopoDS.hxx>
+#include <TopoDS_Face.hxx>
+#include <TopoDS_Iterator.hxx>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/// Entries of the post-transform vertex cache the triangle order
+/// is tuned for. 32 is on the small side of current GPUs, which
+/// degrades gracefully on larger caches.
+static const int vertexCacheSize = 32;
+
+/// Tom Forsyth's score of a vertex at `position` in the simulated
+/// cache (-1 when not cached) with `remaining` triangles left to emit.
+static float vertex_score(int position, int remaining) {
+  if (remaining == 0) {
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if (position >= 0 && position < 3) {
+    // the last triangle: deliberately not the best, to avoid strips
+    score = 0.75f;
+  } else if (position >= 3) {
+    const float scale = 1.0f / (vertexCacheSize - 3);
+    score = std::pow(1.0f - (position - 3) * scale, 1.5f);
+  }
+  // favour vertices with few triangles left so they retire early
+  return score + 2.0f / std::sqrt((float)remaining);
+}
+
+/// Reorder zero-based triangle indices for vertex cache locality
+/// with Forsyth's linear-speed greedy algorithm.
+static void optimize_triangle_order(std::vector<int> &indices,
+                                    int nbVertices) {
+  const int nbTriangles = (int)indices.size() / 3;
+  if (nbTriangles < 2) {
+    return;
+  }
+
+  // triangles around every vertex, live ones first
+  std::vector<int> offsets(nbVertices + 1, 0);
+  for (size_t i = 0; i < indices.size(); i++) {
+    offsets[indices[i] + 1]++;
+  }
+  for (int v = 0; v < nbVertices; v++) {
+    offsets[v + 1] += offsets[v];
+  }
+  std::vector<int> remaining(nbVertices, 0);
+  std::vector<int> adjacency(indices.size());
+  for (int t = 0; t < nbTriangles; t++) {
+    for (int k = 0; k < 3; k++) {
+      const int v = indices[t * 3 + k];
+      adjacency[offsets[v] + remaining[v]++] = t;
+    }
+  }
+
+  std::vector<int> position(nbVertices, -1);
+  std::vector<float> score(nbVertices);
+  for (int v = 0; v < nbVertices; v++) {
+    score[v] = vertex_score(-1, remaining[v]);
+  }
+  std::vector<float> triangleScore(nbTriangles);
+  std::vector<char> emitted(nbTriangles, 0);
+  int best = 0;
+  for (int t = 0; t < nbTriangles; t++) {
+    triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] +
+                       score[indices[t * 3 + 2]];
+    if (triangleScore[t] > triangleScore[best]) {
+      best = t;
+    }
+  }
+
+  std::vector<int> order;
+  order.reserve(nbTriangles);
+  std::vector<int> cache;
+  std::vector<int> next;
+  int cursor = 0;
+  while ((int)order.size() < nbTriangles) {
+    if (best < 0) {
+      // nothing in the cache touches a live triangle: start anew
+      while (emitted[cursor]) {
+        cursor++;
+      }
+      best = cursor;
+    }
+    order.push_back(best);
+    emitted[best] = 1;
+
+    next.clear();
+    for (int k = 0; k < 3; k++) {
+      const int v = indices[best * 3 + k];
+      // retire the triangle from the live part of the adjacency
+      int *begin = &adjacency[offsets[v]];
+      int *end = begin + remaining[v];
+      *std::find(begin, end, best) = *(end - 1);
+      remaining[v]--;
+      next.push_back(v);
+    }
+    for (size_t i = 0; i < cache.size(); i++) {
+      if (std::find(next.begin(), next.begin() + 3, cache[i]) ==
+          next.begin() + 3) {
+        next.push_back(cache[i]);
+      }
+    }
+    cache.swap(next);
+
+    // rescore what moved, including whatever fell out of the cache
+    best = -1;
+    float bestScore = -1.0f;
+    for (size_t i = 0; i < cache.size(); i++) {
+      const int v = cache[i];
+      position[v] = i < (size_t)vertexCacheSize ? (int)i : -1;
+      score[v] = vertex_score(position[v], remaining[v]);
+    }
+    for (size_t i = 0; i < cache.size(); i++) {
+      const int v = cache[i];
+      for (int j = offsets[v]; j < offsets[v] + remaining[v]; j++) {
+        const int t = adjacency[j];
+        triangleScore[t] = score[indices[t * 3]] +
+                           score[indices[t * 3 + 1]] +
+                           score[indices[t * 3 + 2]];
+        if (triangleScore[t] > bestScore) {
+          bestScore = triangleScore[t];
+          best = t;
+        }
+      }
+    }
+    if (cache.size() > (size_t)vertexCacheSize) {
+      cache.resize(vertexCacheSize);
+    }
+  }
+
+  std::vector<int> reordered(indices.size());
+  for (int t = 0; t < nbTriangles; t++) {
+    std::copy(&indices[order[t] * 3], &indices[order[t] * 3] + 3,
+              &reordered[t * 3]);
+  }
+  indices.swap(reordered);
+}
+
+/// Compare node indices by position so coincident ones sort together.
+struct NodeLess {
+  NodeLess(const Handle(Poly_Triangulation) & theTri) : tri(theTri) {}
+
+  bool operator()(int a, int b) const {
+    const gp_Pnt pa = tri->Node(a), pb = tri->Node(b);
+    if (pa.X() != pb.X()) {
+      return pa.X() < pb.X();
+    }
+    if (pa.Y() != pb.Y()) {
+      return pa.Y() < pb.Y();
+    }
+    if (pa.Z() != pb.Z()) {
+      return pa.Z() < pb.Z();
+    }
+    return a < b;
+  }
+
+  const Handle(Poly_Triangulation) & tri;
+};
+
+/// Weld coincident nodes of a face with matching normals, such as the
+/// seam of a cylinder, drop triangles which collapse, reorder triangles
+/// for the vertex cache and nodes in order of first use. With `keepUVs`
+/// nodes must have the same texture coordinates to weld too, which
+/// leaves seams alone, and otherwise the coordinates are dropped.
+static void optimize_face(const TopoDS_Face &face, bool keepUVs) {
+  TopLoc_Location loc;
+  Handle(Poly_Triangulation) tri = BRep_Tool::Triangulation(face, loc);
+  if (tri.IsNull() || tri->NbTriangles() == 0) {
+    return;
+  }
+  if (!tri->HasNormals()) {
+    // the writer would compute them from the surface, which needs the
+    // UV nodes of the seam we are about to weld
+    BRepLib_ToolTriangulatedShape::ComputeNormals(face, tri);
+  }
+
+  // map every node to the first coincident one with the same normal,
+  // and the same texture coordinates if they are kept
+  const bool hasUVs = keepUVs && tri->HasUVNodes();
+  const int nbNodes = tri->NbNodes();
+  std::vector<int> sorted(nbNodes);
+  for (int i = 0; i < nbNodes; i++) {
+    sorted[i] = i + 1;
+  }
+  std::sort(sorted.begin(), sorted.end(), NodeLess(tri));
+  std::vector<int> weld(nbNodes + 1);
+  for (int i = 0; i < nbNodes;) {
+    int j = i;
+    const gp_Pnt p = tri->Node(sorted[i]);
+    while (j < nbNodes && tri->Node(sorted[j]).IsEqual(p, 0.0)) {
+      j++;
+    }
+    for (int a = i; a < j; a++) {
+      weld[sorted[a]] = sorted[a];
+      const gp_Vec3f na = tri->Normal(sorted[a]);
+      for (int b = i; b < a; b++) {
+        if (weld[sorted[b]] == sorted[b] &&
+            na.Dot(tri->Normal(sorted[b])) > 0.9999f &&
+            (!hasUVs ||
+             tri->UVNode(sorted[a]).IsEqual(tri->UVNode(sorted[b]), 0.0))) {
+          weld[sorted[a]] = sorted[b];
+          break;
+        }
+      }
+    }
+    i = j;
+  }
+
+  // renumber welded nodes from zero, dropping collapsed triangles
+  std::vector<int> compact(nbNodes + 1, -1);
+  std::vector<int> source;
+  std::vector<int> indices;
+  indices.reserve(tri->NbTriangles() * 3);
+  for (int t = 1; t <= tri->NbTriangles(); t++) {
+    int n[3];
+    tri->Triangle(t).Get(n[0], n[1], n[2]);
+    for (int k = 0; k < 3; k++) {
+      n[k] = weld[n[k]];
+    }
+    if (n[0] == n[1] || n[1] == n[2] || n[0] == n[2]) {
+      continue;
+    }
+    for (int k = 0; k < 3; k++) {
+      if (compact[n[k]] < 0) {
+        compact[n[k]] = (int)source.size();
+        source.push_back(n[k]);
+      }
+      indices.push_back(compact[n[k]]);
+    }
+  }
+  if (indices.empty()) {
+    return;
+  }
+  optimize_triangle_order(indices, (int)source.size());
+
+  // nodes in the order the reordered triangles first use them
+  std::vector<int> fetch(source.size(), -1);
+  std::vector<int> nodes;
+  nodes.reserve(source.size());
+  for (size_t i = 0; i < indices.size(); i++) {
+    int &index = fetch[indices[i]];
+    if (index < 0) {
+      index = (int)nodes.size();
+      nodes.push_back(source[indices[i]]);
+    }
+    indices[i] = index;
+  }
+
+  Handle(Poly_Triangulation) result =
+      new Poly_Triangulation((int)nodes.size(), (int)indices.size() / 3,
+                             hasUVs, Standard_True);
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const int n = (int)i + 1;
+    result->SetNode(n, tri->Node(nodes[i]));
+    result->SetNormal(n, tri->Normal(nodes[i]));
+    if (hasUVs) {
+      result->SetUVNode(n, tri->UVNode(nodes[i]));
+    }
+  }
+  for (size_t t = 0; t < indices.size() / 3; t++) {
+    result->SetTriangle((int)t + 1,
+                        Poly_Triangle(indices[t * 3] + 1,
+                                      indices[t * 3 + 1] + 1,
+                                      indices[t * 3 + 2] + 1));
+  }
+  result->Deflection(tri->Deflection());
+  BRep_Builder().UpdateFace(face, result);
+}
+
+/// Optimize the triangulation of every face of `faces`, a compound
+/// of distinct faces, one face per task of the thread pool.
+static void optimize_faces(const TopoDS_Shape &faces,
+                           Standard_Boolean use_parallel, bool keepUVs) {
+  std::vector<TopoDS_Face> list;
+  for (TopoDS_Iterator it(faces); it.More(); it.Next()) {
+    list.push_back(TopoDS::Face(it.Value()));
+  }
+  OSD_Parallel::For(
+      0, (int)list.size(),
+      [&list, keepUVs](int i) { optimize_face(list[i], keepUVs); },
+      !use_parallel);
+}
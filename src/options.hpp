@@ -0,0 +1,184 @@
+#pragma once
+
+#include <IMeshTools_Parameters.hxx>
+#include <RWGltf_WriterTrsfFormat.hxx>
+#include <RWMesh_NameFormat.hxx>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// Which parts of a document to convert. Empty converts everything.
+struct ConvertFilter {
+  ConvertFilter() : has_box(false) {
+    for (int i = 0; i < 3; i++) {
+      box_min[i] = box_max[i] = 0.0;
+    }
+  }
+
+  bool IsEmpty() const { return products.empty() && !has_box; }
+
+  /// Product or instance names to keep with everything below them.
+  /// An entry containing "/" is a path of names from a top-level
+  /// shape instead, such as "Plant/Unit 2/Pump".
+  std::vector<std::string> products;
+  /// Keep only parts whose bounds meet this box, in document units.
+  bool has_box;
+  double box_min[3];
+  double box_max[3];
+};
+
+/// What the STEP and IGES readers transfer besides the geometry,
+/// which parts are kept and how the model is freed.
+struct ReadOptions {
+  ReadOptions()
+      : names(true), colors(true), layers(true), metadata(false),
+        release_async(false) {}
+
+  /// Product and instance names, which selecting `products` needs.
+  bool names;
+  bool colors;
+  bool layers;
+  /// STEP validation properties, GD&T, saved views and materials.
+  /// No output reads them, so they are only worth their transfer
+  /// time when comparing against a full transfer.
+  bool metadata;
+  /// Parts to convert, applied before sharing and meshing.
+  ConvertFilter filter;
+  /// Free the parsed model and the document on a background thread
+  /// instead of before returning.
+  bool release_async;
+};
+
+/// How to choose the deflection and what to do with the triangles
+/// besides meshing, and the BRepMesh settings beyond the deflections
+/// and parallelism, which default to those of IMeshTools_Parameters.
+struct MeshOptions {
+  MeshOptions()
+      : tol_auto(false), target_triangles(0), max_triangles(0),
+        optimize(false), dedupe(false), angle_interior(-1.0),
+        deflection_interior(-1.0), min_size(-1.0), internal_vertices(true),
+        control_surface_deflection(true), control_all_surfaces(false),
+        clean_model(true), adjust_min_size(false),
+        force_face_deflection(false), allow_quality_decrease(false),
+        face_timeout(0.0) {}
+
+  /// Derive `tol_linear` from the size of the document.
+  bool tol_auto;
+  /// With `tol_auto`, pick the deflection expected to produce
+  /// about this many distinct triangles, 0 to use a fixed fraction
+  /// of the document size instead.
+  int64_t target_triangles;
+  /// Coarsen the deflection so the distinct triangles stay below
+  /// this many, 0 for no limit.
+  int64_t max_triangles;
+  /// Weld face seams and reorder for the GPU vertex cache.
+  bool optimize;
+  /// Share parts which are rigidly moved copies of each other.
+  bool dedupe;
+
+  /// Angular and linear deflection inside faces, negative to use
+  /// those of the edges.
+  double angle_interior;
+  double deflection_interior;
+  /// Smallest size of a mesh element, negative to derive it from
+  /// the linear deflection.
+  double min_size;
+  /// Insert nodes inside faces rather than only on their boundary.
+  bool internal_vertices;
+  /// Refine until the triangles are within the deflection of the
+  /// surface, not only of the edges.
+  bool control_surface_deflection;
+  /// Apply that check to planes and other analytic surfaces too.
+  bool control_all_surfaces;
+  /// Clear BRepMesh's temporary data model of the shape once
+  /// meshing ends, freeing it sooner.
+  bool clean_model;
+  /// Shrink `min_size` for faces smaller than it.
+  bool adjust_min_size;
+  /// Use the linear deflection as is on every face instead of
+  /// adapting it to the tolerance of the face.
+  bool force_face_deflection;
+  /// Let a coarser remesh replace a finer triangulation already on
+  /// a face, which is otherwise kept.
+  bool allow_quality_decrease;
+  /// Seconds a single face may take before it is meshed from its
+  /// boundary nodes only, 0 for no limit. Not part of `Key`, as faces
+  /// within the limit come out the same.
+  double face_timeout;
+
+  /// Apply these options on top of `params`.
+  void Apply(IMeshTools_Parameters &params) const {
+    params.AngleInterior = angle_interior;
+    params.DeflectionInterior = deflection_interior;
+    params.MinSize = min_size;
+    params.InternalVerticesMode = internal_vertices;
+    params.ControlSurfaceDeflection = control_surface_deflection;
+    params.EnableControlSurfaceDeflectionAllSurfaces = control_all_surfaces;
+    params.CleanModel = clean_model;
+    params.AdjustMinSize = adjust_min_size;
+    params.ForceFaceDeflection = force_face_deflection;
+    params.AllowQualityDecrease = allow_quality_decrease;
+  }
+
+  /// Every BRepMesh option as a string, for keys of cached
+  /// triangulations. The deflection choice is keyed separately.
+  std::string Key() const {
+    std::ostringstream key;
+    key.precision(17);
+    key << "angle_interior=" << angle_interior
+        << ";deflection_interior=" << deflection_interior
+        << ";min_size=" << min_size << ";flags=" << internal_vertices
+        << control_surface_deflection << control_all_surfaces << clean_model
+        << adjust_min_size << force_face_deflection << allow_quality_decrease;
+    return key.str();
+  }
+};
+
+/// Compression, memory use and RWGltf_CafWriter settings, which
+/// default to what every conversion used before they could be changed.
+struct WriteOptions {
+  WriteOptions()
+      : draco(false), draco_level(7), quantize_position_bits(14),
+        quantize_normal_bits(10), quantize_texcoord_bits(12),
+        low_memory(false), transform_format(RWGltf_WriterTrsfFormat_Mat4),
+        node_name_format(RWMesh_NameFormat_InstanceOrProduct),
+        mesh_name_format(RWMesh_NameFormat_Product), split_indices16(false),
+        embed_textures(true), binary(true), normals(true), uvs(true),
+        names(true) {}
+
+  /// Compress meshes with KHR_draco_mesh_compression.
+  bool draco;
+  /// Draco speed against size trade-off, 0 fastest to 10 smallest.
+  int draco_level;
+  /// Quantization bits of the Draco encoded attributes.
+  int quantize_position_bits;
+  int quantize_normal_bits;
+  int quantize_texcoord_bits;
+  /// Mesh, write and free one part definition at a time when writing
+  /// a GLB file, so peak memory follows the largest part rather than
+  /// the whole model.
+  bool low_memory;
+
+  /// How node transforms are written.
+  RWGltf_WriterTrsfFormat transform_format;
+  /// What node and mesh names are made of.
+  RWMesh_NameFormat node_name_format;
+  RWMesh_NameFormat mesh_name_format;
+  /// Write 16-bit indices for primitives with few enough nodes.
+  bool split_indices16;
+  /// Put textures in the binary buffer rather than beside the file.
+  bool embed_textures;
+  /// Write GLB rather than glTF JSON with a separate `.bin`, for
+  /// output to a file.
+  bool binary;
+  /// Vertex normals, texture coordinates and node and mesh names,
+  /// which geometry-only consumers can do without.
+  bool normals;
+  bool uvs;
+  bool names;
+
+  /// Whether RWGltf_CafWriter cannot write what is asked for, as it
+  /// always writes normals. Names it leaves out with an empty format.
+  bool IsStripped() const { return !normals; }
+};
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <Message_ProgressIndicator.hxx>
+#include <Message_ProgressRange.hxx>
+#include <Message_ProgressScope.hxx>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/// Status returned by conversions which were cancelled.
+static const int statusCancelled = 2;
+
+/// Flag shared with a running conversion to ask it to stop.
+/// Checking it is a relaxed atomic load, so it costs nothing
+/// and never needs the GIL.
+class CancelToken {
+public:
+  CancelToken() : myCancelled(false) {}
+
+  void Cancel() { myCancelled.store(true, std::memory_order_relaxed); }
+  bool IsCancelled() const {
+    return myCancelled.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<bool> myCancelled;
+};
+
+/// Progress indicator bridging OCCT progress scopes to a callback
+/// and a cancel token. OCCT serializes calls to `Show`, and reports
+/// are throttled to steps of at least one percent.
+class ConvertProgress : public Message_ProgressIndicator {
+  DEFINE_STANDARD_RTTI_INLINE(ConvertProgress, Message_ProgressIndicator)
+public:
+  /// Receives the overall position in [0, 1] and the innermost scope name.
+  typedef std::function<void(double, const std::string &)> Callback;
+
+  ConvertProgress(const Callback &callback,
+                  const std::shared_ptr<CancelToken> &token)
+      : myCallback(callback), myToken(token), myLast(-1.0) {}
+
+  virtual Standard_Boolean UserBreak() override {
+    return myToken && myToken->IsCancelled();
+  }
+
+  virtual void Show(const Message_ProgressScope &theScope,
+                    const Standard_Boolean isForce) override {
+    if (!myCallback) {
+      return;
+    }
+    const double position = GetPosition();
+    if (!isForce && position - myLast < 0.01) {
+      return;
+    }
+    myLast = position;
+    myCallback(position, theScope.Name() != NULL ? theScope.Name() : "");
+  }
+
+  virtual void Reset() override {
+    Message_ProgressIndicator::Reset();
+    myLast = -1.0;
+  }
+
+private:
+  Callback myCallback;
+  std::shared_ptr<CancelToken> myToken;
+  double myLast;
+};
+
+/// The root progress range of a conversion, inactive without indicator.
+static Message_ProgressRange
+start_progress(const Handle(Message_ProgressIndicator) & progress) {
+  return progress.IsNull() ? Message_ProgressRange() : progress->Start();
+}
+
+/// Stream buffer which copies from another buffer through a fixed
+/// window, advancing a progress scope as bytes are consumed and
+/// ending the stream early once the progress is cancelled. Seeks go
+/// to the source unless they land in the window, so readers which
+/// `tellg` and `seekg`, such as binary BREP, work through it.
+class ProgressStreamBuf : public std::streambuf {
+public:
+  ProgressStreamBuf(std::streambuf *source, int64_t size,
+                    const Message_ProgressRange &range, const char *name)
+      : mySource(source), mySize(std::max<int64_t>(size, 1)), myPosition(0),
+        myDone(0), myScope(range, name, 100), myBuffer(1 << 16) {}
+
+protected:
+  virtual int_type underflow() override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+    if (!myScope.More()) {
+      return traits_type::eof();
+    }
+    std::streamsize n = mySource->sgetn(&myBuffer[0], myBuffer.size());
+    if (n <= 0) {
+      return traits_type::eof();
+    }
+    setg(&myBuffer[0], &myBuffer[0], &myBuffer[0] + n);
+    advance(n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which) override {
+    if (!(which & std::ios_base::in)) {
+      return pos_type(off_type(-1));
+    }
+    if (dir == std::ios_base::end) {
+      return reset(mySource->pubseekoff(off, dir, std::ios_base::in));
+    }
+    // the source is ahead of the reader by what is still buffered
+    const int64_t here = myPosition - (egptr() - gptr());
+    const int64_t target = (dir == std::ios_base::beg ? 0 : here) + off;
+    if (target <= myPosition && target >= myPosition - (egptr() - eback())) {
+      // inside the window, which is every `tellg`
+      setg(eback(), egptr() - (myPosition - target), egptr());
+      return pos_type(off_type(target));
+    }
+    return reset(mySource->pubseekpos(pos_type(off_type(target)),
+                                      std::ios_base::in));
+  }
+
+  virtual pos_type seekpos(pos_type pos,
+                           std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+private:
+  /// Empty the window after the source moved to `pos`. Progress only
+  /// counts forward, so seeking back does not repeat it.
+  pos_type reset(pos_type pos) {
+    if (pos == pos_type(off_type(-1))) {
+      return pos;
+    }
+    setg(&myBuffer[0], &myBuffer[0], &myBuffer[0]);
+    myPosition = (int64_t)off_type(pos);
+    return pos;
+  }
+
+  void advance(std::streamsize n) {
+    myPosition += n;
+    const int percent = (int)std::min<int64_t>(100, myPosition * 100 / mySize);
+    if (percent > myDone) {
+      myScope.Next(percent - myDone);
+      myDone = percent;
+    }
+  }
+
+  std::streambuf *mySource;
+  int64_t mySize;
+  int64_t myPosition;
+  int myDone;
+  Message_ProgressScope myScope;
+  std::vector<char> myBuffer;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Standard_Transient.hxx>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/// Owns a heap object which is not reference counted, so it can be
+/// queued with `ReleaseQueue` like a handle.
+template <typename T> class ReleasedObject : public Standard_Transient {
+public:
+  explicit ReleasedObject(std::unique_ptr<T> &theObject)
+      : myObject(std::move(theObject)) {}
+
+private:
+  std::unique_ptr<T> myObject;
+};
+
+/// Drops the last reference to large object graphs, such as a closed
+/// document or a parsed STEP model, on a background thread. Freeing
+/// hundreds of thousands of small objects otherwise adds a long tail
+/// to the conversion which built them.
+///
+/// The queue takes the caller's reference rather than a copy of it,
+/// so it holds the last one. At most `Limit` objects wait at once:
+/// past that `Add` blocks, so producing models faster than they can
+/// be freed slows the producers down instead of growing memory.
+class ReleaseQueue {
+public:
+  /// The queue used by every conversion. It is never destroyed, so
+  /// nothing is freed during static destruction at exit.
+  static ReleaseQueue &Instance() {
+    static ReleaseQueue *queue = new ReleaseQueue();
+    return *queue;
+  }
+
+  /// Take the reference of `object`, which is null afterwards, and
+  /// drop it in the background, waiting first while the queue is full.
+  template <typename T> void Add(opencascade::handle<T> &object) {
+    if (object.IsNull()) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(myMutex);
+    myRoom.wait(lock, [this]() { return pending() < myLimit; });
+    // nulled under the lock, before the thread can pop it
+    myObjects.push_back(object);
+    object.Nullify();
+    if (!myStarted) {
+      std::thread(&ReleaseQueue::run, this).detach();
+      myStarted = true;
+    }
+    myWake.notify_one();
+  }
+
+  /// Take ownership of `object`, which is empty afterwards, and
+  /// delete it in the background.
+  template <typename T> void Add(std::unique_ptr<T> &object) {
+    if (!object) {
+      return;
+    }
+    Handle(Standard_Transient) owner = new ReleasedObject<T>(object);
+    Add(owner);
+  }
+
+  /// Block until everything queued so far has been freed.
+  void Wait() {
+    std::unique_lock<std::mutex> lock(myMutex);
+    myIdle.wait(lock, [this]() { return pending() == 0; });
+  }
+
+  /// How many objects may wait to be freed before `Add` blocks.
+  void SetLimit(int limit) {
+    std::lock_guard<std::mutex> lock(myMutex);
+    myLimit = limit < 1 ? 1 : (size_t)limit;
+    myRoom.notify_all();
+  }
+
+  int Limit() {
+    std::lock_guard<std::mutex> lock(myMutex);
+    return (int)myLimit;
+  }
+
+private:
+  ReleaseQueue() : myStarted(false), myBusy(false), myLimit(4) {}
+
+  /// Objects queued or being freed, with the mutex held.
+  size_t pending() const { return myObjects.size() + (myBusy ? 1 : 0); }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(myMutex);
+    for (;;) {
+      myWake.wait(lock, [this]() { return !myObjects.empty(); });
+      Handle(Standard_Transient) object = myObjects.front();
+      myObjects.pop_front();
+      myBusy = true;
+      lock.unlock();
+      // the reference counts are atomic, so the last one may be
+      // dropped from any thread
+      object.Nullify();
+      lock.lock();
+      myBusy = false;
+      myRoom.notify_all();
+      myIdle.notify_all();
+    }
+  }
+
+  std::mutex myMutex;
+  std::condition_variable myWake;
+  std::condition_variable myRoom;
+  std::condition_variable myIdle;
+  std::deque<Handle(Standard_Transient)> myObjects;
+  bool myStarted;
+  bool myBusy;
+  size_t myLimit;
+};
@@ -0,0 +1,731 @@
+#pragma once
+
+#include <BRepBndLib.hxx>
+#include <Bnd_Box.hxx>
+#include <Interface_EntityIterator.hxx>
+#include <Interface_Graph.hxx>
+#include <Interface_InterfaceModel.hxx>
+#include <OSD_Parallel.hxx>
+#include <Precision.hxx>
+#include <Quantity_Color.hxx>
+#include <STEPConstruct_Assembly.hxx>
+#include <STEPConstruct_Styles.hxx>
+#include <STEPConstruct_UnitContext.hxx>
+#include <StepBasic_Product.hxx>
+#include <StepBasic_ProductDefinition.hxx>
+#include <StepBasic_ProductDefinitionFormation.hxx>
+#include <StepGeom_Axis2Placement.hxx>
+#include <StepGeom_Axis2Placement3d.hxx>
+#include <StepGeom_CartesianPoint.hxx>
+#include <StepGeom_Circle.hxx>
+#include <StepGeom_Conic.hxx>
+#include <StepGeom_Direction.hxx>
+#include <StepGeom_ElementarySurface.hxx>
+#include <StepGeom_Ellipse.hxx>
+#include <StepGeom_GeomRepContextAndGlobUnitAssCtxAndGlobUncertaintyAssCtx.hxx>
+#include <StepGeom_Line.hxx>
+#include <StepGeom_Pcurve.hxx>
+#include <StepGeom_Placement.hxx>
+#include <StepGeom_SphericalSurface.hxx>
+#include <StepGeom_ToroidalSurface.hxx>
+#include <StepGeom_Vector.hxx>
+#include <StepRepr_CharacterizedDefinition.hxx>
+#include <StepRepr_GlobalUnitAssignedContext.hxx>
+#include <StepRepr_ItemDefinedTransformation.hxx>
+#include <StepRepr_NextAssemblyUsageOccurrence.hxx>
+#include <StepRepr_ProductDefinitionShape.hxx>
+#include <StepRepr_Representation.hxx>
+#include <StepRepr_RepresentationContext.hxx>
+#include <StepRepr_RepresentationItem.hxx>
+#include <StepRepr_RepresentationRelationshipWithTransformation.hxx>
+#include <StepRepr_RepresentedDefinition.hxx>
+#include <StepRepr_ShapeRepresentationRelationship.hxx>
+#include <StepRepr_Transformation.hxx>
+#include <StepShape_ContextDependentShapeRepresentation.hxx>
+#include <StepShape_ShapeDefinitionRepresentation.hxx>
+#include <StepVisual_Colour.hxx>
+#include <StepVisual_FillAreaStyle.hxx>
+#include <StepVisual_FillAreaStyleColour.hxx>
+#include <StepVisual_FillStyleSelect.hxx>
+#include <StepVisual_PresentationLayerAssignment.hxx>
+#include <StepVisual_PresentationStyleAssignment.hxx>
+#include <StepVisual_PresentationStyleSelect.hxx>
+#include <StepVisual_StyledItem.hxx>
+#include <StepVisual_SurfaceSideStyle.hxx>
+#include <StepVisual_SurfaceStyleElementSelect.hxx>
+#include <StepVisual_SurfaceStyleFillArea.hxx>
+#include <StepVisual_SurfaceStyleUsage.hxx>
+#include <TColStd_HSequenceOfExtendedString.hxx>
+#include <TCollection_AsciiString.hxx>
+#include <TCollection_HAsciiString.hxx>
+#include <TDF_Tool.hxx>
+#include <TDocStd_Document.hxx>
+#include <XCAFDoc_DocumentTool.hxx>
+#include <XCAFDoc_LayerTool.hxx>
+#include <XCAFDoc_ShapeTool.hxx>
+#include <XCAFPrs_DocumentExplorer.hxx>
+#include <XSControl_WorkSession.hxx>
+#include <gp.hxx>
+#include <gp_Ax3.hxx>
+#include <gp_Trsf.hxx>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "arrays.hpp"
+#include "options.hpp"
+
+/// One part definition of a scanned document.
+struct ScanPart {
+  ScanPart() : has_box(false) {
+    for (int i = 0; i < 3; i++) {
+      box_min[i] = box_max[i] = 0.0;
+    }
+  }
+
+  std::string name;
+  std::vector<std::string> layers;
+  /// Bounds in the coordinates of the part without meshing. They
+  /// may be a little loose. False for a part without geometry.
+  bool has_box;
+  double box_min[3];
+  double box_max[3];
+};
+
+/// One node of the assembly tree of a scanned document.
+struct ScanNode {
+  ScanNode() : part(-1), parent(-1), has_color(false) {
+    for (int i = 0; i < 16; i++) {
+      transform[i] = (i % 5 == 0) ? 1.0 : 0.0;
+    }
+    for (int i = 0; i < 4; i++) {
+      color[i] = 1.0f;
+    }
+  }
+
+  std::string name;
+  /// Index into `ScanResult::parts`, -1 for an assembly.
+  int part;
+  /// Index of the parent node, -1 for a top-level shape. Parents
+  /// always come before their children.
+  int parent;
+  std::vector<std::string> layers;
+  /// Row-major 4x4 homogeneous transform to world coordinates.
+  double transform[16];
+  /// Linear RGBA surface colour, own or inherited, if any.
+  float color[4];
+  bool has_color;
+};
+
+/// Product structure of a document without any triangles.
+struct ScanResult {
+  std::vector<ScanPart> parts;
+  std::vector<ScanNode> nodes;
+};
+
+/// Names of the layers a label is on.
+static std::vector<std::string>
+label_layers(const Handle(XCAFDoc_LayerTool) & layerTool,
+             const TDF_Label &label) {
+  std::vector<std::string> layers;
+  Handle(TColStd_HSequenceOfExtendedString) names =
+      new TColStd_HSequenceOfExtendedString();
+  if (layerTool->GetLayers(label, names)) {
+    for (int i = 1; i <= names->Length(); i++) {
+      layers.push_back(TCollection_AsciiString(names->Value(i)).ToCString());
+    }
+  }
+  return layers;
+}
+
+/// Walk the assembly tree of a transferred document into `result`,
+/// bounding every part definition once. The bounds come from the
+/// curves and surfaces, so they may be a little loose but need no
+/// triangulation.
+static void scan_document(const Handle(TDocStd_Document) & doc,
+                          ScanResult &result, Standard_Boolean use_parallel) {
+  Handle(XCAFDoc_LayerTool) layerTool =
+      XCAFDoc_DocumentTool::LayerTool(doc->Main());
+  std::map<std::string, int> partIndex;
+  std::vector<TDF_Label> partLabels;
+  // the node on the path to the current one at every depth
+  std::vector<int> path;
+  for (XCAFPrs_DocumentExplorer explorer(doc, XCAFPrs_DocumentExplorerFlags_None);
+       explorer.More(); explorer.Next()) {
+    const XCAFPrs_DocumentNode &node = explorer.Current();
+    const int depth = explorer.CurrentDepth();
+
+    ScanNode item;
+    item.name = label_name(node.Label);
+    if (item.name.empty()) {
+      item.name = label_name(node.RefLabel);
+    }
+    path.resize((size_t)depth);
+    item.parent = depth > 0 ? path[(size_t)depth - 1] : -1;
+    item.layers = label_layers(layerTool, node.Label);
+
+    if (!node.IsAssembly) {
+      TCollection_AsciiString entry;
+      TDF_Tool::Entry(node.RefLabel, entry);
+      std::map<std::string, int>::iterator found =
+          partIndex.find(entry.ToCString());
+      if (found == partIndex.end()) {
+        item.part = (int)result.parts.size();
+        partIndex[entry.ToCString()] = item.part;
+        ScanPart part;
+        part.name = label_name(node.RefLabel);
+        part.layers = label_layers(layerTool, node.RefLabel);
+        result.parts.push_back(part);
+        partLabels.push_back(node.RefLabel);
+      } else {
+        item.part = found->second;
+      }
+    }
+
+    const gp_Trsf trsf = node.Location.Transformation();
+    for (int row = 1; row <= 3; row++) {
+      for (int col = 1; col <= 4; col++) {
+        item.transform[(row - 1) * 4 + (col - 1)] = trsf.Value(row, col);
+      }
+    }
+    if (node.Style.IsSetColorSurf()) {
+      const NCollection_Vec4<float> rgba = node.Style.GetColorSurfRGBA();
+      for (int i = 0; i < 4; i++) {
+        item.color[i] = rgba[i];
+      }
+      item.has_color = true;
+    }
+    path.push_back((int)result.nodes.size());
+    result.nodes.push_back(item);
+  }
+
+  OSD_Parallel::For(
+      0, (int)partLabels.size(),
+      [&result, &partLabels](int i) {
+        Bnd_Box box;
+        BRepBndLib::Add(XCAFDoc_ShapeTool::GetShape(partLabels[(size_t)i]),
+                        box, Standard_False);
+        if (box.IsVoid()) {
+          return;
+        }
+        ScanPart &part = result.parts[(size_t)i];
+        box.Get(part.box_min[0], part.box_min[1], part.box_min[2],
+                part.box_max[0], part.box_max[1], part.box_max[2]);
+        part.has_box = true;
+      },
+      !use_parallel);
+}
+
+/// Text of an optional STEP string, empty if unset.
+static std::string step_text(const Handle(TCollection_HAsciiString) & text) {
+  return text.IsNull() ? std::string() : std::string(text->ToCString());
+}
+
+/// Millimeters per length unit of a representation, as the XCAF
+/// transfer scales to, or 1 without units.
+static double step_length_factor(const Handle(StepRepr_Representation) & rep) {
+  if (rep.IsNull()) {
+    return 1.0;
+  }
+  const Handle(StepRepr_RepresentationContext) &context = rep->ContextOfItems();
+  Handle(StepRepr_GlobalUnitAssignedContext) units =
+      Handle(StepRepr_GlobalUnitAssignedContext)::DownCast(context);
+  Handle(StepGeom_GeomRepContextAndGlobUnitAssCtxAndGlobUncertaintyAssCtx)
+      complex = Handle(
+          StepGeom_GeomRepContextAndGlobUnitAssCtxAndGlobUncertaintyAssCtx)::
+          DownCast(context);
+  if (!complex.IsNull()) {
+    units = complex->GlobalUnitAssignedContext();
+  }
+  if (units.IsNull()) {
+    return 1.0;
+  }
+  STEPConstruct_UnitContext unitContext;
+  return unitContext.ComputeFactors(units) == 0 &&
+                 unitContext.LengthFactor() > 0.0
+             ? unitContext.LengthFactor()
+             : 1.0;
+}
+
+/// A STEP direction, or `fallback` if unset or degenerate.
+static gp_Dir step_direction(const Handle(StepGeom_Direction) & direction,
+                             const gp_Dir &fallback) {
+  if (direction.IsNull() || direction->NbDirectionRatios() < 3) {
+    return fallback;
+  }
+  const gp_XYZ xyz(direction->DirectionRatiosValue(1),
+                   direction->DirectionRatiosValue(2),
+                   direction->DirectionRatiosValue(3));
+  return xyz.Modulus() > gp::Resolution() ? gp_Dir(xyz) : fallback;
+}
+
+/// A 3D point scaled by `factor`, false for 2D parameter points.
+static bool step_point(const Handle(StepGeom_CartesianPoint) & point,
+                       double factor, gp_Pnt &result) {
+  if (point.IsNull() || point->NbCoordinates() != 3) {
+    return false;
+  }
+  result.SetCoord(point->CoordinatesValue(1) * factor,
+                  point->CoordinatesValue(2) * factor,
+                  point->CoordinatesValue(3) * factor);
+  return true;
+}
+
+/// A STEP placement as axes with the origin scaled by `factor`.
+static gp_Ax3 step_axes(const Handle(StepGeom_Axis2Placement3d) & placement,
+                        double factor) {
+  gp_Pnt origin(0.0, 0.0, 0.0);
+  if (placement.IsNull()) {
+    return gp_Ax3(origin, gp::DZ(), gp::DX());
+  }
+  step_point(placement->Location(), factor, origin);
+  const gp_Dir z = placement->HasAxis()
+                       ? step_direction(placement->Axis(), gp::DZ())
+                       : gp::DZ();
+  const gp_Dir x = placement->HasRefDirection()
+                       ? step_direction(placement->RefDirection(), gp::DX())
+                       : gp::DX();
+  // only the part of x perpendicular to z counts
+  return x.IsParallel(z, Precision::Angular()) ? gp_Ax3(origin, z)
+                                               : gp_Ax3(origin, z, x);
+}
+
+/// Grow `box` by a cube of half-size `radius` around `center`.
+static void add_sphere(Bnd_Box &box, const gp_Pnt &center, double radius) {
+  box.Add(center.Translated(gp_Vec(-radius, -radius, -radius)));
+  box.Add(center.Translated(gp_Vec(radius, radius, radius)));
+}
+
+/// Bound the geometry below `items` from their entities alone: the
+/// 3D points, which include every vertex and spline control point,
+/// and the extent of circles, ellipses, spheres and tori, which a
+/// curved edge or face can bulge to. Placements, lines and other
+/// unbounded carriers are skipped, as their points may lie anywhere
+/// and faces on them are bounded by their edges. Entities already
+/// flagged in `seen` are skipped; each one visited is flagged and
+/// appended to `marked` so the caller can clear just those.
+static void bound_step_items(const Interface_Graph &graph,
+                             const Handle(StepRepr_Representation) & rep,
+                             double factor, std::vector<char> &seen,
+                             std::vector<Standard_Integer> &marked,
+                             Bnd_Box &box) {
+  const Handle(Interface_InterfaceModel) &model = graph.Model();
+  std::vector<Handle(Standard_Transient)> stack;
+  for (Standard_Integer i = 1; i <= rep->NbItems(); i++) {
+    stack.push_back(rep->ItemsValue(i));
+  }
+  while (!stack.empty()) {
+    Handle(Standard_Transient) entity = stack.back();
+    stack.pop_back();
+    const Standard_Integer number = model->Number(entity);
+    if (number <= 0 || seen[(size_t)number]) {
+      continue;
+    }
+    seen[(size_t)number] = 1;
+    marked.push_back(number);
+
+    gp_Pnt point;
+    if (entity->IsKind(STANDARD_TYPE(StepGeom_CartesianPoint))) {
+      if (step_point(Handle(StepGeom_CartesianPoint)::DownCast(entity), factor,
+                     point)) {
+        box.Add(point);
+      }
+      continue;
+    }
+    if (entity->IsKind(STANDARD_TYPE(StepGeom_Circle)) ||
+        entity->IsKind(STANDARD_TYPE(StepGeom_Ellipse))) {
+      Handle(StepGeom_Conic) conic = Handle(StepGeom_Conic)::DownCast(entity);
+      Handle(StepGeom_Circle) circle = Handle(StepGeom_Circle)::DownCast(entity);
+      Handle(StepGeom_Ellipse) ellipse =
+          Handle(StepGeom_Ellipse)::DownCast(entity);
+      const double radius =
+          !circle.IsNull()
+              ? circle->Radius()
+              : std::max(ellipse->SemiAxis1(), ellipse->SemiAxis2());
+      Handle(StepGeom_Axis2Placement3d) position =
+          conic->Position().Axis2Placement3d();
+      if (!position.IsNull()) {
+        add_sphere(box, step_axes(position, factor).Location(),
+                   radius * factor);
+      }
+      continue;
+    }
+    if (entity->IsKind(STANDARD_TYPE(StepGeom_SphericalSurface)) ||
+        entity->IsKind(STANDARD_TYPE(StepGeom_ToroidalSurface))) {
+      Handle(StepGeom_ElementarySurface) surface =
+          Handle(StepGeom_ElementarySurface)::DownCast(entity);
+      Handle(StepGeom_SphericalSurface) sphere =
+          Handle(StepGeom_SphericalSurface)::DownCast(entity);
+      Handle(StepGeom_ToroidalSurface) torus =
+          Handle(StepGeom_ToroidalSurface)::DownCast(entity);
+      const double radius =
+          !sphere.IsNull() ? sphere->Radius()
+                           : torus->MajorRadius() + torus->MinorRadius();
+      add_sphere(box, step_axes(surface->Position(), factor).Location(),
+                 radius * factor);
+      continue;
+    }
+    if (entity->IsKind(STANDARD_TYPE(StepGeom_Placement)) ||
+        entity->IsKind(STANDARD_TYPE(StepGeom_Line)) ||
+        entity->IsKind(STANDARD_TYPE(StepGeom_ElementarySurface)) ||
+        entity->IsKind(STANDARD_TYPE(StepGeom_Vector)) ||
+        entity->IsKind(STANDARD_TYPE(StepGeom_Direction)) ||
+        entity->IsKind(STANDARD_TYPE(StepGeom_Pcurve)) ||
+        entity->IsKind(STANDARD_TYPE(StepRepr_Representation)) ||
+        entity->IsKind(STANDARD_TYPE(StepRepr_RepresentationContext))) {
+      continue;
+    }
+    for (Interface_EntityIterator it = graph.Shareds(entity); it.More();
+         it.Next()) {
+      stack.push_back(it.Value());
+    }
+  }
+}
+
+/// The shape representation of a product definition, null if none.
+static Handle(StepRepr_Representation)
+    step_product_shape(const Interface_Graph &graph,
+                       const Handle(StepBasic_ProductDefinition) & product) {
+  for (Interface_EntityIterator it = graph.Sharings(product); it.More();
+       it.Next()) {
+    Handle(StepRepr_ProductDefinitionShape) shape =
+        Handle(StepRepr_ProductDefinitionShape)::DownCast(it.Value());
+    if (shape.IsNull() || shape->Definition().ProductDefinition() != product) {
+      continue;
+    }
+    for (Interface_EntityIterator sdr = graph.Sharings(shape); sdr.More();
+         sdr.Next()) {
+      Handle(StepShape_ShapeDefinitionRepresentation) definition =
+          Handle(StepShape_ShapeDefinitionRepresentation)::DownCast(
+              sdr.Value());
+      if (!definition.IsNull() && !definition->UsedRepresentation().IsNull()) {
+        return definition->UsedRepresentation();
+      }
+    }
+  }
+  return NULL;
+}
+
+/// `rep` and every representation related to it without a
+/// transformation, such as the B-rep behind a part's placements.
+static std::vector<Handle(StepRepr_Representation)>
+step_shape_reps(const Interface_Graph &graph,
+                const Handle(StepRepr_Representation) & rep) {
+  std::vector<Handle(StepRepr_Representation)> reps;
+  if (rep.IsNull()) {
+    return reps;
+  }
+  reps.push_back(rep);
+  for (size_t i = 0; i < reps.size(); i++) {
+    for (Interface_EntityIterator it = graph.Sharings(reps[i]); it.More();
+         it.Next()) {
+      Handle(StepRepr_ShapeRepresentationRelationship) relation =
+          Handle(StepRepr_ShapeRepresentationRelationship)::DownCast(
+              it.Value());
+      if (relation.IsNull() ||
+          relation->IsKind(
+              STANDARD_TYPE(StepRepr_RepresentationRelationshipWithTransformation))) {
+        continue;
+      }
+      Handle(StepRepr_Representation) other =
+          relation->Rep1() == reps[i] ? relation->Rep2() : relation->Rep1();
+      if (!other.IsNull() &&
+          std::find(reps.begin(), reps.end(), other) == reps.end()) {
+        reps.push_back(other);
+      }
+    }
+  }
+  return reps;
+}
+
+/// The first surface colour of a styled item.
+static bool step_style_color(const Handle(StepVisual_StyledItem) & styled,
+                             float color[4]) {
+  for (Standard_Integer i = 1; i <= styled->NbStyles(); i++) {
+    Handle(StepVisual_PresentationStyleAssignment) assignment =
+        styled->StylesValue(i);
+    if (assignment.IsNull()) {
+      continue;
+    }
+    for (Standard_Integer j = 1; j <= assignment->NbStyles(); j++) {
+      Handle(StepVisual_SurfaceStyleUsage) usage =
+          assignment->StylesValue(j).SurfaceStyleUsage();
+      if (usage.IsNull() || usage->Style().IsNull()) {
+        continue;
+      }
+      Handle(StepVisual_SurfaceSideStyle) side = usage->Style();
+      for (Standard_Integer k = 1; k <= side->NbStyles(); k++) {
+        Handle(StepVisual_SurfaceStyleFillArea) fill =
+            side->StylesValue(k).SurfaceStyleFillArea();
+        if (fill.IsNull() || fill->FillArea().IsNull()) {
+          continue;
+        }
+        Handle(StepVisual_FillAreaStyle) area = fill->FillArea();
+        for (Standard_Integer l = 1; l <= area->NbFillStyles(); l++) {
+          Handle(StepVisual_FillAreaStyleColour) colour =
+              area->FillStylesValue(l).FillAreaStyleColour();
+          Quantity_Color rgb;
+          if (!colour.IsNull() &&
+              STEPConstruct_Styles::DecodeColor(colour->FillColour(), rgb)) {
+            color[0] = (float)rgb.Red();
+            color[1] = (float)rgb.Green();
+            color[2] = (float)rgb.Blue();
+            color[3] = 1.0f;
+            return true;
+          }
+        }
+      }
+    }
+  }
+  return false;
+}
+
+/// Names of the layers `entity` is assigned to, appended to `layers`.
+static void step_layers(const Interface_Graph &graph,
+                        const Handle(Standard_Transient) & entity,
+                        std::vector<std::string> &layers) {
+  for (Interface_EntityIterator it = graph.Sharings(entity); it.More();
+       it.Next()) {
+    Handle(StepVisual_PresentationLayerAssignment) layer =
+        Handle(StepVisual_PresentationLayerAssignment)::DownCast(it.Value());
+    if (!layer.IsNull()) {
+      const std::string name = step_text(layer->Name());
+      if (std::find(layers.begin(), layers.end(), name) == layers.end()) {
+        layers.push_back(name);
+      }
+    }
+  }
+}
+
+/// Placement of the child of an assembly usage in its parent, from
+/// the transformation of its context dependent shape representation.
+static gp_Trsf
+step_usage_placement(const Interface_Graph &graph,
+                     const Handle(StepRepr_NextAssemblyUsageOccurrence) &
+                         usage) {
+  for (Interface_EntityIterator it = graph.Sharings(usage); it.More();
+       it.Next()) {
+    Handle(StepRepr_ProductDefinitionShape) shape =
+        Handle(StepRepr_ProductDefinitionShape)::DownCast(it.Value());
+    if (shape.IsNull()) {
+      continue;
+    }
+    for (Interface_EntityIterator cdsr = graph.Sharings(shape); cdsr.More();
+         cdsr.Next()) {
+      Handle(StepShape_ContextDependentShapeRepresentation) context =
+          Handle(StepShape_ContextDependentShapeRepresentation)::DownCast(
+              cdsr.Value());
+      if (context.IsNull()) {
+        continue;
+      }
+      Handle(StepRepr_RepresentationRelationshipWithTransformation) relation =
+          Handle(StepRepr_RepresentationRelationshipWithTransformation)::
+              DownCast(context->RepresentationRelation());
+      if (relation.IsNull()) {
+        continue;
+      }
+      Handle(StepRepr_ItemDefinedTransformation) transform =
+          relation->TransformationOperator().ItemDefinedTransformation();
+      if (transform.IsNull()) {
+        continue;
+      }
+      // the first item is in the child, unless the file has the
+      // representations the other way around
+      const Standard_Boolean reversed =
+          STEPConstruct_Assembly::CheckSRRReversesNAUO(graph, context);
+      const gp_Ax3 from = step_axes(
+          Handle(StepGeom_Axis2Placement3d)::DownCast(
+              transform->TransformItem1()),
+          step_length_factor(relation->Rep1()));
+      const gp_Ax3 to = step_axes(
+          Handle(StepGeom_Axis2Placement3d)::DownCast(
+              transform->TransformItem2()),
+          step_length_factor(relation->Rep2()));
+      gp_Trsf trsf;
+      trsf.SetDisplacement(from, to);
+      if (reversed) {
+        trsf.Invert();
+      }
+      return trsf;
+    }
+  }
+  return gp_Trsf();
+}
+
+/// Walk the product structure of a parsed STEP model into `result`
+/// without transferring any geometry: products, their assembly
+/// usages and placements, names, surface colours and layers of the
+/// top-level items, and bounds from `bound_step_items`. Products
+/// with components are assemblies, every other one is a part. The
+/// `options` leave out what the XCAF transfer would have left out.
+static void scan_step_model(const Handle(XSControl_WorkSession) & session,
+                            const ReadOptions &options, ScanResult &result) {
+  const Interface_Graph &graph = session->Graph();
+  const Handle(Interface_InterfaceModel) &model = graph.Model();
+  const Standard_Integer count = model->NbEntities();
+
+  // the usages below every product definition, in file order
+  std::map<Standard_Integer,
+           std::vector<Handle(StepRepr_NextAssemblyUsageOccurrence)>>
+      usages;
+  std::vector<char> used((size_t)count + 1, 0);
+  std::vector<Handle(StepBasic_ProductDefinition)> products;
+  for (Standard_Integer i = 1; i <= count; i++) {
+    const Handle(Standard_Transient) &entity = model->Value(i);
+    Handle(StepRepr_NextAssemblyUsageOccurrence) usage =
+        Handle(StepRepr_NextAssemblyUsageOccurrence)::DownCast(entity);
+    if (!usage.IsNull() && !usage->RelatingProductDefinition().IsNull() &&
+        !usage->RelatedProductDefinition().IsNull()) {
+      usages[model->Number(usage->RelatingProductDefinition())].push_back(
+          usage);
+      used[(size_t)model->Number(usage->RelatedProductDefinition())] = 1;
+    } else if (entity->IsKind(STANDARD_TYPE(StepBasic_ProductDefinition))) {
+      products.push_back(Handle(StepBasic_ProductDefinition)::DownCast(entity));
+    }
+  }
+
+  struct Pending {
+    Handle(StepBasic_ProductDefinition) product;
+    Handle(StepRepr_NextAssemblyUsageOccurrence) usage;
+    int parent;
+  };
+  std::vector<Pending> stack;
+  for (size_t i = products.size(); i > 0; i--) {
+    if (!used[(size_t)model->Number(products[i - 1])]) {
+      Pending root;
+      root.product = products[i - 1];
+      root.parent = -1;
+      stack.push_back(root);
+    }
+  }
+
+  std::map<Standard_Integer, int> partIndex;
+  // the surface colour of every part, for each node placing it
+  std::vector<char> partColored;
+  std::vector<float> partColors;
+  std::vector<gp_Trsf> world;
+  std::vector<char> seen((size_t)count + 1, 0);
+  std::vector<Standard_Integer> marked;
+  while (!stack.empty()) {
+    const Pending pending = stack.back();
+    stack.pop_back();
+    const Standard_Integer number = model->Number(pending.product);
+    std::string productName;
+    if (!pending.product->Formation().IsNull() &&
+        !pending.product->Formation()->OfProduct().IsNull()) {
+      productName =
+          step_text(pending.product->Formation()->OfProduct()->Name());
+    }
+
+    if (!options.names) {
+      productName.clear();
+    }
+
+    ScanNode node;
+    node.parent = pending.parent;
+    if (!pending.usage.IsNull() && options.names) {
+      node.name = step_text(pending.usage->Name());
+      if (node.name.empty()) {
+        node.name = step_text(pending.usage->Id());
+      }
+    }
+    if (node.name.empty()) {
+      node.name = productName;
+    }
+    gp_Trsf trsf = pending.parent >= 0 ? world[(size_t)pending.parent]
+                                       : gp_Trsf();
+    if (!pending.usage.IsNull()) {
+      trsf.Multiply(step_usage_placement(graph, pending.usage));
+    }
+    for (int row = 1; row <= 3; row++) {
+      for (int col = 1; col <= 4; col++) {
+        node.transform[(row - 1) * 4 + (col - 1)] = trsf.Value(row, col);
+      }
+    }
+    if (pending.parent >= 0 && result.nodes[(size_t)pending.parent].has_color) {
+      std::copy(result.nodes[(size_t)pending.parent].color,
+                result.nodes[(size_t)pending.parent].color + 4, node.color);
+      node.has_color = true;
+    }
+
+    std::map<Standard_Integer,
+             std::vector<Handle(StepRepr_NextAssemblyUsageOccurrence)>>::
+        const_iterator children = usages.find(number);
+    if (children == usages.end()) {
+      std::map<Standard_Integer, int>::iterator found = partIndex.find(number);
+      if (found != partIndex.end()) {
+        node.part = found->second;
+      } else {
+        node.part = (int)result.parts.size();
+        partIndex[number] = node.part;
+        ScanPart part;
+        part.name = productName;
+        Bnd_Box box;
+        float color[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        bool colored = false;
+        const std::vector<Handle(StepRepr_Representation)> reps =
+            step_shape_reps(graph, step_product_shape(graph, pending.product));
+        for (size_t r = 0; r < reps.size(); r++) {
+          bound_step_items(graph, reps[r], step_length_factor(reps[r]), seen,
+                           marked, box);
+          for (Standard_Integer i = 1; i <= reps[r]->NbItems(); i++) {
+            const Handle(StepRepr_RepresentationItem) &item =
+                reps[r]->ItemsValue(i);
+            if (options.layers) {
+              step_layers(graph, item, part.layers);
+            }
+            for (Interface_EntityIterator it = graph.Sharings(item);
+                 it.More(); it.Next()) {
+              Handle(StepVisual_StyledItem) styled =
+                  Handle(StepVisual_StyledItem)::DownCast(it.Value());
+              if (styled.IsNull()) {
+                continue;
+              }
+              if (options.layers) {
+                step_layers(graph, styled, part.layers);
+              }
+              if (options.colors && !colored) {
+                colored = step_style_color(styled, color);
+              }
+            }
+          }
+        }
+        // entities shared with the next part bound it too, and only
+        // those marked are cleared so this stays linear in the file
+        for (size_t m = 0; m < marked.size(); m++) {
+          seen[(size_t)marked[m]] = 0;
+        }
+        marked.clear();
+        if (!box.IsVoid()) {
+          box.Get(part.box_min[0], part.box_min[1], part.box_min[2],
+                  part.box_max[0], part.box_max[1], part.box_max[2]);
+          part.has_box = true;
+        }
+        partColored.push_back(colored ? 1 : 0);
+        partColors.insert(partColors.end(), color, color + 4);
+        result.parts.push_back(part);
+      }
+      if (partColored[(size_t)node.part]) {
+        std::copy(partColors.begin() + node.part * 4,
+                  partColors.begin() + node.part * 4 + 4, node.color);
+        node.has_color = true;
+      }
+      node.layers = result.parts[(size_t)node.part].layers;
+    }
+
+    const int index = (int)result.nodes.size();
+    result.nodes.push_back(node);
+    world.push_back(trsf);
+    if (children != usages.end()) {
+      // pushed in reverse so they come out in file order
+      for (size_t i = children->second.size(); i > 0; i--) {
+        Pending child;
+        child.product = children->second[i - 1]->RelatedProductDefinition();
+        child.usage = children->second[i - 1];
+        child.parent = index;
+        stack.push_back(child);
+      }
+    }
+  }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <BRepBndLib.hxx>
+#include <Bnd_Box.hxx>
+#include <TCollection_AsciiString.hxx>
+#include <TDF_LabelMap.hxx>
+#include <TDF_LabelSequence.hxx>
+#include <TDF_Tool.hxx>
+#include <TDocStd_Document.hxx>
+#include <TopLoc_Location.hxx>
+#include <XCAFDoc_DocumentTool.hxx>
+#include <XCAFDoc_ShapeTool.hxx>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "arrays.hpp"
+#include "options.hpp"
+
+/// Whether an instance named `name`, or of a product named
+/// `product`, at `path` is asked for by `filter`.
+static bool select_matches(const ConvertFilter &filter,
+                           const std::string &name,
+                           const std::string &product,
+                           const std::string &path) {
+  for (size_t i = 0; i < filter.products.size(); i++) {
+    const std::string &wanted = filter.products[i];
+    if (wanted.find('/') != std::string::npos ? wanted == path
+                                              : wanted == name ||
+                                                    wanted == product) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Whether a part placed at `location` meets the box of `filter`.
+/// Every part definition is bounded once in its own coordinates,
+/// kept in `bounds` by label entry, and the box is then moved to
+/// each placement, which may make it a little loose.
+static bool select_box(const ConvertFilter &filter, const TDF_Label &part,
+                       const TopLoc_Location &location,
+                       std::map<std::string, Bnd_Box> &bounds) {
+  TCollection_AsciiString entry;
+  TDF_Tool::Entry(part, entry);
+  std::map<std::string, Bnd_Box>::iterator found =
+      bounds.find(entry.ToCString());
+  if (found == bounds.end()) {
+    Bnd_Box own;
+    BRepBndLib::Add(XCAFDoc_ShapeTool::GetShape(part), own, Standard_False);
+    found = bounds.insert(std::make_pair(std::string(entry.ToCString()), own))
+                .first;
+  }
+  if (found->second.IsVoid()) {
+    return false;
+  }
+  const Bnd_Box placed = found->second.Transformed(location.Transformation());
+  Bnd_Box box;
+  box.Update(filter.box_min[0], filter.box_min[1], filter.box_min[2],
+             filter.box_max[0], filter.box_max[1], filter.box_max[2]);
+  return !placed.IsOut(box);
+}
+
+/// Visit the instance `label` of `ref` and everything below,
+/// adding every component and free shape holding a kept part to
+/// `keep`. Returns whether anything below was kept.
+static bool select_walk(const ConvertFilter &filter, const TDF_Label &label,
+                        const TDF_Label &ref, const std::string &parent,
+                        const TopLoc_Location &location, bool selected,
+                        std::map<std::string, Bnd_Box> &bounds,
+                        TDF_LabelMap &keep) {
+  const std::string product = label_name(ref);
+  std::string name = label_name(label);
+  if (name.empty()) {
+    name = product;
+  }
+  const std::string path = parent.empty() ? name : parent + "/" + name;
+  selected = selected || filter.products.empty() ||
+             select_matches(filter, name, product, path);
+
+  bool kept = false;
+  if (XCAFDoc_ShapeTool::IsAssembly(ref)) {
+    TDF_LabelSequence components;
+    XCAFDoc_ShapeTool::GetComponents(ref, components);
+    for (TDF_LabelSequence::Iterator it(components); it.More(); it.Next()) {
+      TDF_Label child;
+      XCAFDoc_ShapeTool::GetReferredShape(it.Value(), child);
+      // a shared sub-assembly keeps every component kept by any
+      // of its instances
+      if (select_walk(filter, it.Value(), child, path,
+                      location * XCAFDoc_ShapeTool::GetLocation(it.Value()),
+                      selected, bounds, keep)) {
+        kept = true;
+      }
+    }
+  } else {
+    kept = selected &&
+           (!filter.has_box || select_box(filter, ref, location, bounds));
+  }
+  if (kept) {
+    keep.Add(label);
+  }
+  return kept;
+}
+
+/// Remove every part of `doc` which `filter` does not ask for, and
+/// the assemblies left empty, so they are never meshed or written.
+/// Returns the number of top-level shapes left.
+static int select_parts(const Handle(TDocStd_Document) & doc,
+                        const ConvertFilter &filter) {
+  Handle(XCAFDoc_ShapeTool) shapeTool =
+      XCAFDoc_DocumentTool::ShapeTool(doc->Main());
+  TDF_LabelSequence roots;
+  shapeTool->GetFreeShapes(roots);
+  TDF_LabelMap keep;
+  std::map<std::string, Bnd_Box> bounds;
+  for (TDF_LabelSequence::Iterator it(roots); it.More(); it.Next()) {
+    select_walk(filter, it.Value(), it.Value(), std::string(),
+                TopLoc_Location(), false, bounds, keep);
+  }
+
+  TDF_LabelSequence shapes;
+  shapeTool->GetShapes(shapes);
+  for (TDF_LabelSequence::Iterator it(shapes); it.More(); it.Next()) {
+    if (!XCAFDoc_ShapeTool::IsAssembly(it.Value())) {
+      continue;
+    }
+    TDF_LabelSequence components;
+    XCAFDoc_ShapeTool::GetComponents(it.Value(), components);
+    for (TDF_LabelSequence::Iterator c(components); c.More(); c.Next()) {
+      if (!keep.Contains(c.Value())) {
+        shapeTool->RemoveComponent(c.Value());
+      }
+    }
+  }
+
+  // definitions no longer referenced become free shapes: drop them,
+  // and again for what they referenced, until only kept roots remain
+  int left = 0;
+  for (bool removed = true; removed;) {
+    removed = false;
+    left = 0;
+    TDF_LabelSequence free;
+    shapeTool->GetFreeShapes(free);
+    for (TDF_LabelSequence::Iterator it(free); it.More(); it.Next()) {
+      if (keep.Contains(it.Value())) {
+        left++;
+      } else if (shapeTool->RemoveShape(it.Value(), Standard_False)) {
+        removed = true;
+      }
+    }
+  }
+  shapeTool->UpdateAssemblies();
+  return left;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <OSD_Chronometer.hxx>
+#include <OSD_MemInfo.hxx>
+#include <OSD_Timer.hxx>
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+// jemalloc's control interface, null unless jemalloc is linked or
+// preloaded with LD_PRELOAD in place of malloc
+extern "C" int mallctl(const char *name, void *oldp, size_t *oldlenp,
+                       void *newp, size_t newlen) __attribute__((weak));
+#endif
+
+/// Cost of one stage of a conversion.
+struct StageStats {
+  StageStats()
+      : wall(0.0), cpu(0.0), peak_rss(0), heap(0), allocations(-1),
+        frees(-1) {}
+
+  /// Elapsed seconds.
+  double wall;
+  /// User and system seconds of the whole process, so this includes
+  /// worker threads but also any other conversion running at once.
+  double cpu;
+  /// High-water mark of the resident set in bytes when the stage ended.
+  /// The operating system only keeps a process-wide peak, so this is
+  /// the largest RSS seen up to the end of this stage.
+  int64_t peak_rss;
+  /// Bytes allocated from the heap and not yet freed when the stage
+  /// ended, 0 where the allocator does not report it.
+  int64_t heap;
+  /// Heap allocations and frees made by the whole process during the
+  /// stage, -1 where the allocator does not count them.
+  int64_t allocations;
+  int64_t frees;
+};
+
+/// Measurements of a single conversion.
+struct ConvertStats {
+  ConvertStats()
+      : entities(0), shapes(0), faces(0), triangles(0), output_bytes(0),
+        tol_linear(0.0), duplicates(0), reused(0), timeouts(0) {}
+
+  StageStats read;
+  StageStats transfer;
+  StageStats mesh;
+  StageStats write;
+  /// Closing and freeing the document.
+  StageStats release;
+
+  /// Entities in the parsed STEP model.
+  int64_t entities;
+  /// Distinct part definitions in the XCAF document.
+  int64_t shapes;
+  /// Distinct faces after instancing.
+  int64_t faces;
+  /// Triangles over the distinct faces.
+  int64_t triangles;
+  /// Size of the written GLB.
+  int64_t output_bytes;
+  /// Linear deflection the faces were meshed with, which differs
+  /// from the requested one with automatic tolerance or a cap.
+  double tol_linear;
+  /// Parts found to be moved copies of another and shared with it.
+  int64_t duplicates;
+  /// Parts whose triangulations came from the manifest of the
+  /// previous conversion instead of being meshed.
+  int64_t reused;
+  /// Faces which went over `MeshOptions::face_timeout` and were
+  /// meshed from their boundary only.
+  int64_t timeouts;
+};
+
+/// Peak resident set size of the process in bytes.
+static int64_t peak_rss() {
+  OSD_MemInfo info(Standard_False);
+  info.SetActive(Standard_False);
+  info.SetActive(OSD_MemInfo::MemWorkingSetPeak, Standard_True);
+  info.Update();
+  return (int64_t)info.Value(OSD_MemInfo::MemWorkingSetPeak);
+}
+
+/// Bytes in use on the heap, 0 where it is not cheap to know.
+static int64_t heap_usage() {
+#ifdef _WIN32
+  // walking the Windows heap costs time proportional to its size
+  return 0;
+#else
+  OSD_MemInfo info(Standard_False);
+  info.SetActive(Standard_False);
+  info.SetActive(OSD_MemInfo::MemHeapUsage, Standard_True);
+  info.Update();
+  return (int64_t)info.Value(OSD_MemInfo::MemHeapUsage);
+#endif
+}
+
+/// Allocations and frees the process made so far, from jemalloc's
+/// statistics, which OpenCASCADE allocates from with `MMGT_OPT=0`
+/// and jemalloc preloaded. False where nothing counts them.
+static bool allocation_counts(int64_t &allocations, int64_t &frees) {
+#if defined(__linux__)
+  if (mallctl == NULL) {
+    return false;
+  }
+  // the statistics are a snapshot refreshed by writing the epoch
+  uint64_t epoch = 1;
+  size_t size = sizeof(epoch);
+  mallctl("epoch", &epoch, &size, &epoch, size);
+  // 4096 is MALLCTL_ARENAS_ALL, the sum over every arena
+  const char *names[4] = {"stats.arenas.4096.small.nmalloc",
+                          "stats.arenas.4096.large.nmalloc",
+                          "stats.arenas.4096.small.ndalloc",
+                          "stats.arenas.4096.large.ndalloc"};
+  uint64_t counts[4];
+  for (int i = 0; i < 4; i++) {
+    size = sizeof(counts[i]);
+    if (mallctl(names[i], &counts[i], &size, NULL, 0) != 0) {
+      // built without statistics
+      return false;
+    }
+  }
+  allocations = (int64_t)(counts[0] + counts[1]);
+  frees = (int64_t)(counts[2] + counts[3]);
+  return true;
+#else
+  (void)allocations;
+  (void)frees;
+  return false;
+#endif
+}
+
+/// Process CPU time in seconds.
+static double process_cpu() {
+  Standard_Real user = 0.0, system = 0.0;
+  OSD_Chronometer::GetProcessCPU(user, system);
+  return user + system;
+}
+
+/// Records one stage into `StageStats` from construction until
+/// destruction. Does nothing for a null target.
+class StageTimer {
+public:
+  StageTimer(StageStats *stage)
+      : myStage(stage), myCpu(0.0), myAllocations(0), myFrees(0),
+        myCounted(false) {
+    if (myStage != NULL) {
+      myCounted = allocation_counts(myAllocations, myFrees);
+      myCpu = process_cpu();
+      myTimer.Start();
+    }
+  }
+
+  ~StageTimer() {
+    if (myStage != NULL) {
+      myTimer.Stop();
+      myStage->wall += myTimer.ElapsedTime();
+      myStage->cpu += process_cpu() - myCpu;
+      myStage->peak_rss = peak_rss();
+      myStage->heap = heap_usage();
+      int64_t allocations = 0, frees = 0;
+      if (myCounted && allocation_counts(allocations, frees)) {
+        // stages like the write run more than once per conversion
+        myStage->allocations = std::max<int64_t>(0, myStage->allocations) +
+                               allocations - myAllocations;
+        myStage->frees =
+            std::max<int64_t>(0, myStage->frees) + frees - myFrees;
+      }
+    }
+  }
+
+private:
+  StageStats *myStage;
+  OSD_Timer myTimer;
+  double myCpu;
+  int64_t myAllocations;
+  int64_t myFrees;
+  bool myCounted;
+};
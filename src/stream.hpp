@@ -0,0 +1,390 @@
+#pragma once
+
+#include <OSD_FileSystem.hxx>
+#include <OSD_StreamBuffer.hxx>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/// Read-only stream buffer over memory owned by the caller.
+/// Nothing is copied: the get area points straight at the data.
+class MemoryStreamBuf : public std::streambuf {
+public:
+  MemoryStreamBuf(const char *data, size_t size) {
+    char *begin = const_cast<char *>(data);
+    setg(begin, begin, begin + size);
+  }
+
+protected:
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which) override {
+    if (!(which & std::ios_base::in)) {
+      return pos_type(off_type(-1));
+    }
+    char *base = dir == std::ios_base::beg   ? eback()
+                 : dir == std::ios_base::cur ? gptr()
+                                             : egptr();
+    char *target = base + off;
+    if (target < eback() || target > egptr()) {
+      return pos_type(off_type(-1));
+    }
+    setg(eback(), target, egptr());
+    return pos_type(target - eback());
+  }
+
+  virtual pos_type seekpos(pos_type pos,
+                           std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+  virtual std::streamsize showmanyc() override { return egptr() - gptr(); }
+};
+
+/// Read-only stream buffer which keeps a shared string alive.
+class SharedMemoryStreamBuf : public MemoryStreamBuf {
+public:
+  SharedMemoryStreamBuf(const std::shared_ptr<std::string> &data)
+      : MemoryStreamBuf(data->data(), data->size()), myData(data) {}
+
+private:
+  std::shared_ptr<std::string> myData;
+};
+
+/// Read-only memory mapping of a whole file, so multi-gigabyte
+/// inputs are paged in by the OS instead of copied into the heap.
+class MappedFile {
+public:
+  MappedFile(const char *path) : myData(NULL), mySize(0) {
+#ifdef _WIN32
+    myMapping = NULL;
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+      return;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+      myMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    }
+    CloseHandle(file);
+    if (myMapping == NULL) {
+      return;
+    }
+    myData = (const char *)MapViewOfFile(myMapping, FILE_MAP_READ, 0, 0, 0);
+    if (myData != NULL) {
+      mySize = (size_t)size.QuadPart;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+      void *data =
+          mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        myData = (const char *)data;
+        mySize = (size_t)info.st_size;
+        // the STEP parser reads front to back exactly once
+        madvise(data, mySize, MADV_SEQUENTIAL);
+      }
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+#endif
+  }
+
+  ~MappedFile() {
+#ifdef _WIN32
+    if (myData != NULL) {
+      UnmapViewOfFile(myData);
+    }
+    if (myMapping != NULL) {
+      CloseHandle(myMapping);
+    }
+#else
+    if (myData != NULL) {
+      munmap((void *)myData, mySize);
+    }
+#endif
+  }
+
+  bool IsOpen() const { return myData != NULL; }
+  const char *Data() const { return myData; }
+  size_t Size() const { return mySize; }
+
+  /// Drop the resident pages of a range which has been consumed,
+  /// keeping the peak RSS to the parsed model rather than the file.
+  void Release(size_t begin, size_t end) const {
+#ifndef _WIN32
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    begin = (begin + page - 1) / page * page;
+    end = end / page * page;
+    if (end > begin) {
+      madvise((void *)(myData + begin), end - begin, MADV_DONTNEED);
+    }
+#else
+    (void)begin;
+    (void)end;
+#endif
+  }
+
+private:
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+  const char *myData;
+  size_t mySize;
+#ifdef _WIN32
+  HANDLE myMapping;
+#endif
+};
+
+/// Read-only stream buffer over a mapped file which exposes it one
+/// window at a time and releases every window once it is consumed.
+/// Nothing is copied: each window points straight into the mapping.
+class MappedStreamBuf : public std::streambuf {
+public:
+  MappedStreamBuf(const MappedFile &file, size_t window = (size_t)1 << 22)
+      : myFile(file), myWindow(window), myBegin(0) {
+    char *data = const_cast<char *>(file.Data());
+    setg(data, data, data);
+  }
+
+protected:
+  virtual int_type underflow() override {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+    const size_t position = (size_t)(gptr() - start());
+    if (position >= myFile.Size()) {
+      return traits_type::eof();
+    }
+    if (position > myBegin) {
+      myFile.Release(myBegin, position);
+    }
+    setWindow(position);
+    return traits_type::to_int_type(*gptr());
+  }
+
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which) override {
+    if (!(which & std::ios_base::in)) {
+      return pos_type(off_type(-1));
+    }
+    const off_type origin = dir == std::ios_base::beg ? 0
+                            : dir == std::ios_base::cur
+                                ? (off_type)(gptr() - start())
+                                : (off_type)myFile.Size();
+    const off_type target = origin + off;
+    if (target < 0 || target > (off_type)myFile.Size()) {
+      return pos_type(off_type(-1));
+    }
+    setWindow((size_t)target);
+    return pos_type(target);
+  }
+
+  virtual pos_type seekpos(pos_type pos,
+                           std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+  virtual std::streamsize showmanyc() override {
+    return (std::streamsize)(myFile.Size() - (size_t)(gptr() - start()));
+  }
+
+private:
+  char *start() const { return const_cast<char *>(myFile.Data()); }
+
+  void setWindow(size_t position) {
+    const size_t end = std::min(myFile.Size(), position + myWindow);
+    myBegin = position;
+    setg(start() + position, start() + position, start() + end);
+  }
+
+  const MappedFile &myFile;
+  size_t myWindow;
+  size_t myBegin;
+};
+
+/// Seekable write-only stream buffer appending into a shared string.
+class StringStreamBuf : public std::streambuf {
+public:
+  StringStreamBuf(const std::shared_ptr<std::string> &data)
+      : myData(data), myPos(0) {}
+
+protected:
+  virtual int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+    }
+    char ch = traits_type::to_char_type(c);
+    xsputn(&ch, 1);
+    return c;
+  }
+
+  virtual std::streamsize xsputn(const char *s, std::streamsize n) override {
+    if (myPos == myData->size()) {
+      myData->append(s, (size_t)n);
+    } else {
+      // the GLB writer seeks back to patch chunk lengths
+      if (myPos + n > myData->size()) {
+        myData->resize(myPos + (size_t)n);
+      }
+      std::memcpy(&(*myData)[myPos], s, (size_t)n);
+    }
+    myPos += (size_t)n;
+    return n;
+  }
+
+  virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                           std::ios_base::openmode which) override {
+    if (!(which & std::ios_base::out)) {
+      return pos_type(off_type(-1));
+    }
+    off_type base = dir == std::ios_base::beg   ? 0
+                    : dir == std::ios_base::cur ? (off_type)myPos
+                                                : (off_type)myData->size();
+    if (base + off < 0) {
+      return pos_type(off_type(-1));
+    }
+    myPos = (size_t)(base + off);
+    if (myPos > myData->size()) {
+      myData->resize(myPos);
+    }
+    return pos_type((off_type)myPos);
+  }
+
+  virtual pos_type seekpos(pos_type pos,
+                           std::ios_base::openmode which) override {
+    return seekoff(off_type(pos), std::ios_base::beg, which);
+  }
+
+private:
+  std::shared_ptr<std::string> myData;
+  size_t myPos;
+};
+
+/// In-memory file system registered with OSD_FileSystem so that
+/// OCCT writers which only take file names (RWGltf_CafWriter) can
+/// write into memory. Files live under `cascadio-mem://<n>/` URLs.
+class MemoryFileSystem : public OSD_FileSystem {
+  DEFINE_STANDARD_RTTI_INLINE(MemoryFileSystem, OSD_FileSystem)
+public:
+  /// Return the process-wide instance, registering it on first use.
+  static const Handle(MemoryFileSystem) & Instance() {
+    static Handle(MemoryFileSystem) theFileSystem = registerInstance();
+    return theFileSystem;
+  }
+
+  /// Return a fresh directory URL for a single conversion.
+  TCollection_AsciiString NewFolder() {
+    std::lock_guard<std::mutex> lock(myMutex);
+    return TCollection_AsciiString(Prefix()) + TCollection_AsciiString(++myCounter) +
+           "/";
+  }
+
+  /// Move the contents of a file out of the file system.
+  bool Take(const TCollection_AsciiString &url, std::string &out) {
+    std::lock_guard<std::mutex> lock(myMutex);
+    std::map<std::string, std::shared_ptr<std::string>>::iterator found =
+        myFiles.find(url.ToCString());
+    if (found == myFiles.end()) {
+      return false;
+    }
+    out.swap(*found->second);
+    myFiles.erase(found);
+    return true;
+  }
+
+  /// Drop every file below a directory URL.
+  void Release(const TCollection_AsciiString &folder) {
+    std::lock_guard<std::mutex> lock(myMutex);
+    const std::string prefix(folder.ToCString());
+    std::map<std::string, std::shared_ptr<std::string>>::iterator it =
+        myFiles.lower_bound(prefix);
+    while (it != myFiles.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+      myFiles.erase(it++);
+    }
+  }
+
+  static const char *Prefix() { return "cascadio-mem://"; }
+
+  virtual bool
+  IsSupportedPath(const TCollection_AsciiString &theUrl) const override {
+    return theUrl.Search(Prefix()) == 1;
+  }
+
+  virtual bool
+  IsOpenIStream(const std::shared_ptr<std::istream> &theStream) const override {
+    std::shared_ptr<OSD_IStreamBuffer> aStream =
+        std::dynamic_pointer_cast<OSD_IStreamBuffer>(theStream);
+    return aStream.get() != NULL &&
+           IsSupportedPath(TCollection_AsciiString(aStream->Url().c_str()));
+  }
+
+  virtual bool
+  IsOpenOStream(const std::shared_ptr<std::ostream> &theStream) const override {
+    std::shared_ptr<OSD_OStreamBuffer> aStream =
+        std::dynamic_pointer_cast<OSD_OStreamBuffer>(theStream);
+    return aStream.get() != NULL &&
+           IsSupportedPath(TCollection_AsciiString(aStream->Url().c_str()));
+  }
+
+  virtual std::shared_ptr<std::streambuf>
+  OpenStreamBuffer(const TCollection_AsciiString &theUrl,
+                   const std::ios_base::openmode theMode,
+                   const int64_t theOffset = 0,
+                   int64_t *theOutBufSize = NULL) override {
+    std::lock_guard<std::mutex> lock(myMutex);
+    std::shared_ptr<std::string> &file = myFiles[theUrl.ToCString()];
+    if ((theMode & std::ios_base::out) != 0) {
+      // writing always truncates
+      file = std::make_shared<std::string>();
+      return std::make_shared<StringStreamBuf>(file);
+    }
+    if (!file) {
+      myFiles.erase(theUrl.ToCString());
+      return std::shared_ptr<std::streambuf>();
+    }
+    std::shared_ptr<std::streambuf> buffer =
+        std::make_shared<SharedMemoryStreamBuf>(file);
+    if (theOffset > 0) {
+      buffer->pubseekoff(theOffset, std::ios_base::beg, std::ios_base::in);
+    }
+    if (theOutBufSize != NULL) {
+      *theOutBufSize = (int64_t)file->size() - theOffset;
+    }
+    return buffer;
+  }
+
+private:
+  MemoryFileSystem() : myCounter(0) {}
+
+  static Handle(MemoryFileSystem) registerInstance() {
+    Handle(MemoryFileSystem) aFileSystem = new MemoryFileSystem();
+    OSD_FileSystem::AddDefaultProtocol(aFileSystem, true);
+    return aFileSystem;
+  }
+
+  std::mutex myMutex;
+  std::map<std::string, std::shared_ptr<std::string>> myFiles;
+  int myCounter;
+};
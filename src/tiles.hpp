@@ -0,0 +1,138 @@
+#pragma once
+
+#include <Bnd_Box.hxx>
+#include <gp_Pnt.hxx>
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/// One placed instance to partition into tiles.
+struct TileItem {
+  TileItem() : triangles(0), index(0) {}
+
+  /// Bounds in document coordinates.
+  Bnd_Box box;
+  int64_t triangles;
+  /// Index of the instance in the caller's list.
+  size_t index;
+};
+
+/// A node of the bounding volume hierarchy over `TileItem`s. Leaves
+/// are tiles and hold the items `begin` to `end`.
+struct TileNode {
+  TileNode() : begin(0), end(0), tile(-1) {
+    children[0] = children[1] = -1;
+  }
+
+  Bnd_Box box;
+  size_t begin;
+  size_t end;
+  int children[2];
+  /// Index of the tile for a leaf, -1 for an inner node.
+  int tile;
+};
+
+static double box_center(const Bnd_Box &box, int axis) {
+  double lower[3], upper[3];
+  box.Get(lower[0], lower[1], lower[2], upper[0], upper[1], upper[2]);
+  return 0.5 * (lower[axis] + upper[axis]);
+}
+
+/// Split `items` from `begin` to `end` at the median center of the
+/// longest axis of their centers until every leaf has at most
+/// `maxTriangles` triangles or a single item. Items are reordered so
+/// each node holds a contiguous range. Returns the index of the node.
+static int build_tiles(std::vector<TileItem> &items, size_t begin, size_t end,
+                       int64_t maxTriangles, std::vector<TileNode> &nodes,
+                       int &tiles) {
+  const int index = (int)nodes.size();
+  nodes.push_back(TileNode());
+  Bnd_Box box, centers;
+  int64_t triangles = 0;
+  for (size_t i = begin; i < end; i++) {
+    box.Add(items[i].box);
+    centers.Add(gp_Pnt(box_center(items[i].box, 0), box_center(items[i].box, 1),
+                       box_center(items[i].box, 2)));
+    triangles += items[i].triangles;
+  }
+  nodes[index].box = box;
+  nodes[index].begin = begin;
+  nodes[index].end = end;
+  if (end - begin <= 1 || triangles <= maxTriangles) {
+    nodes[index].tile = tiles++;
+    return index;
+  }
+
+  double lower[3], upper[3];
+  centers.Get(lower[0], lower[1], lower[2], upper[0], upper[1], upper[2]);
+  int axis = 0;
+  for (int i = 1; i < 3; i++) {
+    if (upper[i] - lower[i] > upper[axis] - lower[axis]) {
+      axis = i;
+    }
+  }
+  const size_t middle = begin + (end - begin) / 2;
+  std::nth_element(items.begin() + begin, items.begin() + middle,
+                   items.begin() + end,
+                   [axis](const TileItem &a, const TileItem &b) {
+                     return box_center(a.box, axis) < box_center(b.box, axis);
+                   });
+  const int left = build_tiles(items, begin, middle, maxTriangles, nodes, tiles);
+  const int right = build_tiles(items, middle, end, maxTriangles, nodes, tiles);
+  nodes[index].children[0] = left;
+  nodes[index].children[1] = right;
+  return index;
+}
+
+/// Write the 3D Tiles bounding volume of a box in document units
+/// scaled by `unit` to meters. The tiles are glTF, which a client
+/// turns from Y-up to the Z-up of 3D Tiles, so the written data maps
+/// (x, y, z) to (x, -z, y) there. Returns the diagonal in meters.
+static double write_tile_box(std::ostream &out, const Bnd_Box &box,
+                             double unit) {
+  double lower[3] = {0.0, 0.0, 0.0}, upper[3] = {0.0, 0.0, 0.0};
+  if (!box.IsVoid()) {
+    box.Get(lower[0], lower[1], lower[2], upper[0], upper[1], upper[2]);
+  }
+  const double center[3] = {0.5 * (lower[0] + upper[0]) * unit,
+                            -0.5 * (lower[2] + upper[2]) * unit,
+                            0.5 * (lower[1] + upper[1]) * unit};
+  const double half[3] = {0.5 * (upper[0] - lower[0]) * unit,
+                          0.5 * (upper[2] - lower[2]) * unit,
+                          0.5 * (upper[1] - lower[1]) * unit};
+  out << "\"boundingVolume\":{\"box\":[" << center[0] << "," << center[1]
+      << "," << center[2] << "," << half[0] << ",0,0,0," << half[1]
+      << ",0,0,0," << half[2] << "]}";
+  return 2.0 * std::sqrt(half[0] * half[0] + half[1] * half[1] +
+                         half[2] * half[2]);
+}
+
+/// Write node `index` and everything below it as a 3D Tiles tile,
+/// with `uris` the content of every tile. Only leaves have content,
+/// and an inner node asks for its children once its own extent is
+/// the error on screen.
+static void write_tile_json(std::ostream &out,
+                            const std::vector<TileNode> &nodes, int index,
+                            const std::vector<std::string> &uris,
+                            double unit) {
+  const TileNode &node = nodes[(size_t)index];
+  out << "{";
+  const double diagonal = write_tile_box(out, node.box, unit);
+  if (index == 0) {
+    // children add to their parents, which have no content of their own
+    out << ",\"refine\":\"ADD\"";
+  }
+  if (node.tile >= 0) {
+    out << ",\"geometricError\":0,\"content\":{\"uri\":\""
+        << uris[(size_t)node.tile] << "\"}}";
+    return;
+  }
+  out << ",\"geometricError\":" << diagonal << ",\"children\":[";
+  write_tile_json(out, nodes, node.children[0], uris, unit);
+  out << ",";
+  write_tile_json(out, nodes, node.children[1], uris, unit);
+  out << "]}";
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "glb.hpp"
+
+/// Records timed spans from every thread while a trace is running and
+/// writes them in the Chrome trace event format, which Perfetto and
+/// chrome://tracing open. When no trace is running a span costs one
+/// atomic load.
+class TraceRecorder {
+public:
+  /// The recorder shared by every conversion, never destroyed so
+  /// spans may end during static destruction.
+  static TraceRecorder &Instance() {
+    static TraceRecorder *recorder = new TraceRecorder();
+    return *recorder;
+  }
+
+  bool IsActive() const { return myActive.load(std::memory_order_relaxed); }
+
+  /// Drop anything recorded so far and record from now on.
+  void Start() {
+    std::lock_guard<std::mutex> lock(myMutex);
+    myEvents.clear();
+    myActive = true;
+  }
+
+  /// Stop recording and write what was recorded to `path`. Returns
+  /// the number of spans written, or -1 if the file failed.
+  int64_t Stop(const std::string &path) {
+    std::vector<Event> events;
+    {
+      std::lock_guard<std::mutex> lock(myMutex);
+      myActive = false;
+      events.swap(myEvents);
+    }
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); i++) {
+      const Event &event = events[i];
+      out << (i > 0 ? ",\n" : "\n") << "{\"name\":" << json_string(event.name)
+          << ",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"ts\":"
+          << event.start << ",\"dur\":" << event.duration
+          << ",\"pid\":1,\"tid\":" << event.thread;
+      if (!event.args.empty()) {
+        out << ",\"args\":{" << event.args << "}";
+      }
+      out << "}";
+    }
+    out << "\n]}\n";
+    out.close();
+    return out.fail() ? -1 : (int64_t)events.size();
+  }
+
+  /// Microseconds since the recorder was created.
+  int64_t Now() const {
+    return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - myOrigin)
+        .count();
+  }
+
+  /// Record a span which ran on the calling thread. `args` is the
+  /// inside of a JSON object, or empty.
+  void Add(const char *category, const std::string &name, int64_t start,
+           int64_t end, const std::string &args) {
+    Event event;
+    event.category = category;
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+    event.thread = threadNumber();
+    event.args = args;
+    std::lock_guard<std::mutex> lock(myMutex);
+    if (myActive) {
+      myEvents.push_back(event);
+    }
+  }
+
+private:
+  struct Event {
+    const char *category;
+    std::string name;
+    int64_t start;
+    int64_t duration;
+    int thread;
+    std::string args;
+  };
+
+  TraceRecorder() : myActive(false), myOrigin(std::chrono::steady_clock::now()) {}
+
+  /// Small stable number of the calling thread, easier to read in a
+  /// viewer than a native thread id.
+  static int threadNumber() {
+    static std::atomic<int> next(1);
+    static thread_local int number = next++;
+    return number;
+  }
+
+  std::atomic<bool> myActive;
+  std::chrono::steady_clock::time_point myOrigin;
+  std::mutex myMutex;
+  std::vector<Event> myEvents;
+};
+
+/// Records a span from construction until destruction while a trace
+/// is running. `category` must be a string literal.
+class TraceSpan {
+public:
+  TraceSpan(const char *theCategory, const std::string &theName)
+      : myCategory(theCategory), myStart(-1) {
+    TraceRecorder &recorder = TraceRecorder::Instance();
+    if (recorder.IsActive()) {
+      myName = theName;
+      myStart = recorder.Now();
+    }
+  }
+
+  ~TraceSpan() {
+    if (myStart >= 0) {
+      TraceRecorder &recorder = TraceRecorder::Instance();
+      recorder.Add(myCategory, myName, myStart, recorder.Now(), myArgs.str());
+    }
+  }
+
+  bool IsActive() const { return myStart >= 0; }
+
+  /// Attach a value shown with the span, while it is recorded.
+  template <typename T> void Arg(const char *key, const T &value) {
+    if (myStart >= 0) {
+      myArgs << (myArgs.tellp() > 0 ? "," : "") << "\"" << key
+             << "\":" << value;
+    }
+  }
+
+  void Arg(const char *key, const std::string &value) {
+    if (myStart >= 0) {
+      myArgs << (myArgs.tellp() > 0 ? "," : "") << "\"" << key
+             << "\":" << json_string(value);
+    }
+  }
+
+private:
+  const char *myCategory;
+  std::string myName;
+  int64_t myStart;
+  std::ostringstream myArgs;
+};
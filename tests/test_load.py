@@ -1,10 +1,26 @@
 import os
+import sys
+import asyncio
+import json
 import cascadio
 import trimesh
 import tempfile
+from io import BytesIO
 
 cwd = os.path.abspath(os.path.dirname(__file__))
 
+# the benchmark corpus generators build the assembly fixtures
+sys.path.insert(0, os.path.join(cwd, "..", "benchmarks"))
+import corpus  # noqa: E402
+
+
+def glb_json(glb):
+    """
+    The JSON chunk of GLB bytes as a dict.
+    """
+    length = int.from_bytes(glb[12:16], "little")
+    return json.loads(bytes(glb[20 : 20 + length]))
+
 
 def test_convert():
     infile = os.path.join(cwd, "models", "featuretype.STEP")
@@ -18,5 +34,1082 @@ def test_convert():
     assert len(scene.geometry) == 1
 
 
+def test_convert_bytes():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    glb = cascadio.convert_to_glb(data, "step", tol_linear=0.1)
+    assert isinstance(glb, bytes)
+    assert glb.startswith(b"glTF")
+
+    # opting out of the copy hands over the same data as a view
+    view = cascadio.convert_to_glb(data, "step", tol_linear=0.1, copy=False)
+    assert isinstance(view, memoryview)
+    assert view.readonly
+    assert view == glb
+
+    scene = trimesh.load(BytesIO(glb), file_type="glb", merge_primitives=True)
+    assert len(scene.geometry) == 1
+
+
+def test_convert_batch():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+
+    with tempfile.TemporaryDirectory() as D:
+        inputs = [infile, os.path.join(D, "missing.step"), infile]
+        outputs = [os.path.join(D, f"{i}.glb") for i in range(len(inputs))]
+        status = cascadio.step_to_glb_batch(inputs, outputs, tol_linear=0.1)
+
+        # a failed file is reported without stopping the others
+        assert status == [0, 1, 0]
+        for i in (0, 2):
+            scene = trimesh.load(outputs[i], merge_primitives=True)
+            assert len(scene.geometry) == 1
+
+
+def test_cache():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    with tempfile.TemporaryDirectory() as D:
+        cascadio.enable_cache(D)
+        try:
+            first = cascadio.convert_to_glb(data, "step", tol_linear=0.05)
+            info = cascadio.cache_info()
+            assert info["hits"] == 0
+            assert info["misses"] > 0
+            assert info["entries"] > 0
+
+            # the same geometry and tolerances should skip meshing
+            second = cascadio.convert_to_glb(data, "step", tol_linear=0.05)
+            assert cascadio.cache_info()["hits"] == info["misses"]
+            assert len(first) == len(second)
+
+            # a different tolerance is a different key
+            cascadio.convert_to_glb(data, "step", tol_linear=0.02)
+            assert cascadio.cache_info()["misses"] == 2 * info["misses"]
+
+            # an entry is larger than this so everything is evicted
+            cascadio.enable_cache(D, max_bytes=1)
+            assert cascadio.cache_info()["entries"] == 0
+        finally:
+            cascadio.disable_cache()
+    assert cascadio.cache_info() == {}
+
+
+def test_stats():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+
+    with tempfile.TemporaryDirectory() as D:
+        outfile = os.path.join(D, "outfile.glb")
+        stats = cascadio.ConvertStats()
+        cascadio.step_to_glb(infile, outfile, 0.1, 0.5, stats=stats)
+        assert stats.output_bytes == os.path.getsize(outfile)
+
+    for stage in (stats.read, stats.transfer, stats.mesh, stats.write):
+        assert stage.wall > 0.0
+        assert stage.peak_rss > 0
+    assert stats.entities > 0
+    assert stats.shapes == 1
+    assert stats.faces > 0
+    assert stats.triangles > 0
+
+    assert stats.release.wall > 0.0
+
+    info = stats.to_dict()
+    assert info["triangles"] == stats.triangles
+    assert info["mesh"]["wall"] == stats.mesh.wall
+
+    # counted only under jemalloc, where parsing allocates plenty
+    assert info["read"]["allocations"] == stats.read.allocations
+    if stats.read.allocations >= 0:
+        assert stats.read.allocations > 0
+        assert stats.release.frees > 0
+    else:
+        assert stats.read.frees == -1
+
+
+def test_progress_cancel():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    reports = []
+    cascadio.convert_to_glb(
+        data, "step", tol_linear=0.1, progress=lambda f, s: reports.append(f)
+    )
+    assert len(reports) > 1
+    assert reports == sorted(reports)
+    assert reports[-1] > 0.99
+
+    # a cancelled token stops the conversion before anything is written
+    token = cascadio.CancelToken()
+    token.cancel()
+    assert token.cancelled
+    with tempfile.TemporaryDirectory() as D:
+        outfile = os.path.join(D, "outfile.glb")
+        assert cascadio.step_to_glb(infile, outfile, cancel=token) == 2
+        assert not os.path.exists(outfile)
+
+    # cancelling from inside the callback
+    token = cascadio.CancelToken()
+    try:
+        cascadio.convert_to_glb(
+            data, "step", progress=lambda f, s: token.cancel(), cancel=token
+        )
+        raise AssertionError("conversion should have been cancelled")
+    except cascadio.CancelledError:
+        pass
+
+
+def test_convert_arrays():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    result = cascadio.convert_to_arrays(data, "step", tol_linear=0.1)
+    assert len(result["meshes"]) == 1
+    assert len(result["instances"]) == 1
+
+    mesh = result["meshes"][0]
+    assert mesh["vertices"].shape[1] == 3
+    assert mesh["vertices"].dtype.name == "float32"
+    assert mesh["normals"].shape == mesh["vertices"].shape
+    assert mesh["faces"].shape[1] == 3
+    assert mesh["faces"].max() < len(mesh["vertices"])
+
+    instance = result["instances"][0]
+    assert instance["mesh"] == 0
+    assert instance["transform"].shape == (4, 4)
+
+    # the same triangles as the GLB, which is in meters with Y up
+    glb = cascadio.convert_to_glb(data, "step", tol_linear=0.1)
+    scene = trimesh.load(BytesIO(glb), file_type="glb", merge_primitives=True)
+    assert len(scene.geometry) == 1
+    geometry = next(iter(scene.geometry.values()))
+    assert len(geometry.faces) == len(mesh["faces"])
+
+    # reading from disk gives the same meshes
+    disk = cascadio.step_to_arrays(infile, tol_linear=0.1)
+    assert len(disk["meshes"][0]["faces"]) == len(mesh["faces"])
+
+
+def test_convert_mmap():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+
+    with tempfile.TemporaryDirectory() as D:
+        plain = os.path.join(D, "plain.glb")
+        mapped = os.path.join(D, "mapped.glb")
+        assert cascadio.step_to_glb(infile, plain, 0.1) == 0
+        reports = []
+        status = cascadio.step_to_glb(
+            infile, mapped, 0.1, use_mmap=True, progress=lambda f, s: reports.append(f)
+        )
+        assert status == 0
+        assert reports[-1] > 0.99
+        assert os.path.getsize(plain) == os.path.getsize(mapped)
+
+        missing = os.path.join(D, "missing.step")
+        assert cascadio.step_to_glb(missing, mapped, use_mmap=True) == 1
+
+
+def test_convert_lods():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+
+    with tempfile.TemporaryDirectory() as D:
+        fine = os.path.join(D, "fine.glb")
+        coarse = os.path.join(D, "coarse.glb")
+        # passed fine first to check they are sorted
+        status = cascadio.step_to_glb_lods(infile, [fine, coarse], [0.01, 1.0])
+        assert status == 0
+
+        faces = {}
+        for name, path in (("fine", fine), ("coarse", coarse)):
+            scene = trimesh.load(path, merge_primitives=True)
+            assert len(scene.geometry) == 1
+            faces[name] = sum(len(g.faces) for g in scene.geometry.values())
+        assert faces["coarse"] < faces["fine"]
+
+        # each level matches a separate conversion at that tolerance
+        single = os.path.join(D, "single.glb")
+        cascadio.step_to_glb(infile, single, 1.0)
+        scene = trimesh.load(single, merge_primitives=True)
+        assert sum(len(g.faces) for g in scene.geometry.values()) == faces["coarse"]
+
+
+def test_auto_tolerance():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    auto = cascadio.ConvertStats()
+    cascadio.convert_to_glb(
+        data, "step", mesh=cascadio.MeshOptions(tol_auto=True), stats=auto
+    )
+    assert auto.tol_linear > 0.0
+    assert auto.triangles > 0
+
+    # the fit is approximate so only check the budget is roughly met
+    budget = cascadio.ConvertStats()
+    mesh = cascadio.MeshOptions(tol_auto=True, target_triangles=20000)
+    cascadio.convert_to_glb(data, "step", mesh=mesh, stats=budget)
+    assert 5000 < budget.triangles < 80000
+
+    # a cap coarsens a fine request
+    fine = cascadio.ConvertStats()
+    cascadio.convert_to_glb(data, "step", tol_linear=1e-4, stats=fine)
+    capped = cascadio.ConvertStats()
+    cap = fine.triangles // 4
+    cascadio.convert_to_glb(
+        data,
+        "step",
+        tol_linear=1e-4,
+        mesh=cascadio.MeshOptions(max_triangles=cap),
+        stats=capped,
+    )
+    assert capped.triangles <= cap
+    assert capped.tol_linear > fine.tol_linear
+
+
+def test_draco():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    plain = cascadio.convert_to_glb(data, "step", tol_linear=0.01)
+    draco = cascadio.convert_to_glb(
+        data, "step", tol_linear=0.01, write=cascadio.WriteOptions(draco=True)
+    )
+    assert draco[:4] == b"glTF"
+
+    # the JSON chunk directly follows the 12 byte header
+    length = int.from_bytes(draco[12:16], "little")
+    header = json.loads(bytes(draco[20 : 20 + length]))
+    assert "KHR_draco_mesh_compression" in header["extensionsRequired"]
+    assert len(draco) < len(plain)
+
+    try:
+        write = cascadio.WriteOptions(draco=True, quantize_texcoord_bits=31)
+        cascadio.convert_to_glb(data, "step", write=write)
+        raise AssertionError("out of range quantization accepted")
+    except ValueError:
+        pass
+
+    # options only take the names of their fields
+    try:
+        cascadio.WriteOptions(dracoo=True)
+        raise AssertionError("unknown option accepted")
+    except TypeError:
+        pass
+
+
+def test_optimize_mesh():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    raw = cascadio.convert_to_arrays(data, "step", tol_linear=0.05)["meshes"][0]
+    optimize = cascadio.MeshOptions(optimize=True)
+    opt = cascadio.convert_to_arrays(data, "step", tol_linear=0.05, mesh=optimize)[
+        "meshes"
+    ][0]
+    assert len(opt["vertices"]) <= len(raw["vertices"])
+    assert len(opt["faces"]) <= len(raw["faces"])
+    assert opt["faces"].max() < len(opt["vertices"])
+
+    # the surface area should survive welding and reordering
+    a = trimesh.Trimesh(raw["vertices"], raw["faces"], process=False)
+    b = trimesh.Trimesh(opt["vertices"], opt["faces"], process=False)
+    assert abs(a.area - b.area) < 1e-3 * a.area
+
+    glb = cascadio.convert_to_glb(data, "step", tol_linear=0.05, mesh=optimize)
+    scene = trimesh.load(BytesIO(glb), file_type="glb", merge_primitives=True)
+    assert len(scene.geometry) == 1
+
+    # seams with texture coordinates either side are only welded
+    # once the coordinates are left out
+    welded = cascadio.convert_to_glb(
+        data,
+        "step",
+        tol_linear=0.05,
+        mesh=optimize,
+        write=cascadio.WriteOptions(uvs=False),
+    )
+
+    def positions(glb):
+        header = glb_json(glb)
+        return sum(
+            header["accessors"][p["attributes"]["POSITION"]]["count"]
+            for mesh in header["meshes"]
+            for p in mesh["primitives"]
+        )
+
+    assert positions(welded) <= positions(glb)
+    assert positions(welded) == len(opt["vertices"])
+
+
+def test_dedupe():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    # three unrelated copies of the same product, renumbered
+    step = corpus.many_roots(infile, 3).encode()
+
+    plain = cascadio.ConvertStats()
+    glb = cascadio.convert_to_glb(step, "step", tol_linear=0.1, stats=plain)
+    assert plain.shapes == 3
+    assert plain.duplicates == 0
+
+    stats = cascadio.ConvertStats()
+    shared = cascadio.convert_to_glb(
+        step,
+        "step",
+        tol_linear=0.1,
+        mesh=cascadio.MeshOptions(dedupe=True),
+        stats=stats,
+    )
+    assert stats.duplicates == 2
+    assert stats.shapes == 1
+    assert len(shared) < len(glb)
+
+    # every copy is still in the scene, instancing one mesh
+    scene = trimesh.load(BytesIO(shared), file_type="glb", merge_primitives=True)
+    assert len(scene.geometry) == 1
+    before = trimesh.load(BytesIO(glb), file_type="glb", merge_primitives=True)
+    assert len(scene.graph.nodes_geometry) == len(before.graph.nodes_geometry)
+    assert abs(scene.area - before.area) < 1e-6 * before.area
+
+
+def test_dedupe_symmetric():
+    # two squares, the second turned 30 degrees about its normal: the
+    # axes across a square are arbitrary, so the turn must be searched
+    with open(os.path.join(cwd, "models", "squares.brep"), "rb") as f:
+        data = f.read()
+    plain = cascadio.ConvertStats()
+    glb = cascadio.convert_to_glb(data, "brep", tol_linear=0.01, stats=plain)
+    assert plain.shapes == 2
+    assert plain.duplicates == 0
+
+    stats = cascadio.ConvertStats()
+    shared = cascadio.convert_to_glb(
+        data,
+        "brep",
+        tol_linear=0.01,
+        mesh=cascadio.MeshOptions(dedupe=True),
+        stats=stats,
+    )
+    assert stats.duplicates == 1
+    assert stats.shapes == 1
+
+    scene = trimesh.load(BytesIO(shared), file_type="glb", merge_primitives=True)
+    assert len(scene.geometry) == 1
+    assert len(scene.graph.nodes_geometry) == 2
+    # the turned copy lands where it was drawn
+    before = trimesh.load(BytesIO(glb), file_type="glb", merge_primitives=True)
+    assert abs(scene.area - before.area) < 1e-6 * before.area
+    assert (abs(scene.bounds - before.bounds) < 1e-6 * before.scale).all()
+
+
+def test_instances():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    single = cascadio.ConvertStats()
+    with open(infile, "rb") as f:
+        cascadio.convert_to_glb(f.read(), "step", tol_linear=0.1, stats=single)
+
+    # five placements of one part, four of them through two
+    # instances of one shared sub-assembly
+    pair = {
+        "name": "pair",
+        "children": [("a", (0, 0, 0), None), ("b", (5, 0, 0), None)],
+    }
+    step = corpus.assembly(
+        corpus.model,
+        {
+            "name": "rack",
+            "children": [
+                ("top", (0, 0, 0), pair),
+                ("bottom", (0, 0, 5), pair),
+                ("loose", (0, 5, 0), None, ((1, 0, 0), (0, 1, 0))),
+            ],
+        },
+    ).encode()
+
+    stats = cascadio.ConvertStats()
+    glb = cascadio.convert_to_glb(step, "step", tol_linear=0.1, stats=stats)
+    # the prototype is meshed once, whatever the number of instances
+    assert stats.shapes == 1
+    assert stats.faces == single.faces
+    assert stats.triangles == single.triangles
+
+    # and every instance is a node pointing at the one mesh
+    header = glb_json(glb)
+    placed = [node["mesh"] for node in header["nodes"] if "mesh" in node]
+    assert len(placed) == 5
+    assert len(set(placed)) == 1
+    scene = trimesh.load(BytesIO(glb), file_type="glb", merge_primitives=True)
+    assert len(scene.geometry) == 1
+    assert len(scene.graph.nodes_geometry) == 5
+
+
+
+def test_file_types():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    # file types are case insensitive
+    glb = cascadio.convert_to_glb(data, "STP", tol_linear=0.1)
+    assert glb[:4] == b"glTF"
+
+    try:
+        cascadio.convert_to_glb(data, "obj")
+        raise AssertionError("unsupported file type accepted")
+    except ValueError:
+        pass
+
+    # STEP data is not a valid BREP
+    try:
+        cascadio.convert_to_glb(data, "brep")
+        raise AssertionError("invalid BREP accepted")
+    except RuntimeError:
+        pass
+
+    # a 10 mm square as an IGES B-spline surface and a text and a
+    # binary BREP face, from files and from memory, which IGES reads
+    # via a temp file
+    squares = (
+        ("square.igs", "iges"),
+        ("square.brep", "brep"),
+        ("square_binary.brep", "brep"),
+    )
+    with tempfile.TemporaryDirectory() as D:
+        for name, file_type in squares:
+            path = os.path.join(cwd, "models", name)
+            outfile = os.path.join(D, name + ".glb")
+            assert cascadio.step_to_glb(path, outfile, tol_linear=0.1) == 0
+            with open(path, "rb") as f:
+                glb = cascadio.convert_to_glb(f.read(), file_type, tol_linear=0.1)
+            mesh = trimesh.load(BytesIO(glb), file_type="glb", force="mesh")
+            assert len(mesh.faces) >= 2
+            on_disk = trimesh.load(outfile, force="mesh")
+            assert len(on_disk.faces) == len(mesh.faces)
+            extents = sorted(mesh.extents)
+            assert extents[0] < 1e-6 * extents[2]
+            assert abs(extents[1] - extents[2]) < 1e-6 * extents[2]
+
+            # progress and cancellation read through a wrapping stream,
+            # which binary BREP seeks in
+            fractions = []
+            with open(path, "rb") as f:
+                tracked = cascadio.convert_to_glb(
+                    f.read(),
+                    file_type,
+                    tol_linear=0.1,
+                    progress=lambda fraction, stage: fractions.append(fraction),
+                    cancel=cascadio.CancelToken(),
+                )
+            assert len(fractions) > 0
+            mesh = trimesh.load(BytesIO(tracked), file_type="glb", force="mesh")
+            assert len(mesh.faces) == len(on_disk.faces)
+            assert (
+                cascadio.step_to_glb(
+                    path, outfile, tol_linear=0.1, cancel=cascadio.CancelToken()
+                )
+                == 0
+            )
+
+
+
+def test_converter():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    converter = cascadio.Converter(tol_linear=0.1)
+    with tempfile.TemporaryDirectory() as D:
+        outfile = os.path.join(D, "outfile.glb")
+        for _ in range(3):
+            assert converter.step_to_glb(infile, outfile) == 0
+            scene = trimesh.load(outfile, merge_primitives=True)
+            assert len(scene.geometry) == 1
+
+    # the same settings give the same bytes as the module function
+    glb = converter.convert_to_glb(data, "step")
+    assert glb == cascadio.convert_to_glb(data, "step", tol_linear=0.1)
+
+    arrays = converter.step_to_arrays(infile)
+    assert len(arrays["meshes"]) == 1
+
+    # freeing in the background gives the same result
+    background = cascadio.Converter(
+        tol_linear=0.1, read=cascadio.ReadOptions(release_async=True)
+    )
+    assert background.convert_to_glb(data, "step") == glb
+
+    # more models than the queue takes at once wait rather than pile up
+    limit = cascadio.release_limit()
+    cascadio.set_release_limit(1)
+    try:
+        assert cascadio.release_limit() == 1
+        for _ in range(4):
+            assert background.convert_to_glb(data, "step") == glb
+    finally:
+        cascadio.set_release_limit(limit)
+    cascadio.wait_released()
+
+
+
+def test_select():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    everything = cascadio.convert_to_arrays(data, "step", 0.1)
+    vertices = everything["meshes"][0]["vertices"]
+    lower, upper = vertices.min(axis=0), vertices.max(axis=0)
+
+    # a box around the part keeps it
+    box = cascadio.ReadOptions(bbox=(lower, upper))
+    inside = cascadio.convert_to_arrays(data, "step", 0.1, read=box)
+    assert len(inside["meshes"]) == 1
+    assert box.bbox == (tuple(lower), tuple(upper))
+
+    # a box away from the part or an unknown product leaves nothing
+    far = (upper + 10.0, upper + 20.0)
+    for kwargs in ({"bbox": far}, {"products": ["no such product"]}):
+        try:
+            read = cascadio.ReadOptions(**kwargs)
+            cascadio.convert_to_arrays(data, "step", 0.1, read=read)
+            raise AssertionError("empty selection converted")
+        except RuntimeError:
+            pass
+
+    # two instances of a sub-assembly of two parts, and a loose part,
+    # all 20 inches apart
+    pair = {
+        "name": "pair",
+        "children": [("a", (0, 0, 0), None), ("b", (20, 0, 0), None)],
+    }
+    rack = corpus.assembly(
+        corpus.model,
+        {
+            "name": "rack",
+            "children": [
+                ("top", (0, 0, 0), pair),
+                ("bottom", (0, 0, 20), pair),
+                ("loose", (0, 20, 0), None),
+            ],
+        },
+    ).encode()
+
+    def placed(**kwargs):
+        read = cascadio.ReadOptions(**kwargs)
+        scene = cascadio.convert_to_arrays(rack, "step", 0.1, read=read)
+        assert len(scene["meshes"]) == 1
+        return [instance["transform"][:3, 3] for instance in scene["instances"]]
+
+    assert len(placed()) == 5
+    # a product name keeps every instance of it
+    assert len(placed(products=["pair"])) == 4
+    # an instance name keeps that instance only
+    (loose,) = placed(products=["loose"])
+    assert loose[1] > 0.0 and abs(loose[0]) < 1e-6 and abs(loose[2]) < 1e-6
+    # and a path picks one instance inside one of the sub-assemblies
+    (corner,) = placed(products=["rack/bottom/b"])
+    assert corner[0] > 0.0 and abs(corner[0] - corner[2]) < 1e-6
+    assert abs(corner[1]) < 1e-6
+
+    # a box around the part at one placement keeps only that one
+    (boxed,) = placed(bbox=(lower + corner, upper + corner))
+    assert abs(boxed - corner).max() < 1e-6
+
+
+
+def test_scan():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+
+    stats = cascadio.ConvertStats()
+    scan = cascadio.scan_step(infile, stats=stats)
+    assert len(scan["parts"]) == 1
+    assert stats.triangles == 0
+    # the model is walked without a transfer of the geometry
+    assert stats.transfer.wall > 0.0
+    assert stats.write.wall == 0.0
+    (lower, upper) = scan["parts"][0]["bounds"]
+    assert all(a < b for a, b in zip(lower, upper))
+
+    # the bounds may be loose but hold the whole mesh
+    vertices = cascadio.step_to_arrays(infile)["meshes"][0]["vertices"]
+    size = max(b - a for a, b in zip(lower, upper))
+    for axis in range(3):
+        low = float(vertices[:, axis].min())
+        high = float(vertices[:, axis].max())
+        assert lower[axis] - 1e-3 * size <= low < lower[axis] + 0.25 * size
+        assert upper[axis] - 0.25 * size < high <= upper[axis] + 1e-3 * size
+    leaves = [n for n in scan["nodes"] if n["part"] is not None]
+    assert len(leaves) >= 1
+    for index, node in enumerate(scan["nodes"]):
+        assert node["parent"] is None or node["parent"] < index
+
+    scans = cascadio.scan_step_batch([infile, infile + ".missing", infile])
+    assert scans[1] is None
+    assert scans[0]["parts"] == scans[2]["parts"]
+
+    # two instances of a sub-assembly, one part of it turned, and a
+    # loose part, all placing the one coloured part of the model
+    (color,) = [n["color"] for n in scan["nodes"] if n["part"] is not None]
+    assert color is not None
+    pair = {
+        "name": "pair",
+        "children": [
+            ("a", (0, 0, 0), None),
+            ("b", (20, 0, 0), None, ((0, 0, 1), (0, 1, 0))),
+        ],
+    }
+    rack = {
+        "name": "rack",
+        "children": [
+            ("top", (0, 0, 0), pair),
+            ("bottom", (0, 0, 20), pair),
+            ("loose", (0, 20, 0), None),
+        ],
+    }
+    with tempfile.TemporaryDirectory() as D:
+        path = os.path.join(D, "rack.step")
+        with open(path, "w") as f:
+            f.write(corpus.assembly(corpus.model, rack))
+        tree = cascadio.scan_step(path)
+        scene = cascadio.step_to_arrays(path, 0.1)
+
+    assert len(tree["parts"]) == 1
+    leaves = [n for n in tree["nodes"] if n["part"] is not None]
+    assert sorted(n["name"] for n in leaves) == ["a", "a", "b", "b", "loose"]
+    # every instance of the part has its colour, not just the first
+    assert all(n["color"] == color for n in leaves)
+    assembly = [n["name"] for n in tree["nodes"] if n["part"] is None]
+    assert sorted(assembly) == ["bottom", "rack", "top"]
+
+    # each placement matches one of the transferred instances
+    placements = [i["transform"].tolist() for i in scene["instances"]]
+    assert len(placements) == len(leaves)
+    for node in leaves:
+        matrix = node["transform"].tolist()
+        assert any(
+            all(
+                abs(matrix[r][c] - other[r][c]) < 1e-6 * (1.0 + abs(other[r][c]))
+                for r in range(4)
+                for c in range(4)
+            )
+            for other in placements
+        )
+
+
+
+def test_convert_async():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+    converter = cascadio.Converter(tol_linear=0.1)
+    expected = converter.convert_to_glb(data, "step")
+
+    async def convert_many():
+        return await asyncio.gather(
+            *[cascadio.convert_async(data, "step", converter) for _ in range(4)]
+        )
+
+    previous = cascadio.async_limit()
+    cascadio.set_async_limit(2)
+    try:
+        assert asyncio.run(convert_many()) == [expected] * 4
+    finally:
+        cascadio.set_async_limit(previous)
+
+    async def convert_cancelled():
+        task = asyncio.ensure_future(cascadio.convert_async(data, "step"))
+        task.cancel()
+        await task
+
+    try:
+        asyncio.run(convert_cancelled())
+        raise AssertionError("cancelled conversion returned")
+    except asyncio.CancelledError:
+        pass
+
+
+def test_low_memory():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with tempfile.TemporaryDirectory() as D:
+        normal = os.path.join(D, "normal.glb")
+        streamed = os.path.join(D, "streamed.glb")
+        assert cascadio.step_to_glb(infile, normal, tol_linear=0.1) == 0
+        stats = cascadio.ConvertStats()
+        assert (
+            cascadio.step_to_glb(
+                infile,
+                streamed,
+                tol_linear=0.1,
+                stats=stats,
+                write=cascadio.WriteOptions(low_memory=True),
+            )
+            == 0
+        )
+        # only the GLB is left behind
+        assert sorted(os.listdir(D)) == ["normal.glb", "streamed.glb"]
+
+        expected = trimesh.load(normal, force="mesh")
+        mesh = trimesh.load(streamed, force="mesh")
+        assert len(mesh.faces) == len(expected.faces)
+        assert stats.triangles == len(mesh.faces)
+        assert (abs(mesh.bounds - expected.bounds) < 1e-6).all()
+
+
+def test_manifest():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with tempfile.TemporaryDirectory() as D:
+        outfile = os.path.join(D, "outfile.glb")
+        manifest = os.path.join(D, "outfile.parts")
+
+        first = cascadio.ConvertStats()
+        assert (
+            cascadio.step_to_glb(
+                infile, outfile, tol_linear=0.1, stats=first, manifest=manifest
+            )
+            == 0
+        )
+        assert first.reused == 0
+        assert os.path.exists(manifest)
+        expected = trimesh.load(outfile, force="mesh")
+
+        # an unchanged revision reuses every part
+        second = cascadio.ConvertStats()
+        assert (
+            cascadio.step_to_glb(
+                infile, outfile, tol_linear=0.1, stats=second, manifest=manifest
+            )
+            == 0
+        )
+        assert second.reused == second.shapes > 0
+        assert second.triangles == first.triangles
+        mesh = trimesh.load(outfile, force="mesh")
+        assert len(mesh.faces) == len(expected.faces)
+
+        # other mesh settings do not match the manifest
+        third = cascadio.ConvertStats()
+        converter = cascadio.Converter(tol_linear=0.05)
+        assert (
+            converter.step_to_glb(infile, outfile, stats=third, manifest=manifest)
+            == 0
+        )
+        assert third.reused == 0
+
+        # a triangle budget settled by the last conversion is reused
+        # with the parts, rather than sampled by meshing them again
+        budget = os.path.join(D, "budget.parts")
+        converter = cascadio.Converter(
+            mesh=cascadio.MeshOptions(tol_auto=True, target_triangles=20000)
+        )
+        fourth = cascadio.ConvertStats()
+        converter.step_to_glb(infile, outfile, stats=fourth, manifest=budget)
+        tracefile = os.path.join(D, "trace.json")
+        cascadio.start_trace()
+        fifth = cascadio.ConvertStats()
+        converter.step_to_glb(infile, outfile, stats=fifth, manifest=budget)
+        cascadio.stop_trace(tracefile)
+        with open(tracefile) as f:
+            events = json.load(f)["traceEvents"]
+        assert fifth.reused == fifth.shapes > 0
+        assert fifth.tol_linear == fourth.tol_linear
+        assert not any(event["name"] == "face" for event in events)
+
+
+def test_tiles():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with tempfile.TemporaryDirectory() as D:
+        outfile = os.path.join(D, "outfile.glb")
+        assert cascadio.step_to_glb(infile, outfile, tol_linear=0.1) == 0
+        expected = trimesh.load(outfile, force="mesh")
+
+        tiles = os.path.join(D, "tiles")
+        stats = cascadio.ConvertStats()
+        assert (
+            cascadio.step_to_tiles(
+                infile, tiles, tile_triangles=100, tol_linear=0.1, stats=stats
+            )
+            == 0
+        )
+        with open(os.path.join(tiles, "tileset.json")) as f:
+            tileset = json.load(f)
+        assert tileset["asset"]["version"] == "1.1"
+
+        # every tile is a GLB with the triangles of its parts
+        uris = []
+        stack = [tileset["root"]]
+        while stack:
+            tile = stack.pop()
+            assert len(tile["boundingVolume"]["box"]) == 12
+            if "content" in tile:
+                uris.append(tile["content"]["uri"])
+            stack.extend(tile.get("children", []))
+        assert len(uris) > 0
+        faces = sum(
+            len(trimesh.load(os.path.join(tiles, uri), force="mesh").faces)
+            for uri in uris
+        )
+        assert faces == len(expected.faces)
+        assert stats.output_bytes > 0
+
+
+def test_options():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    # the defaults are what every conversion used before
+    glb = cascadio.convert_to_glb(data, "step", tol_linear=0.1)
+    assert (
+        cascadio.convert_to_glb(
+            data,
+            "step",
+            tol_linear=0.1,
+            mesh=cascadio.MeshOptions(),
+            write=cascadio.WriteOptions(),
+        )
+        == glb
+    )
+    expected = trimesh.load(BytesIO(glb), file_type="glb", force="mesh")
+
+    mesh_options = cascadio.MeshOptions()
+    mesh_options.control_surface_deflection = False
+    mesh_options.internal_vertices = False
+    coarse = cascadio.ConvertStats()
+    fine = cascadio.ConvertStats()
+    cascadio.convert_to_glb(data, "step", tol_linear=0.1, stats=fine)
+    cascadio.convert_to_glb(
+        data, "step", tol_linear=0.1, stats=coarse, mesh=mesh_options
+    )
+    assert 0 < coarse.triangles <= fine.triangles
+
+    write_options = cascadio.WriteOptions()
+    write_options.transform_format = cascadio.TransformFormat.TRS
+    write_options.node_name_format = cascadio.NameFormat.EMPTY
+    converter = cascadio.Converter(tol_linear=0.1, write=write_options)
+    result = converter.convert_to_glb(data, "step")
+    mesh = trimesh.load(BytesIO(result), file_type="glb", force="mesh")
+    assert len(mesh.faces) == len(expected.faces)
+
+    # placed instances are written as TRS nodes without names
+    placed = corpus.assembly(
+        corpus.model,
+        {
+            "name": "plate",
+            "children": [
+                ("left", (0, 0, 0), None),
+                ("right", (4, 0, 0), None, ((0, 0, 1), (0, 1, 0))),
+            ],
+        },
+    ).encode()
+    matrices = glb_json(cascadio.convert_to_glb(placed, "step", tol_linear=0.1))
+    assert any("matrix" in node for node in matrices["nodes"])
+    assert any(node.get("name") == "right" for node in matrices["nodes"])
+    header = glb_json(converter.convert_to_glb(placed, "step"))
+    assert all("matrix" not in node for node in header["nodes"])
+    assert any("translation" in node for node in header["nodes"])
+    assert any("rotation" in node for node in header["nodes"])
+    assert all(not node.get("name") for node in header["nodes"])
+
+    # the streaming writers cannot write TRS, so they refuse it
+    streamed = cascadio.WriteOptions(
+        low_memory=True, transform_format=cascadio.TransformFormat.TRS
+    )
+    with tempfile.TemporaryDirectory() as D:
+        step = os.path.join(D, "plate.step")
+        with open(step, "wb") as f:
+            f.write(placed)
+        for call in (
+            lambda: cascadio.step_to_glb(
+                step, os.path.join(D, "out.glb"), write=streamed
+            ),
+            lambda: cascadio.step_to_tiles(
+                step, os.path.join(D, "tiles"), write=write_options
+            ),
+        ):
+            try:
+                call()
+                raise AssertionError("TRS accepted by a streaming writer")
+            except ValueError:
+                pass
+
+
+def test_strip_attributes():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+    full = cascadio.convert_to_glb(data, "step", tol_linear=0.1)
+
+    read_options = cascadio.ReadOptions()
+    read_options.names = False
+    read_options.colors = False
+    read_options.layers = False
+    write_options = cascadio.WriteOptions()
+    write_options.normals = False
+    write_options.uvs = False
+    write_options.names = False
+    stripped = cascadio.convert_to_glb(
+        data,
+        "step",
+        tol_linear=0.1,
+        read=read_options,
+        write=write_options,
+    )
+    assert stripped[:4] == b"glTF"
+    assert len(stripped) < len(full)
+
+    length = int.from_bytes(stripped[12:16], "little")
+    header = json.loads(bytes(stripped[20 : 20 + length]))
+    for mesh in header["meshes"]:
+        assert "name" not in mesh
+        for primitive in mesh["primitives"]:
+            assert list(primitive["attributes"]) == ["POSITION"]
+    assert all("name" not in node for node in header["nodes"])
+
+    expected = trimesh.load(BytesIO(full), file_type="glb", force="mesh")
+    mesh = trimesh.load(BytesIO(stripped), file_type="glb", force="mesh")
+    assert len(mesh.faces) == len(expected.faces)
+
+
+def test_skip_metadata():
+    # validation properties, GD&T, views and materials are not
+    # transferred by default, which must not change the output
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+    read_options = cascadio.ReadOptions()
+    assert not read_options.metadata
+    skipped = cascadio.convert_to_glb(data, "step", tol_linear=0.1)
+
+    read_options.metadata = True
+    full = cascadio.convert_to_glb(
+        data, "step", tol_linear=0.1, read=read_options
+    )
+    assert skipped == full
+
+    arrays = cascadio.step_to_arrays(infile, tol_linear=0.1)
+    full_arrays = cascadio.step_to_arrays(
+        infile, tol_linear=0.1, read=read_options
+    )
+    assert len(arrays["meshes"]) == len(full_arrays["meshes"])
+    for a, b in zip(arrays["meshes"], full_arrays["meshes"]):
+        assert (a["vertices"] == b["vertices"]).all()
+        assert (a["faces"] == b["faces"]).all()
+
+
+
+def test_strip_names():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+
+    # the glTF writer leaves out names and keeps every other setting
+    write_options = cascadio.WriteOptions()
+    write_options.names = False
+    write_options.transform_format = cascadio.TransformFormat.TRS
+    write_options.binary = False
+    with tempfile.TemporaryDirectory() as D:
+        outfile = os.path.join(D, "outfile.gltf")
+        cascadio.step_to_glb(
+            infile, outfile, 0.1, 0.5, write=write_options
+        )
+        with open(outfile, "rb") as f:
+            data = f.read()
+        assert not data.startswith(b"glTF")
+        header = json.loads(data)
+        assert os.path.exists(os.path.join(D, header["buffers"][0]["uri"]))
+
+    assert all(not node.get("name") for node in header["nodes"])
+    assert all(not mesh.get("name") for mesh in header["meshes"])
+    # a matrix is only in the default format
+    assert all("matrix" not in node for node in header["nodes"])
+    for mesh in header["meshes"]:
+        for primitive in mesh["primitives"]:
+            assert "NORMAL" in primitive["attributes"]
+
+
+def test_trace():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+
+    with tempfile.TemporaryDirectory() as D:
+        outfile = os.path.join(D, "outfile.glb")
+        tracefile = os.path.join(D, "trace.json")
+        cascadio.start_trace()
+        cascadio.step_to_glb(infile, outfile, 0.05, 0.5)
+        spans = cascadio.stop_trace(tracefile)
+        with open(tracefile) as f:
+            trace = json.load(f)
+
+        # nothing is recorded once stopped
+        cascadio.step_to_glb(infile, outfile, 0.05, 0.5)
+        assert cascadio.stop_trace(tracefile) == 0
+
+    events = trace["traceEvents"]
+    assert len(events) == spans > 0
+    assert all(event["ph"] == "X" and event["dur"] >= 0 for event in events)
+    categories = {event["cat"] for event in events}
+    assert {"convert", "read", "transfer", "mesh", "write"} <= categories
+    faces = [event for event in events if event["name"] == "face"]
+    assert len(faces) > 0
+    assert all("surface" in event["args"] for event in faces)
+
+
+def test_face_timeout():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+
+    with tempfile.TemporaryDirectory() as D:
+        outfile = os.path.join(D, "outfile.glb")
+        full = cascadio.ConvertStats()
+        cascadio.step_to_glb(infile, outfile, 0.01, 0.1, stats=full)
+        assert full.timeouts == 0
+
+        # too short for any face which inserts nodes inside itself
+        mesh_options = cascadio.MeshOptions()
+        mesh_options.face_timeout = 1e-9
+        stats = cascadio.ConvertStats()
+        cascadio.step_to_glb(
+            infile, outfile, 0.01, 0.1, stats=stats, mesh=mesh_options
+        )
+        scene = trimesh.load(outfile, merge_primitives=True)
+
+    assert stats.timeouts > 0
+    assert stats.timeouts <= stats.faces
+    assert stats.faces == full.faces
+    assert 0 < stats.triangles < full.triangles
+    assert stats.to_dict()["timeouts"] == stats.timeouts
+    assert len(scene.geometry) == 1
+
 if __name__ == "__main__":
     test_convert()
+    test_convert_bytes()
+    test_convert_batch()
+    test_cache()
+    test_stats()
+    test_progress_cancel()
+    test_convert_arrays()
+    test_convert_mmap()
+    test_convert_lods()
+    test_auto_tolerance()
+    test_draco()
+    test_optimize_mesh()
+    test_dedupe()
+    test_dedupe_symmetric()
+    test_instances()
+    test_file_types()
+    test_converter()
+    test_select()
+    test_scan()
+    test_convert_async()
+    test_low_memory()
+    test_manifest()
+    test_tiles()
+    test_options()
+    test_strip_attributes()
+    test_skip_metadata()
+    test_strip_names()
+    test_trace()
+    test_face_timeout()
@@ -0,0 +1,51 @@
+import os
+import threading
+import time
+import cascadio
+from concurrent.futures import ThreadPoolExecutor
+
+cwd = os.path.abspath(os.path.dirname(__file__))
+
+
+def test_threads_release_gil():
+    infile = os.path.join(cwd, "models", "featuretype.STEP")
+    with open(infile, "rb") as f:
+        data = f.read()
+
+    def convert(_):
+        # keep OCCT single-threaded so only Python threads add parallelism
+        return cascadio.convert_to_glb(
+            data, "step", tol_linear=0.001, use_parallel=False
+        )
+
+    # warm up one-time OCCT initialization and time one conversion
+    convert(None)
+    tic = time.perf_counter()
+    expected = convert(None)
+    duration = time.perf_counter() - tic
+
+    # while a conversion runs on another thread this one keeps going:
+    # if the GIL were held the longest stall would be the whole thing
+    done = threading.Event()
+    worker = threading.Thread(target=lambda: (convert(None), done.set()))
+    ticks = 0
+    longest = 0.0
+    last = time.perf_counter()
+    worker.start()
+    while not done.is_set():
+        now = time.perf_counter()
+        longest = max(longest, now - last)
+        last = now
+        ticks += 1
+    worker.join()
+    assert ticks > 100, ticks
+    assert longest < duration * 0.5, (longest, duration)
+
+    # results should be identical no matter which thread produced them
+    with ThreadPoolExecutor(4) as pool:
+        threaded = list(pool.map(convert, range(8)))
+    assert all(len(t) == len(expected) for t in threaded)
+
+
+if __name__ == "__main__":
+    test_threads_release_gil()